@@ -20,12 +20,47 @@
 //	limitations under the License.
 
 #import <Foundation/Foundation.h>
+
+#if __has_include(<CommonCrypto/CommonCryptor.h>)
 #import <CommonCrypto/CommonCryptor.h>
+#define JFAes256CodecUsesCommonCrypto		1
+#else
+#import "JFAesCipher.h"
+#define JFAes256CodecUsesCommonCrypto		0
+
+// The Common Crypto sizes callers pass as actualKeySize, for platforms without Common Crypto.
+#define kCCKeySizeAES128					JFAesKeySize128
+#define kCCKeySizeAES192					JFAesKeySize192
+#define kCCKeySizeAES256					JFAesKeySize256
+#define kCCBlockSizeAES128					JFAesBlockSize
+#endif
+
+// The byte size below which a CTR or GCM input is not split any further across threads.
+#define JFAes256CodecMinParallelPieceSize	(NSUInteger) (256 * 1024)
+
+// The thread count denoting one thread per active processor.
+#define JFAes256CodecAllProcessors			0
+
+// The sizes of the GCM IV recommended (others are hashed into a counter block) and of the tags produced.
+#define JFAes256CodecGcmIvSize				12
+#define JFAes256CodecGcmTagSize				16
+
+// The smallest tag size accepted when decrypting.
+#define JFAes256CodecGcmMinTagSize			12
 
 
 /*
  * The encryptor and decryptor of NSData instances using AES-256 as
  * provided by the Common Crypto library provided within the iOS platform.
+ *
+ * Where Common Crypto is unavailable (Linux) the same CBC mode, PKCS7 padding and null-padded keys are
+ * implemented by JFAesCipher, on AES-NI when the CPU has it and in constant-time software otherwise,
+ * so data encrypted on one platform decrypts on the other.
+ *
+ * For bulk data there are also AES-256 in CTR and GCM modes (always through JFAesCipher), which split
+ * inputs larger than JFAes256CodecMinParallelPieceSize into pieces processed on as many threads.
+ * Each piece starts at its own counter offset and GHASHes its own ciphertext, and the partial hashes
+ * are combined with powers of the hash key, so the output is the same whatever the thread count.
  */
 @interface JFAes256Codec : NSObject
 
@@ -34,4 +69,13 @@
 + (NSData *) decryptData: (NSData *) data withKey: (NSString *) key initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize;
 + (NSData *) decryptData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize;
 
++ (NSData *) cryptCtrData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector;
++ (NSData *) cryptCtrData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector threadCount: (NSUInteger) threadCount;
++ (NSData *) encryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData **) tag;
++ (NSData *) encryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData **) tag threadCount: (NSUInteger) threadCount;
++ (NSData *) decryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData *) tag;
++ (NSData *) decryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData *) tag threadCount: (NSUInteger) threadCount;
+
++ (NSDictionary *) benchmarkGcmThreadScalingWithLength: (NSUInteger) length;
+
 @end
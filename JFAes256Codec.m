@@ -19,6 +19,204 @@
 
 #import "JFAes256Codec.h"
 
+#import "JFAesCipher.h"
+#import "JFLatencyHistogram.h"
+
+
+// The number of seconds the benchmark encrypts for at each thread count.
+#define JFAes256CodecBenchmarkDuration		0.25
+
+
+/*
+ * Encrypts or decrypts the data with AES in CBC mode with PKCS7 padding,
+ * through Common Crypto where available and JFAesCipher otherwise.
+ *
+ * Params
+ *		encrypt					YES to encrypt, NO to decrypt.
+ *		keyPtr					The null-padded key.
+ *		keySize					The number of key bytes used (16, 24 or 32).
+ *		initializationVector	The 16 byte IV or NULL for an IV of zeroes.
+ *		data					The non-empty data.
+ *
+ * Return
+ *		The encrypted or decrypted data if successful, nil otherwise.
+ */
+static NSData *JFAes256CodecCrypt(BOOL encrypt, const char *keyPtr, size_t keySize, const void *initializationVector, NSData *data) {
+	
+	NSUInteger dataLength = [data length];
+	size_t bufferSize = dataLength + kCCBlockSizeAES128;
+	void *buffer = malloc(bufferSize);
+	if (buffer == NULL) {
+		return nil;
+	}
+	
+#if JFAes256CodecUsesCommonCrypto
+	size_t numBytesCrypted = 0;
+	CCCryptorStatus result = CCCrypt(encrypt ? kCCEncrypt : kCCDecrypt,
+									 kCCAlgorithmAES128,
+									 kCCOptionPKCS7Padding,
+									 keyPtr,
+									 keySize,
+									 initializationVector, /* initialization vector (optional) */
+									 [data bytes],
+									 dataLength, /* input */
+									 buffer,
+									 bufferSize, /* output */
+									 &numBytesCrypted);
+	
+	if (result != kCCSuccess) {
+		// Encryption or decryption failed so return nil.
+		free(buffer);
+		return nil;
+	}
+#else
+	JFAesKeySchedule schedule;
+	if (!JFAesKeyScheduleInit(&schedule, (const UInt8 *) keyPtr, keySize)) {
+		// The key size was invalid so return nil.
+		free(buffer);
+		return nil;
+	}
+	
+	NSInteger numBytesCrypted;
+	if (encrypt) {
+		numBytesCrypted = (NSInteger) JFAesCbcEncrypt(&schedule, initializationVector, [data bytes], dataLength, buffer);
+	} else {
+		numBytesCrypted = JFAesCbcDecrypt(&schedule, initializationVector, [data bytes], dataLength, buffer);
+	}
+	JFAesKeyScheduleClear(&schedule);
+	
+	if (numBytesCrypted < 0) {
+		// Decryption failed so return nil.
+		free(buffer);
+		return nil;
+	}
+#endif
+	
+	NSData *val = [NSData dataWithBytes: buffer
+								 length: (NSUInteger) numBytesCrypted];
+	free(buffer);
+	return val;
+}
+
+/*
+ * Returns the number of pieces a CTR or GCM input is split into, one per thread
+ * but none smaller than JFAes256CodecMinParallelPieceSize.
+ */
+static NSUInteger JFAes256CodecPieceCount(NSUInteger length, NSUInteger threadCount) {
+	
+	if (threadCount == JFAes256CodecAllProcessors) {
+		threadCount = [[NSProcessInfo processInfo] activeProcessorCount];
+	}
+	
+	NSUInteger maxPieceCount = MAX(length / JFAes256CodecMinParallelPieceSize, (NSUInteger) 1);
+	return MAX(MIN(threadCount, maxPieceCount), (NSUInteger) 1);
+}
+
+/*
+ * Returns the index of the first block of a piece, spreading the blocks evenly over the pieces.
+ */
+static inline NSUInteger JFAes256CodecPieceStartBlock(NSUInteger piece, NSUInteger pieceCount, NSUInteger blockCount) {
+	
+	return (NSUInteger) (((UInt64) blockCount * piece) / pieceCount);
+}
+
+/*
+ * Encrypts or decrypts with AES-GCM, splitting the input into pieces processed concurrently.
+ *
+ * Params
+ *		encrypt		YES to encrypt, NO to decrypt.
+ *		tag			Receives the full 16 byte tag, computed over the ciphertext either way.
+ *
+ * Return
+ *		NO if the memory for the pieces' hashes could not be allocated.
+ */
+static BOOL JFAes256CodecGcmCrypt(BOOL encrypt, const JFAesKeySchedule *schedule, NSData *initializationVector, NSData *additionalData, const UInt8 *input, UInt8 *output, NSUInteger length, NSUInteger threadCount, UInt8 *tag) {
+	
+	JFAesGhashKey ghashKey;
+	JFAesGhashKeyInit(&ghashKey, schedule);
+	const JFAesGhashKey *ghashKeyPointer = &ghashKey;
+	
+	// The pre-counter block J0: the IV followed by 1 for 12 byte IVs, the GHASH of any other IV and its bit length.
+	UInt8 preCounterBlock[JFAesBlockSize] = { 0 };
+	NSUInteger ivLength = [initializationVector length];
+	if (ivLength == JFAes256CodecGcmIvSize) {
+		memcpy(preCounterBlock, [initializationVector bytes], ivLength);
+		preCounterBlock[JFAesBlockSize - 1] = 1;
+	} else {
+		UInt8 lengthBlock[JFAesBlockSize] = { 0 };
+		UInt64 ivBitLength = (UInt64) ivLength * 8;
+		for (NSUInteger index = 0; index < 8; index++) {
+			lengthBlock[JFAesBlockSize - 1 - index] = (UInt8) (ivBitLength >> (8 * index));
+		}
+		
+		JFAesGhashUpdate(&ghashKey, preCounterBlock, [initializationVector bytes], ivLength);
+		JFAesGhashUpdate(&ghashKey, preCounterBlock, lengthBlock, JFAesBlockSize);
+	}
+	const UInt8 *preCounterBlockPointer = preCounterBlock;
+	
+	NSUInteger blockCount = (length + JFAesBlockSize - 1) / JFAesBlockSize;
+	NSUInteger pieceCount = JFAes256CodecPieceCount(length, threadCount);
+	UInt8 (*pieceHashes)[JFAesBlockSize] = calloc(pieceCount, JFAesBlockSize);
+	if (pieceHashes == NULL) {
+		memset(&ghashKey, 0, sizeof(ghashKey));
+		return NO;
+	}
+	
+	dispatch_apply(pieceCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t piece) {
+		NSUInteger startBlock = JFAes256CodecPieceStartBlock(piece, pieceCount, blockCount);
+		NSUInteger endBlock = JFAes256CodecPieceStartBlock(piece + 1, pieceCount, blockCount);
+		NSUInteger offset = startBlock * JFAesBlockSize;
+		NSUInteger pieceLength = MIN(endBlock * JFAesBlockSize, length) - offset;
+		
+		if (pieceLength == 0) {
+			return;
+		}
+		
+		// The first counter of the message is J0 + 1, so the piece's is J0 + 1 + its first block.
+		if (encrypt) {
+			JFAesCtrCrypt(schedule, preCounterBlockPointer, JFAesCounterBits32, 1 + startBlock, input + offset, output + offset, pieceLength);
+			JFAesGhashUpdate(ghashKeyPointer, pieceHashes[piece], output + offset, pieceLength);
+		} else {
+			JFAesGhashUpdate(ghashKeyPointer, pieceHashes[piece], input + offset, pieceLength);
+			JFAesCtrCrypt(schedule, preCounterBlockPointer, JFAesCounterBits32, 1 + startBlock, input + offset, output + offset, pieceLength);
+		}
+	});
+	
+	// GHASH(A || C || lengths), folding the pieces' hashes in: each shifts what came before by its block count.
+	UInt8 hash[JFAesBlockSize] = { 0 };
+	JFAesGhashUpdate(&ghashKey, hash, [additionalData bytes], [additionalData length]);
+	
+	for (NSUInteger piece = 0; piece < pieceCount; piece++) {
+		NSUInteger startBlock = JFAes256CodecPieceStartBlock(piece, pieceCount, blockCount);
+		NSUInteger endBlock = JFAes256CodecPieceStartBlock(piece + 1, pieceCount, blockCount);
+		
+		JFAesGhashMultiplyByPower(&ghashKey, hash, endBlock - startBlock);
+		for (NSUInteger index = 0; index < JFAesBlockSize; index++) {
+			hash[index] ^= pieceHashes[piece][index];
+		}
+	}
+	
+	UInt8 lengthBlock[JFAesBlockSize];
+	UInt64 additionalDataBitLength = (UInt64) [additionalData length] * 8;
+	UInt64 dataBitLength = (UInt64) length * 8;
+	for (NSUInteger index = 0; index < 8; index++) {
+		lengthBlock[7 - index] = (UInt8) (additionalDataBitLength >> (8 * index));
+		lengthBlock[JFAesBlockSize - 1 - index] = (UInt8) (dataBitLength >> (8 * index));
+	}
+	JFAesGhashUpdate(&ghashKey, hash, lengthBlock, JFAesBlockSize);
+	
+	// The tag is E(K, J0) ^ GHASH.
+	JFAesEncryptBlocks(schedule, preCounterBlock, tag, 1);
+	for (NSUInteger index = 0; index < JFAesBlockSize; index++) {
+		tag[index] ^= hash[index];
+	}
+	
+	free(pieceHashes);
+	memset(&ghashKey, 0, sizeof(ghashKey));
+	
+	return YES;
+}
+
 
 @implementation JFAes256Codec
 
@@ -64,30 +262,8 @@
 	
 	// fetch key data
 	[key getCString: keyPtr maxLength: sizeof(keyPtr) encoding: NSUTF8StringEncoding];
-	size_t bufferSize = dataLength + kCCBlockSizeAES128;
-	void *buffer = malloc(bufferSize);
-	
-	size_t numBytesEncrypted = 0;
-	CCCryptorStatus result = CCCrypt(kCCEncrypt,
-									 kCCAlgorithmAES128,
-									 kCCOptionPKCS7Padding, 
-									 keyPtr,
-									 kCCKeySizeAES256,
-									 nil, /* initialization vector (optional) */
-									 [data bytes],
-									 dataLength, /* input */
-									 buffer,
-									 bufferSize, /* output */
-									 &numBytesEncrypted);
-	if (result != kCCSuccess) {
-		// Encryption failed so return nil.
-		free(buffer);
-		return nil;
-	}
 	
-	NSData *val = [NSData dataWithBytes: buffer length: numBytesEncrypted];
-	free(buffer);
-	return val;
+	return JFAes256CodecCrypt(YES, keyPtr, kCCKeySizeAES256, NULL, data);
 }
 
 
@@ -175,32 +351,8 @@
 	
 	// fetch key data
 	[key getCString: keyPtr maxLength: sizeof(keyPtr) encoding: NSUTF8StringEncoding];
-	size_t bufferSize = dataLength + kCCBlockSizeAES128;
-    void *buffer = malloc(bufferSize);
-	
-	size_t numBytesDecrypted = 0;
-	CCCryptorStatus result = CCCrypt(kCCDecrypt,
-									 kCCAlgorithmAES128,
-									 kCCOptionPKCS7Padding, 
-									 keyPtr,
-                                     actualKeySize,
-									 [initializationVector bytes], /* initialization vector (optional) */
-									 [data bytes],
-									 dataLength, /* input */
-									 buffer,
-									 bufferSize, /* output */
-									 &numBytesDecrypted);
-	
-	if (result != kCCSuccess) {
-		// Decryption failed so return nil.
-		free(buffer);
-		return nil;
-	}
 	
-	NSData *val = [NSData dataWithBytes: buffer
-                                 length: numBytesDecrypted];
-	free(buffer);
-	return val;
+	return JFAes256CodecCrypt(NO, keyPtr, actualKeySize, [initializationVector bytes], data);
 }
 
 /*
@@ -247,33 +399,239 @@
 	
 	// fetch key data
     const char *keyDataBytes = [keyData bytes];
-    memcpy(keyPtr, keyDataBytes, sizeof(keyPtr));
-	size_t bufferSize = dataLength + kCCBlockSizeAES128;
-    void *buffer = malloc(bufferSize);
+    memcpy(keyPtr, keyDataBytes, MIN(keyLength, (NSUInteger) kCCKeySizeAES256));
 	
-	size_t numBytesDecrypted = 0;
-	CCCryptorStatus result = CCCrypt(kCCDecrypt,
-									 kCCAlgorithmAES128,
-									 kCCOptionPKCS7Padding,
-									 keyPtr,
-                                     actualKeySize,
-									 [initializationVector bytes], /* initialization vector (optional) */
-									 [data bytes],
-									 dataLength, /* input */
-									 buffer,
-									 bufferSize, /* output */
-									 &numBytesDecrypted);
+	return JFAes256CodecCrypt(NO, keyPtr, actualKeySize, [initializationVector bytes], data);
+}
+
+
+#pragma mark - Bulk modes
+
++ (NSData *) cryptCtrData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector {
 	
-	if (result != kCCSuccess) {
-		// Decryption failed so return nil.
-		free(buffer);
+	return [JFAes256Codec cryptCtrData: data
+						   withKeyData: keyData
+				  initializationVector: initializationVector
+						   threadCount: JFAes256CodecAllProcessors];
+}
+
+/*
+ * Encrypts or decrypts (the same operation) an NSData instance with AES-256 in CTR mode,
+ * the counter block advancing as a 128 bit big-endian integer.
+ *
+ * Params
+ *		data                    The data instance to be encrypted or decrypted.
+ *                              Must be non-nil and not empty.
+ *		keyData                 The 32 byte key.
+ *      initializationVector    The 16 byte initial counter block, never to be reused with the same key.
+ *      threadCount             The number of threads to split the work across, or JFAes256CodecAllProcessors.
+ *
+ * Return
+ *		The encrypted or decrypted NSData instance if successful, nil otherwise.
+ */
++ (NSData *) cryptCtrData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector threadCount: (NSUInteger) threadCount {
+	
+	NSUInteger dataLength = [data length];
+	if (dataLength == 0 || [keyData length] != kCCKeySizeAES256 || [initializationVector length] != JFAesBlockSize) {
+		// data was nil or empty, or the key or IV was not of the right size so return nil.
 		return nil;
 	}
 	
-	NSData *val = [NSData dataWithBytes: buffer
-                                 length: numBytesDecrypted];
-	free(buffer);
-	return val;
+	JFAesKeySchedule schedule;
+	JFAesKeyScheduleInit(&schedule, [keyData bytes], kCCKeySizeAES256);
+	const JFAesKeySchedule *schedulePointer = &schedule;
+	
+	NSMutableData *output = [NSMutableData dataWithLength: dataLength];
+	const UInt8 *input = [data bytes];
+	UInt8 *outputBytes = [output mutableBytes];
+	const UInt8 *counterBlock = [initializationVector bytes];
+	
+	NSUInteger blockCount = (dataLength + JFAesBlockSize - 1) / JFAesBlockSize;
+	NSUInteger pieceCount = JFAes256CodecPieceCount(dataLength, threadCount);
+	
+	dispatch_apply(pieceCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t piece) {
+		NSUInteger startBlock = JFAes256CodecPieceStartBlock(piece, pieceCount, blockCount);
+		NSUInteger endBlock = JFAes256CodecPieceStartBlock(piece + 1, pieceCount, blockCount);
+		NSUInteger offset = startBlock * JFAesBlockSize;
+		NSUInteger pieceLength = MIN(endBlock * JFAesBlockSize, dataLength) - offset;
+		
+		JFAesCtrCrypt(schedulePointer, counterBlock, JFAesCounterBits128, startBlock, input + offset, outputBytes + offset, pieceLength);
+	});
+	
+	JFAesKeyScheduleClear(&schedule);
+	return output;
+}
+
++ (NSData *) encryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData **) tag {
+	
+	return [JFAes256Codec encryptGcmData: data
+							 withKeyData: keyData
+					initializationVector: initializationVector
+						  additionalData: additionalData
+									 tag: tag
+							 threadCount: JFAes256CodecAllProcessors];
+}
+
+/*
+ * Encrypts and authenticates an NSData instance with AES-256 in GCM mode.
+ *
+ * Params
+ *		data                    The data instance to be encrypted.
+ *                              Must be non-nil, but may be empty to only authenticate the additional data.
+ *		keyData                 The 32 byte key.
+ *      initializationVector    The IV (preferably JFAes256CodecGcmIvSize bytes), never to be reused with the same key.
+ *      additionalData          The data authenticated but not encrypted, or nil.
+ *      tag                     Receives the JFAes256CodecGcmTagSize byte authentication tag.
+ *      threadCount             The number of threads to split the work across, or JFAes256CodecAllProcessors.
+ *
+ * Return
+ *		An encrypted NSData instance if successful, nil otherwise.
+ */
++ (NSData *) encryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData **) tag threadCount: (NSUInteger) threadCount {
+	
+	if (data == nil || tag == NULL || [keyData length] != kCCKeySizeAES256 || [initializationVector length] == 0) {
+		// data, the key, the IV or the tag pointer was missing so return nil.
+		return nil;
+	}
+	
+	JFAesKeySchedule schedule;
+	JFAesKeyScheduleInit(&schedule, [keyData bytes], kCCKeySizeAES256);
+	
+	NSUInteger dataLength = [data length];
+	NSMutableData *output = [NSMutableData dataWithLength: dataLength];
+	UInt8 tagBytes[JFAes256CodecGcmTagSize];
+	
+	BOOL crypted = JFAes256CodecGcmCrypt(YES, &schedule, initializationVector, additionalData, [data bytes], [output mutableBytes], dataLength, threadCount, tagBytes);
+	JFAesKeyScheduleClear(&schedule);
+	
+	if (!crypted) {
+		// The memory could not be allocated so return nil.
+		return nil;
+	}
+	
+	*tag = [NSData dataWithBytes: tagBytes
+						  length: JFAes256CodecGcmTagSize];
+	return output;
+}
+
++ (NSData *) decryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData *) tag {
+	
+	return [JFAes256Codec decryptGcmData: data
+							 withKeyData: keyData
+					initializationVector: initializationVector
+						  additionalData: additionalData
+									 tag: tag
+							 threadCount: JFAes256CodecAllProcessors];
+}
+
+/*
+ * Decrypts an NSData instance encrypted with AES-256 in GCM mode, checking its authenticity.
+ *
+ * Params
+ *		data                    The data instance to be decrypted.
+ *                              Must be non-nil.
+ *		keyData                 The 32 byte key.
+ *      initializationVector    The IV the data was encrypted with.
+ *      additionalData          The additional data the data was encrypted with, or nil.
+ *      tag                     The authentication tag, at least JFAes256CodecGcmMinTagSize bytes.
+ *      threadCount             The number of threads to split the work across, or JFAes256CodecAllProcessors.
+ *
+ * Return
+ *		A decrypted NSData instance if the tag matched, nil otherwise.
+ */
++ (NSData *) decryptGcmData: (NSData *) data withKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector additionalData: (NSData *) additionalData tag: (NSData *) tag threadCount: (NSUInteger) threadCount {
+	
+	NSUInteger tagLength = [tag length];
+	if (data == nil || [keyData length] != kCCKeySizeAES256 || [initializationVector length] == 0
+		|| tagLength < JFAes256CodecGcmMinTagSize || tagLength > JFAes256CodecGcmTagSize) {
+		// data, the key, the IV or the tag was missing or of the wrong size so return nil.
+		return nil;
+	}
+	
+	JFAesKeySchedule schedule;
+	JFAesKeyScheduleInit(&schedule, [keyData bytes], kCCKeySizeAES256);
+	
+	NSUInteger dataLength = [data length];
+	NSMutableData *output = [NSMutableData dataWithLength: dataLength];
+	UInt8 expectedTag[JFAes256CodecGcmTagSize];
+	
+	BOOL crypted = JFAes256CodecGcmCrypt(NO, &schedule, initializationVector, additionalData, [data bytes], [output mutableBytes], dataLength, threadCount, expectedTag);
+	JFAesKeyScheduleClear(&schedule);
+	
+	if (!crypted) {
+		// The memory could not be allocated so return nil, leaving no plaintext behind.
+		bzero([output mutableBytes], dataLength);
+		return nil;
+	}
+	
+	// Compares every byte whatever the first difference, so the time taken reveals nothing about the expected tag.
+	const UInt8 *tagBytes = [tag bytes];
+	UInt8 difference = 0;
+	for (NSUInteger index = 0; index < tagLength; index++) {
+		difference |= tagBytes[index] ^ expectedTag[index];
+	}
+	
+	if (difference != 0) {
+		// The data or additional data was tampered with so return nil, leaving no plaintext behind.
+		bzero([output mutableBytes], dataLength);
+		return nil;
+	}
+	
+	return output;
+}
+
+/*
+ * Measures how the GCM encryption throughput of this machine scales with the thread count,
+ * encrypting the same input repeatedly for about a quarter of a second per thread count
+ * (or once, if that takes longer).
+ *
+ * Params
+ *		length		The byte size of the input, which should be several times
+ *					JFAes256CodecMinParallelPieceSize for the larger thread counts to be used.
+ *
+ * Return
+ *		The bytes encrypted per second (NSNumber doubles) keyed by thread count (NSNumber),
+ *		from 1 to the number of active processors, or nil if the length is 0.
+ */
++ (NSDictionary *) benchmarkGcmThreadScalingWithLength: (NSUInteger) length {
+	
+	if (length == 0) {
+		return nil;
+	}
+	
+	NSUInteger coreCount = [[NSProcessInfo processInfo] activeProcessorCount];
+	NSMutableDictionary *results = [NSMutableDictionary dictionaryWithCapacity: coreCount];
+	NSData *data = [NSMutableData dataWithLength: length];
+	NSData *keyData = [NSMutableData dataWithLength: kCCKeySizeAES256];
+	NSData *initializationVector = [NSMutableData dataWithLength: JFAes256CodecGcmIvSize];
+	
+	for (NSUInteger threadCount = 1; threadCount <= coreCount; threadCount++) {
+		NSUInteger encryptionCount = 0;
+		UInt64 start = JFLatencyHistogramNow();
+		UInt64 elapsed = 0;
+		
+		while (elapsed < (UInt64) (JFAes256CodecBenchmarkDuration * 1000000000.0)) {
+			@autoreleasepool {
+				NSData *tag = nil;
+				if ([JFAes256Codec encryptGcmData: data
+									  withKeyData: keyData
+							 initializationVector: initializationVector
+								   additionalData: nil
+											  tag: &tag
+									  threadCount: threadCount] == nil) {
+					return nil;
+				}
+			}
+			
+			encryptionCount++;
+			elapsed = JFLatencyHistogramNow() - start;
+		}
+		
+		[results setObject: [NSNumber numberWithDouble: (double) length * encryptionCount / (elapsed / 1000000000.0)]
+					forKey: [NSNumber numberWithUnsignedInteger: threadCount]];
+	}
+	
+	return results;
 }
 
 
@@ -0,0 +1,88 @@
+//
+//  JFAes256Cryptor.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFAes256Codec.h"
+
+
+#if JFAes256CodecUsesCommonCrypto
+// The number of idle Common Crypto cryptors kept per direction.
+#define JFAes256CryptorPoolSize	8
+#endif
+
+
+/*
+ * Encrypts and decrypts many records with the same key, in the CBC mode with PKCS7 padding of JFAes256Codec
+ * and with the same output, without converting and expanding the key on every call.
+ *
+ * The key is prepared once when the cryptor is created.  The byte methods work on caller-provided buffers
+ * (in place when the input and output are the same) and allocate nothing.
+ *
+ * A cryptor can be shared by any number of threads and calls run concurrently.  Where JFAesCipher is used
+ * the expanded key is only read; with Common Crypto each call takes a CCCryptor from a small lock-free pool
+ * per direction (creating one if all are in use) and returns it when done.
+ *
+ * Usage Example:
+ * JFAes256Cryptor *cryptor = [[JFAes256Cryptor alloc] initWithKey: key];
+ * UInt8 record[256];
+ * NSInteger encryptedLength = [cryptor encryptBytes: record
+ *                                            length: recordLength
+ *                                          capacity: sizeof(record)];
+ */
+@interface JFAes256Cryptor : NSObject {
+
+@private
+	// The IV every call starts from (zeroes unless given).
+	UInt8 _initializationVector[kCCBlockSizeAES128];
+
+#if JFAes256CodecUsesCommonCrypto
+	// The idle cryptors of each direction, NULL slots being empty.
+	CCCryptorRef _encryptors[JFAes256CryptorPoolSize];
+	CCCryptorRef _decryptors[JFAes256CryptorPoolSize];
+
+	// The null-padded key, kept to create more cryptors when every pooled one is in use.
+	char _key[kCCKeySizeAES256];
+	size_t _keySize;
+#else
+	// The expanded key, only read once initialized.
+	JFAesKeySchedule *_schedule;
+#endif
+}
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithKey: (NSString *) key;
+- (id) initWithKey: (NSString *) key initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize;
+- (id) initWithKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize;
+
+
+#pragma mark - Methods
+
++ (NSUInteger) encryptedLengthForLength: (NSUInteger) length;
+
+- (NSInteger) encryptBytes: (void *) bytes length: (NSUInteger) length capacity: (NSUInteger) capacity;
+- (NSInteger) decryptBytes: (void *) bytes length: (NSUInteger) length;
+- (NSInteger) encryptBytes: (const void *) input length: (NSUInteger) length intoBuffer: (void *) output capacity: (NSUInteger) capacity;
+- (NSInteger) decryptBytes: (const void *) input length: (NSUInteger) length intoBuffer: (void *) output capacity: (NSUInteger) capacity;
+- (NSData *) encryptData: (NSData *) data;
+- (NSData *) decryptData: (NSData *) data;
+
+@end
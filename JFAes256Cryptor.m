@@ -0,0 +1,425 @@
+//
+//  JFAes256Cryptor.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFAes256Cryptor.h"
+
+#import "JFGC.h"
+#import "JFMacros.h"
+
+
+@interface JFAes256Cryptor (PrivateMethods)
+
+- (BOOL) prepareKey: (const char *) keyPtr initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize;
+#if JFAes256CodecUsesCommonCrypto
+- (NSInteger) cryptBytes: (const void *) input length: (NSUInteger) length intoBuffer: (void *) output capacity: (NSUInteger) capacity operation: (CCOperation) operation;
+#endif
+
+@end
+
+
+#if JFAes256CodecUsesCommonCrypto
+
+/*
+ * Takes an idle cryptor out of the pool without locking.
+ *
+ * Return
+ *		The cryptor or NULL if the pool is empty.
+ */
+static inline CCCryptorRef JFAes256CryptorTake(CCCryptorRef *pool) {
+
+	for (NSUInteger slot = 0; slot < JFAes256CryptorPoolSize; slot++) {
+		CCCryptorRef cryptor = __atomic_exchange_n(&pool[slot], NULL, __ATOMIC_ACQUIRE);
+		if (cryptor != NULL) {
+			return cryptor;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Puts the cryptor back into an empty slot of the pool without locking, or releases it if the pool is full.
+ */
+static inline void JFAes256CryptorGiveBack(CCCryptorRef *pool, CCCryptorRef cryptor) {
+
+	for (NSUInteger slot = 0; slot < JFAes256CryptorPoolSize; slot++) {
+		CCCryptorRef empty = NULL;
+		if (__atomic_compare_exchange_n(&pool[slot], &empty, cryptor, NO, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			return;
+		}
+	}
+
+	CCCryptorRelease(cryptor);
+}
+
+/*
+ * Releases every cryptor of the pool.
+ */
+static void JFAes256CryptorDrain(CCCryptorRef *pool) {
+
+	for (NSUInteger slot = 0; slot < JFAes256CryptorPoolSize; slot++) {
+		if (pool[slot] != NULL) {
+			CCCryptorRelease(pool[slot]);
+			pool[slot] = NULL;
+		}
+	}
+}
+
+#endif
+
+
+@implementation JFAes256Cryptor
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithKey: (NSString *) key {
+
+	return [self initWithKey: key
+		initializationVector: nil
+			   actualKeySize: kCCKeySizeAES256];
+}
+
+/*
+ * Initializes a cryptor with the key conventions of JFAes256Codec.
+ *
+ * Params
+ *		key						The key, null-padded to 32 bytes.
+ *								Must be non-nil and not empty.
+ *		initializationVector	The 16 byte IV or nil for an IV of zeroes.
+ *		actualKeySize			The number of bytes used for the AES key.
+ *
+ * Return
+ *		The cryptor or nil if the key or key size is invalid.
+ */
+- (id) initWithKey: (NSString *) key initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize {
+
+	self = [super init];
+
+	if (self) {
+		// 'key' should be at most 32 bytes for AES256, will be null-padded otherwise
+		char keyPtr[kCCKeySizeAES256 + 1];
+		bzero(keyPtr, sizeof(keyPtr));
+		[key getCString: keyPtr maxLength: sizeof(keyPtr) encoding: NSUTF8StringEncoding];
+
+		BOOL prepared = ([key length] > 0 && [self prepareKey: keyPtr
+										 initializationVector: initializationVector
+												actualKeySize: actualKeySize]);
+		bzero(keyPtr, sizeof(keyPtr));
+
+		if (!prepared) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+	}
+
+	return self;
+}
+
+/*
+ * Initializes a cryptor with a raw key, null-padded to 32 bytes (as the keyData methods of JFAes256Codec do).
+ */
+- (id) initWithKeyData: (NSData *) keyData initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize {
+
+	self = [super init];
+
+	if (self) {
+		char keyPtr[kCCKeySizeAES256 + 1];
+		bzero(keyPtr, sizeof(keyPtr));
+		memcpy(keyPtr, [keyData bytes], MIN([keyData length], (NSUInteger) kCCKeySizeAES256));
+
+		BOOL prepared = ([keyData length] > 0 && [self prepareKey: keyPtr
+											 initializationVector: initializationVector
+													actualKeySize: actualKeySize]);
+		bzero(keyPtr, sizeof(keyPtr));
+
+		if (!prepared) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+	}
+
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+
+#if JFAes256CodecUsesCommonCrypto
+	JFAes256CryptorDrain(_encryptors);
+	JFAes256CryptorDrain(_decryptors);
+	bzero(_key, sizeof(_key));
+#else
+	if (_schedule != NULL) {
+		JFAesKeyScheduleClear(_schedule);
+		JFFree(_schedule);
+	}
+#endif
+}
+
+#else
+
+- (void) dealloc {
+
+#if JFAes256CodecUsesCommonCrypto
+	JFAes256CryptorDrain(_encryptors);
+	JFAes256CryptorDrain(_decryptors);
+	bzero(_key, sizeof(_key));
+#else
+	if (_schedule != NULL) {
+		JFAesKeyScheduleClear(_schedule);
+		JFFree(_schedule);
+	}
+#endif
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Methods
+
+/*
+ * Returns the length of the ciphertext of a plaintext of the given length, PKCS7 padding included,
+ * which is the capacity encryption needs.
+ */
++ (NSUInteger) encryptedLengthForLength: (NSUInteger) length {
+
+	return (length / kCCBlockSizeAES128 + 1) * kCCBlockSizeAES128;
+}
+
+/*
+ * Encrypts the bytes in place.
+ *
+ * Params
+ *		bytes		The plaintext, in a buffer with room for the padding.
+ *		capacity	The size of the buffer, at least encryptedLengthForLength: length.
+ *
+ * Return
+ *		The length of the ciphertext or -1 if the buffer is too small.
+ */
+- (NSInteger) encryptBytes: (void *) bytes length: (NSUInteger) length capacity: (NSUInteger) capacity {
+
+	return [self encryptBytes: bytes
+					   length: length
+				   intoBuffer: bytes
+					 capacity: capacity];
+}
+
+/*
+ * Decrypts the bytes in place.
+ *
+ * Return
+ *		The length of the plaintext (left at the start of the buffer) or -1 if the input is not
+ *		a whole number of blocks or the padding is invalid.
+ */
+- (NSInteger) decryptBytes: (void *) bytes length: (NSUInteger) length {
+
+	return [self decryptBytes: bytes
+					   length: length
+				   intoBuffer: bytes
+					 capacity: length];
+}
+
+/*
+ * Encrypts the input into a caller-provided buffer, which may be the input itself.
+ *
+ * Params
+ *		capacity	The size of the output buffer, at least encryptedLengthForLength: length.
+ *
+ * Return
+ *		The length of the ciphertext or -1 if the buffer is too small.
+ */
+- (NSInteger) encryptBytes: (const void *) input length: (NSUInteger) length intoBuffer: (void *) output capacity: (NSUInteger) capacity {
+
+	if ((input == NULL && length > 0) || output == NULL || capacity < [JFAes256Cryptor encryptedLengthForLength: length]) {
+		return -1;
+	}
+
+#if JFAes256CodecUsesCommonCrypto
+	return [self cryptBytes: input
+					 length: length
+				 intoBuffer: output
+				   capacity: capacity
+				  operation: kCCEncrypt];
+#else
+	return (NSInteger) JFAesCbcEncrypt(_schedule, _initializationVector, input, length, output);
+#endif
+}
+
+/*
+ * Decrypts the input into a caller-provided buffer, which may be the input itself.
+ *
+ * Params
+ *		capacity	The size of the output buffer, at least length.
+ *
+ * Return
+ *		The length of the plaintext or -1 if the buffer is too small, the input is not
+ *		a whole number of blocks or the padding is invalid.
+ */
+- (NSInteger) decryptBytes: (const void *) input length: (NSUInteger) length intoBuffer: (void *) output capacity: (NSUInteger) capacity {
+
+	if (input == NULL || output == NULL || length == 0 || capacity < length) {
+		return -1;
+	}
+
+#if JFAes256CodecUsesCommonCrypto
+	return [self cryptBytes: input
+					 length: length
+				 intoBuffer: output
+				   capacity: capacity
+				  operation: kCCDecrypt];
+#else
+	return JFAesCbcDecrypt(_schedule, _initializationVector, input, length, output);
+#endif
+}
+
+/*
+ * Encrypts an NSData instance, as encryptData:withKey: of JFAes256Codec does.
+ *
+ * Return
+ *		An encrypted NSData instance if successful, nil otherwise.
+ */
+- (NSData *) encryptData: (NSData *) data {
+
+	JFReturnNilIfNil(data);
+
+	NSUInteger length = [data length];
+	NSMutableData *output = [NSMutableData dataWithLength: [JFAes256Cryptor encryptedLengthForLength: length]];
+	NSInteger outputLength = [self encryptBytes: [data bytes]
+										 length: length
+									 intoBuffer: [output mutableBytes]
+									   capacity: [output length]];
+	if (outputLength < 0) {
+		return nil;
+	}
+
+	[output setLength: (NSUInteger) outputLength];
+	return output;
+}
+
+/*
+ * Decrypts an NSData instance, as decryptData:withKey: of JFAes256Codec does.
+ *
+ * Return
+ *		A decrypted NSData instance if successful, nil otherwise.
+ */
+- (NSData *) decryptData: (NSData *) data {
+
+	JFReturnNilIfNil(data);
+
+	NSUInteger length = [data length];
+	NSMutableData *output = [NSMutableData dataWithLength: length];
+	NSInteger outputLength = [self decryptBytes: [data bytes]
+										 length: length
+									 intoBuffer: [output mutableBytes]
+									   capacity: length];
+	if (outputLength < 0) {
+		return nil;
+	}
+
+	[output setLength: (NSUInteger) outputLength];
+	return output;
+}
+
+
+#pragma mark - Private methods
+
+/*
+ * Expands the null-padded key (or creates the Common Crypto cryptors holding it) and keeps the IV.
+ */
+- (BOOL) prepareKey: (const char *) keyPtr initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize {
+
+	if (actualKeySize > kCCKeySizeAES256) {
+		return NO;
+	}
+
+	if ([initializationVector length] >= kCCBlockSizeAES128) {
+		memcpy(_initializationVector, [initializationVector bytes], kCCBlockSizeAES128);
+	}
+
+#if JFAes256CodecUsesCommonCrypto
+	memcpy(_key, keyPtr, sizeof(_key));
+	_keySize = actualKeySize;
+
+	// Creating the first cryptor of each direction validates the key.
+	if (CCCryptorCreate(kCCEncrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, _key, _keySize, _initializationVector, &_encryptors[0]) != kCCSuccess) {
+		return NO;
+	}
+
+	return (CCCryptorCreate(kCCDecrypt, kCCAlgorithmAES128, kCCOptionPKCS7Padding, _key, _keySize, _initializationVector, &_decryptors[0]) == kCCSuccess);
+#else
+	void *schedule = NULL;
+
+	// The schedule's round keys must be 16 byte aligned for AES-NI.
+	if (posix_memalign(&schedule, 16, sizeof(JFAesKeySchedule)) != 0) {
+		return NO;
+	}
+	_schedule = schedule;
+
+	return JFAesKeyScheduleInit(_schedule, (const UInt8 *) keyPtr, actualKeySize);
+#endif
+}
+
+#if JFAes256CodecUsesCommonCrypto
+
+/*
+ * Runs the input through a pooled cryptor of the direction, creating one if every pooled one is in use,
+ * so concurrent calls each have their own.
+ *
+ * Return
+ *		The length of the output or -1 on failure.
+ */
+- (NSInteger) cryptBytes: (const void *) input length: (NSUInteger) length intoBuffer: (void *) output capacity: (NSUInteger) capacity operation: (CCOperation) operation {
+
+	CCCryptorRef *pool = (operation == kCCEncrypt) ? _encryptors : _decryptors;
+	CCCryptorRef cryptor = JFAes256CryptorTake(pool);
+	if (cryptor == NULL) {
+		if (CCCryptorCreate(operation, kCCAlgorithmAES128, kCCOptionPKCS7Padding, _key, _keySize, _initializationVector, &cryptor) != kCCSuccess) {
+			return -1;
+		}
+	} else if (CCCryptorReset(cryptor, _initializationVector) != kCCSuccess) {
+		CCCryptorRelease(cryptor);
+		return -1;
+	}
+
+	size_t numBytesUpdated = 0;
+	size_t numBytesFinalized = 0;
+
+	if (CCCryptorUpdate(cryptor, input, length, output, capacity, &numBytesUpdated) != kCCSuccess
+		|| CCCryptorFinal(cryptor, (UInt8 *) output + numBytesUpdated, capacity - numBytesUpdated, &numBytesFinalized) != kCCSuccess) {
+		// A cryptor that failed mid-stream is not reused.
+		CCCryptorRelease(cryptor);
+		return -1;
+	}
+
+	JFAes256CryptorGiveBack(pool, cryptor);
+
+	return (NSInteger) (numBytesUpdated + numBytesFinalized);
+}
+
+#endif
+
+@end
@@ -0,0 +1,93 @@
+//
+//  JFAes256StreamCryptor.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFAes256Codec.h"
+
+
+// The byte size of the chunks read from file descriptors.
+#define JFAes256StreamCryptorDefaultChunkSize	(NSUInteger) (64 * 1024)
+
+
+/*
+ * Encrypts or decrypts a stream piece by piece, in the CBC mode with PKCS7 padding of JFAes256Codec.
+ * The concatenated output of every update and the finish is the same as the one-shot
+ * JFAes256Codec output for the whole input, while only a block is ever held back between calls.
+ *
+ * Files are processed in chunks of chunkSize through two buffers allocated once per call,
+ * so memory stays constant whatever the size of the file.
+ *
+ * Usage Example:
+ * [JFAes256StreamCryptor encryptFileDescriptor: backupDescriptor
+ *                             toFileDescriptor: encryptedDescriptor
+ *                                      withKey: key];
+ */
+@interface JFAes256StreamCryptor : NSObject {
+
+@private
+	// The flag denoting whether the cryptor encrypts (or decrypts).
+	BOOL _encrypting;
+
+#if JFAes256CodecUsesCommonCrypto
+	CCCryptorRef _cryptor;
+#else
+	// The expanded key and the CBC chaining value.
+	JFAesKeySchedule *_schedule;
+	UInt8 _chainingBlock[JFAesBlockSize];
+
+	// The input not yet processed: a partial block, and when decrypting the last whole block (which may be the padding).
+	UInt8 _pendingBytes[JFAesBlockSize];
+	NSUInteger _pendingLength;
+#endif
+
+	// The byte size of the chunks read from file descriptors.
+	NSUInteger _chunkSize;
+
+	// The flag denoting whether the stream has been finished or has failed.
+	BOOL _finished;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly, getter=isEncrypting) BOOL encrypting;
+@property (nonatomic, assign) NSUInteger chunkSize;
+@property (nonatomic, readonly, getter=isFinished) BOOL finished;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initForEncryptionWithKey: (NSString *) key;
+- (id) initForDecryptionWithKey: (NSString *) key;
+- (id) initForEncryption: (BOOL) encryption withKey: (NSString *) key initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize;
+
+
+#pragma mark - Methods
+
++ (BOOL) encryptFileDescriptor: (int) inputDescriptor toFileDescriptor: (int) outputDescriptor withKey: (NSString *) key;
++ (BOOL) decryptFileDescriptor: (int) inputDescriptor toFileDescriptor: (int) outputDescriptor withKey: (NSString *) key;
+
+- (NSData *) update: (NSData *) data;
+- (NSData *) finish;
+- (NSInteger) updateBytes: (const void *) bytes length: (NSUInteger) length output: (void *) output;
+- (NSInteger) finishWithOutput: (void *) output;
+- (BOOL) processFileDescriptor: (int) inputDescriptor toFileDescriptor: (int) outputDescriptor;
+
+@end
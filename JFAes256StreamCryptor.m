@@ -0,0 +1,506 @@
+//
+//  JFAes256StreamCryptor.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFAes256StreamCryptor.h"
+
+#import "JFGC.h"
+#import "JFMacros.h"
+#import <errno.h>
+#import <unistd.h>
+
+
+/*
+ * Writes all the bytes, retrying short and interrupted writes.
+ */
+static BOOL JFAes256StreamCryptorWriteFully(int descriptor, const UInt8 *bytes, size_t length) {
+
+	while (length > 0) {
+		ssize_t written = write(descriptor, bytes, length);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return NO;
+		}
+
+		bytes += written;
+		length -= (size_t) written;
+	}
+
+	return YES;
+}
+
+
+@interface JFAes256StreamCryptor (PrivateMethods)
+
+- (void) releaseCryptor;
+#if !JFAes256CodecUsesCommonCrypto
+- (void) cryptBlocks: (const UInt8 *) input output: (UInt8 *) output count: (NSUInteger) blockCount;
+#endif
+
+@end
+
+
+@implementation JFAes256StreamCryptor
+
+
+#pragma mark - Properties
+
+@synthesize encrypting = _encrypting;
+@synthesize chunkSize = _chunkSize;
+@synthesize finished = _finished;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initForEncryptionWithKey: (NSString *) key {
+
+	return [self initForEncryption: YES
+						   withKey: key
+			  initializationVector: nil
+					 actualKeySize: kCCKeySizeAES256];
+}
+
+- (id) initForDecryptionWithKey: (NSString *) key {
+
+	return [self initForEncryption: NO
+						   withKey: key
+			  initializationVector: nil
+					 actualKeySize: kCCKeySizeAES256];
+}
+
+/*
+ * Initializes a cryptor with the key conventions of JFAes256Codec.
+ *
+ * Params
+ *		encryption				YES to encrypt, NO to decrypt.
+ *		key						The key, null-padded to 32 bytes.
+ *								Must be non-nil and not empty.
+ *		initializationVector	The 16 byte IV or nil for an IV of zeroes.
+ *								Must be exactly 16 bytes if given.
+ *		actualKeySize			The number of bytes used for the AES key.
+ *
+ * Return
+ *		The cryptor or nil if the key, IV or key size is invalid.
+ */
+- (id) initForEncryption: (BOOL) encryption withKey: (NSString *) key initializationVector: (NSData *) initializationVector actualKeySize: (NSUInteger) actualKeySize {
+
+	self = [super init];
+
+	if (self) {
+		if ([key length] == 0 || actualKeySize > kCCKeySizeAES256
+			|| (initializationVector != nil && [initializationVector length] != kCCBlockSizeAES128)) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+
+		// 'key' should be at most 32 bytes for AES256, will be null-padded otherwise
+		char keyPtr[kCCKeySizeAES256 + 1];
+		bzero(keyPtr, sizeof(keyPtr));
+		[key getCString: keyPtr maxLength: sizeof(keyPtr) encoding: NSUTF8StringEncoding];
+
+		_encrypting = encryption;
+		_chunkSize = JFAes256StreamCryptorDefaultChunkSize;
+
+#if JFAes256CodecUsesCommonCrypto
+		CCCryptorStatus result = CCCryptorCreate(encryption ? kCCEncrypt : kCCDecrypt,
+												 kCCAlgorithmAES128,
+												 kCCOptionPKCS7Padding,
+												 keyPtr,
+												 actualKeySize,
+												 [initializationVector bytes],
+												 &_cryptor);
+		BOOL succeeded = (result == kCCSuccess);
+#else
+		void *schedule = NULL;
+		BOOL succeeded = NO;
+
+		// The schedule's round keys must be 16 byte aligned for AES-NI.
+		if (posix_memalign(&schedule, 16, sizeof(JFAesKeySchedule)) == 0) {
+			_schedule = schedule;
+			succeeded = JFAesKeyScheduleInit(_schedule, (const UInt8 *) keyPtr, actualKeySize);
+		}
+
+		if (initializationVector != nil) {
+			memcpy(_chainingBlock, [initializationVector bytes], JFAesBlockSize);
+		}
+#endif
+		bzero(keyPtr, sizeof(keyPtr));
+
+		if (!succeeded) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+	}
+
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+
+	[self releaseCryptor];
+}
+
+#else
+
+- (void) dealloc {
+
+	[self releaseCryptor];
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Methods
+
+/*
+ * Encrypts a file descriptor into another until the end of the input.
+ *
+ * Return
+ *		YES if the whole input was encrypted and written, NO on a read or write error.
+ */
++ (BOOL) encryptFileDescriptor: (int) inputDescriptor toFileDescriptor: (int) outputDescriptor withKey: (NSString *) key {
+
+	JFAes256StreamCryptor *cryptor = [[JFAes256StreamCryptor alloc] initForEncryptionWithKey: key];
+	JFReturnNoIfNil(cryptor);
+
+	BOOL succeeded = [cryptor processFileDescriptor: inputDescriptor
+								   toFileDescriptor: outputDescriptor];
+
+#if !__has_feature(objc_arc) // NON ARC
+	[cryptor release];
+#endif
+
+	return succeeded;
+}
+
+/*
+ * Decrypts a file descriptor into another until the end of the input.
+ *
+ * Return
+ *		YES if the whole input was decrypted and written, NO on a read or write error or invalid padding.
+ *		The output written before a failure must be discarded.
+ */
++ (BOOL) decryptFileDescriptor: (int) inputDescriptor toFileDescriptor: (int) outputDescriptor withKey: (NSString *) key {
+
+	JFAes256StreamCryptor *cryptor = [[JFAes256StreamCryptor alloc] initForDecryptionWithKey: key];
+	JFReturnNoIfNil(cryptor);
+
+	BOOL succeeded = [cryptor processFileDescriptor: inputDescriptor
+								   toFileDescriptor: outputDescriptor];
+
+#if !__has_feature(objc_arc) // NON ARC
+	[cryptor release];
+#endif
+
+	return succeeded;
+}
+
+/*
+ * Processes the next piece of the stream.
+ *
+ * Return
+ *		The output produced (possibly empty, as up to a block is held back) or nil if the stream has finished or failed.
+ */
+- (NSData *) update: (NSData *) data {
+
+	JFReturnNilIfNil(data);
+
+	NSUInteger length = [data length];
+	NSMutableData *output = [NSMutableData dataWithLength: length + kCCBlockSizeAES128];
+	NSInteger outputLength = [self updateBytes: [data bytes]
+										length: length
+										output: [output mutableBytes]];
+	if (outputLength < 0) {
+		return nil;
+	}
+
+	[output setLength: (NSUInteger) outputLength];
+	return output;
+}
+
+/*
+ * Ends the stream, adding the padding when encrypting and checking and stripping it when decrypting.
+ *
+ * Return
+ *		The last of the output or nil if the stream had already finished, the input was not
+ *		a whole number of blocks or the padding was invalid.
+ */
+- (NSData *) finish {
+
+	UInt8 output[kCCBlockSizeAES128];
+
+	NSInteger outputLength = [self finishWithOutput: output];
+	if (outputLength < 0) {
+		return nil;
+	}
+
+	NSData *val = [NSData dataWithBytes: output
+								 length: (NSUInteger) outputLength];
+	bzero(output, sizeof(output));
+	return val;
+}
+
+/*
+ * Processes the next piece of the stream into a caller-provided buffer.
+ *
+ * Params
+ *		output	Room for length + kCCBlockSizeAES128 bytes.
+ *
+ * Return
+ *		The number of bytes written to the output or -1 if the stream has finished or failed.
+ */
+- (NSInteger) updateBytes: (const void *) bytes length: (NSUInteger) length output: (void *) output {
+
+	if (_finished) {
+		return -1;
+	}
+
+	if (length == 0) {
+		return 0;
+	}
+
+	if (bytes == NULL || output == NULL) {
+		return -1;
+	}
+
+#if JFAes256CodecUsesCommonCrypto
+	size_t numBytesCrypted = 0;
+	CCCryptorStatus result = CCCryptorUpdate(_cryptor,
+											 bytes,
+											 length,
+											 output,
+											 length + kCCBlockSizeAES128,
+											 &numBytesCrypted);
+	if (result != kCCSuccess) {
+		_finished = YES;
+		return -1;
+	}
+
+	return (NSInteger) numBytesCrypted;
+#else
+	const UInt8 *input = bytes;
+	UInt8 *outputBytes = output;
+
+	// What stays pending: the partial block, and when decrypting a last whole block too, since only the finish can strip its padding.
+	NSUInteger totalLength = _pendingLength + length;
+	NSUInteger keptLength = totalLength % JFAesBlockSize;
+	if (keptLength == 0 && !_encrypting) {
+		keptLength = JFAesBlockSize;
+	}
+
+	NSUInteger processedLength = totalLength - keptLength;
+	if (processedLength == 0) {
+		memcpy(_pendingBytes + _pendingLength, input, length);
+		_pendingLength = totalLength;
+		return 0;
+	}
+
+	NSUInteger outputLength = 0;
+
+	if (_pendingLength > 0) {
+		// Completes the pending block from the input.
+		NSUInteger fillLength = JFAesBlockSize - _pendingLength;
+		memcpy(_pendingBytes + _pendingLength, input, fillLength);
+		input += fillLength;
+		length -= fillLength;
+
+		[self cryptBlocks: _pendingBytes
+				   output: outputBytes
+					count: 1];
+		outputLength = JFAesBlockSize;
+		_pendingLength = 0;
+	}
+
+	// The remaining whole blocks go straight from the input to the output.
+	NSUInteger directLength = processedLength - outputLength;
+	[self cryptBlocks: input
+			   output: outputBytes + outputLength
+				count: directLength / JFAesBlockSize];
+	outputLength += directLength;
+
+	memcpy(_pendingBytes, input + directLength, length - directLength);
+	_pendingLength = length - directLength;
+
+	return (NSInteger) outputLength;
+#endif
+}
+
+/*
+ * Ends the stream into a caller-provided buffer.
+ *
+ * Params
+ *		output	Room for kCCBlockSizeAES128 bytes.
+ *
+ * Return
+ *		The number of bytes written to the output or -1 if the stream had already finished,
+ *		the input was not a whole number of blocks or the padding was invalid.
+ */
+- (NSInteger) finishWithOutput: (void *) output {
+
+	if (_finished || output == NULL) {
+		return -1;
+	}
+
+	_finished = YES;
+
+#if JFAes256CodecUsesCommonCrypto
+	size_t numBytesCrypted = 0;
+	CCCryptorStatus result = CCCryptorFinal(_cryptor,
+											output,
+											kCCBlockSizeAES128,
+											&numBytesCrypted);
+	if (result != kCCSuccess) {
+		return -1;
+	}
+
+	return (NSInteger) numBytesCrypted;
+#else
+	NSInteger outputLength;
+
+	if (_encrypting) {
+		// PKCS7: a whole block of padding when the input ended on a block boundary.
+		UInt8 paddingLength = (UInt8) (JFAesBlockSize - _pendingLength);
+		memset(_pendingBytes + _pendingLength, paddingLength, paddingLength);
+
+		[self cryptBlocks: _pendingBytes
+				   output: output
+					count: 1];
+		outputLength = JFAesBlockSize;
+	} else if (_pendingLength != JFAesBlockSize) {
+		outputLength = -1;
+	} else {
+		outputLength = JFAesCbcDecrypt(_schedule, _chainingBlock, _pendingBytes, JFAesBlockSize, output);
+	}
+
+	bzero(_pendingBytes, sizeof(_pendingBytes));
+	_pendingLength = 0;
+
+	return outputLength;
+#endif
+}
+
+/*
+ * Reads the input descriptor in chunks until its end, writing the output of each chunk
+ * and finally of the finish to the output descriptor.
+ * Uses two buffers allocated once, so memory stays constant whatever the size of the input.
+ *
+ * Return
+ *		YES if the whole stream was processed and written, NO on a read or write error or invalid padding.
+ */
+- (BOOL) processFileDescriptor: (int) inputDescriptor toFileDescriptor: (int) outputDescriptor {
+
+	if (_finished) {
+		return NO;
+	}
+
+	NSUInteger chunkSize = (_chunkSize > 0) ? _chunkSize : JFAes256StreamCryptorDefaultChunkSize;
+	UInt8 *inputBuffer = malloc(chunkSize);
+	UInt8 *outputBuffer = malloc(chunkSize + kCCBlockSizeAES128);
+	BOOL succeeded = (inputBuffer != NULL && outputBuffer != NULL);
+
+	while (succeeded) {
+		ssize_t bytesRead = read(inputDescriptor, inputBuffer, chunkSize);
+		if (bytesRead < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			_finished = YES;
+			succeeded = NO;
+			break;
+		}
+
+		NSInteger outputLength;
+		if (bytesRead == 0) {
+			outputLength = [self finishWithOutput: outputBuffer];
+		} else {
+			outputLength = [self updateBytes: inputBuffer
+									  length: (NSUInteger) bytesRead
+									  output: outputBuffer];
+		}
+
+		succeeded = (outputLength >= 0 && JFAes256StreamCryptorWriteFully(outputDescriptor, outputBuffer, (size_t) outputLength));
+
+		if (bytesRead == 0) {
+			break;
+		}
+	}
+
+	if (!succeeded) {
+		_finished = YES;
+	}
+
+	if (outputBuffer != NULL) {
+		bzero(outputBuffer, chunkSize + kCCBlockSizeAES128);
+	}
+	JFFree(inputBuffer);
+	JFFree(outputBuffer);
+
+	return succeeded;
+}
+
+
+#pragma mark - Private methods
+
+- (void) releaseCryptor {
+
+#if JFAes256CodecUsesCommonCrypto
+	if (_cryptor != NULL) {
+		CCCryptorRelease(_cryptor);
+		_cryptor = NULL;
+	}
+#else
+	if (_schedule != NULL) {
+		JFAesKeyScheduleClear(_schedule);
+		JFFree(_schedule);
+	}
+	bzero(_chainingBlock, sizeof(_chainingBlock));
+	bzero(_pendingBytes, sizeof(_pendingBytes));
+#endif
+}
+
+#if !JFAes256CodecUsesCommonCrypto
+
+/*
+ * Encrypts or decrypts whole blocks, chaining from the previous call.
+ */
+- (void) cryptBlocks: (const UInt8 *) input output: (UInt8 *) output count: (NSUInteger) blockCount {
+
+	if (blockCount == 0) {
+		return;
+	}
+
+	if (_encrypting) {
+		JFAesCbcEncryptBlocks(_schedule, _chainingBlock, input, output, blockCount);
+	} else {
+		JFAesCbcDecryptBlocks(_schedule, _chainingBlock, input, output, blockCount);
+	}
+}
+
+#endif
+
+@end
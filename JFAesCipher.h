@@ -0,0 +1,175 @@
+//
+//  JFAesCipher.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+
+// The AES block size in bytes.
+#define JFAesBlockSize				16
+
+// The supported key sizes in bytes.
+#define JFAesKeySize128				16
+#define JFAesKeySize192				24
+#define JFAesKeySize256				32
+
+// The number of rounds of the largest (256 bit) key.
+#define JFAesMaxRoundCount			14
+
+
+/*
+ * The expanded round keys of an AES key, in the forms both implementations need.
+ *
+ * Initialized once per key by JFAesKeyScheduleInit and only read afterwards,
+ * so a schedule can be shared by any number of threads.
+ */
+typedef struct {
+
+	// The encryption round keys, and the decryption round keys of the equivalent inverse cipher (AES-NI).
+	UInt8 encryptionRoundKeys[JFAesMaxRoundCount + 1][JFAesBlockSize] __attribute__((aligned(16)));
+	UInt8 decryptionRoundKeys[JFAesMaxRoundCount + 1][JFAesBlockSize] __attribute__((aligned(16)));
+
+	// The encryption round keys bitsliced across four blocks (software).
+	UInt64 bitslicedRoundKeys[JFAesMaxRoundCount + 1][8];
+
+	// The number of rounds (10, 12 or 14).
+	NSUInteger roundCount;
+
+	// The flag denoting whether the AES-NI instructions are used, set when the CPU supports them.
+	// Clear it to force the constant-time software implementation.
+	BOOL hardware;
+
+} JFAesKeySchedule;
+
+
+/*
+ * Returns YES if the CPU has the AES-NI instructions.
+ */
+BOOL JFAesHardwareAvailable(void);
+
+/*
+ * Returns YES if the CPU has the carry-less multiplication (PCLMULQDQ) instruction.
+ */
+BOOL JFAesCarrylessMultiplyAvailable(void);
+
+/*
+ * Expands the key into the schedule.
+ * Returns NO if the key length is not one of the supported key sizes.
+ */
+BOOL JFAesKeyScheduleInit(JFAesKeySchedule *schedule, const UInt8 *key, size_t keyLength);
+
+/*
+ * Zeroes the schedule so no key material is left behind in memory.
+ */
+void JFAesKeyScheduleClear(JFAesKeySchedule *schedule);
+
+/*
+ * Encrypts or decrypts whole blocks independently of each other (ECB).
+ * The input and output may be the same buffer.
+ */
+void JFAesEncryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount);
+void JFAesDecryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount);
+
+/*
+ * Encrypts or decrypts whole blocks in CBC mode, without padding.
+ * The chaining block holds the IV on entry and the value to chain the next call with on return.
+ * The input and output may be the same buffer.
+ */
+void JFAesCbcEncryptBlocks(const JFAesKeySchedule *schedule, UInt8 *chainingBlock, const UInt8 *input, UInt8 *output, size_t blockCount);
+void JFAesCbcDecryptBlocks(const JFAesKeySchedule *schedule, UInt8 *chainingBlock, const UInt8 *input, UInt8 *output, size_t blockCount);
+
+/*
+ * Returns the length of the CBC ciphertext of a plaintext of the given length, PKCS7 padding included.
+ */
+static inline size_t JFAesCbcEncryptedLength(size_t length) {
+
+	return (length / JFAesBlockSize + 1) * JFAesBlockSize;
+}
+
+/*
+ * Encrypts the input in CBC mode with PKCS7 padding (as CCCrypt with kCCOptionPKCS7Padding does).
+ *
+ * Params
+ *		initializationVector	The 16 byte IV or NULL for an IV of zeroes.
+ *		output					Room for JFAesCbcEncryptedLength(length) bytes.
+ *
+ * Return
+ *		The number of bytes written to the output.
+ */
+size_t JFAesCbcEncrypt(const JFAesKeySchedule *schedule, const UInt8 *initializationVector, const UInt8 *input, size_t length, UInt8 *output);
+
+/*
+ * Decrypts the input in CBC mode and strips the PKCS7 padding.
+ *
+ * Params
+ *		initializationVector	The 16 byte IV or NULL for an IV of zeroes.
+ *		output					Room for length bytes.
+ *
+ * Return
+ *		The length of the plaintext, or -1 if the input is not a whole number of blocks or the padding is invalid.
+ */
+NSInteger JFAesCbcDecrypt(const JFAesKeySchedule *schedule, const UInt8 *initializationVector, const UInt8 *input, size_t length, UInt8 *output);
+
+
+#pragma mark - Counter mode
+
+// How the counter block advances from block to block: as a whole 128 bit
+// big-endian integer (plain CTR) or in its last 32 bits only (GCM).
+#define JFAesCounterBits128			128
+#define JFAesCounterBits32			32
+
+/*
+ * XORs the input with the keystream starting at the counter block advanced by blockOffset blocks.
+ * A message can be split at block boundaries and its pieces processed independently,
+ * even concurrently, by passing each the offset of its first block.
+ * The input and output may be the same buffer.
+ */
+void JFAesCtrCrypt(const JFAesKeySchedule *schedule, const UInt8 *counterBlock, NSUInteger counterBits, UInt64 blockOffset, const UInt8 *input, UInt8 *output, size_t length);
+
+
+#pragma mark - GHASH
+
+/*
+ * The hash key of GCM's GHASH, H = E(K, 0^128).
+ */
+typedef struct {
+
+	// H as stored in a block, and as two big-endian words for the software multiplication.
+	UInt8 hashKey[JFAesBlockSize] __attribute__((aligned(16)));
+	UInt64 high;
+	UInt64 low;
+
+	// The flag denoting whether the PCLMULQDQ instruction is used.
+	BOOL carryless;
+
+} JFAesGhashKey;
+
+void JFAesGhashKeyInit(JFAesGhashKey *ghashKey, const JFAesKeySchedule *schedule);
+
+/*
+ * Folds the bytes into the GHASH state (state = (state ^ block) * H for each block),
+ * zero-padding a partial last block.
+ */
+void JFAesGhashUpdate(const JFAesGhashKey *ghashKey, UInt8 *state, const UInt8 *bytes, size_t length);
+
+/*
+ * Multiplies the state by H^exponent.
+ * Combines GHASH states computed separately: the state of A followed by B is
+ * the state of A multiplied by H^(blocks of B), XORed with the state of B alone.
+ */
+void JFAesGhashMultiplyByPower(const JFAesGhashKey *ghashKey, UInt8 *state, UInt64 exponent);
@@ -0,0 +1,1124 @@
+//
+//  JFAesCipher.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFAesCipher.h"
+
+#import <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JFAesCipherHasAesNi			1
+#import <emmintrin.h>
+#import <tmmintrin.h>
+#import <wmmintrin.h>
+#else
+#define JFAesCipherHasAesNi			0
+#endif
+
+
+// The number of blocks the software implementation processes at once, one per 16 bit lane of a plane.
+#define JFAesSoftwareParallelBlockCount		4
+
+// The number of blocks the AES-NI implementation keeps in flight to hide the instruction latency.
+#define JFAesHardwareParallelBlockCount		8
+
+// The number of counter blocks encrypted per call in counter mode.
+#define JFAesCtrBatchBlockCount				32
+
+
+static inline UInt64 JFAesLoadBigEndian64(const UInt8 *bytes) {
+
+	UInt64 value;
+	memcpy(&value, bytes, sizeof(value));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+
+	return value;
+}
+
+static inline void JFAesStoreBigEndian64(UInt8 *bytes, UInt64 value) {
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+
+	memcpy(bytes, &value, sizeof(value));
+}
+
+
+#pragma mark - Software implementation
+
+/*
+ * The software implementation is bitsliced so it never indexes memory with secret data and runs in constant time.
+ *
+ * Four blocks are held as eight 64 bit planes, plane k holding bit k of every byte.  Byte i of block b is
+ * at bit (4 * i + b), so each nibble holds one byte position of the four blocks, each 16 bit group one column
+ * and ShiftRows and MixColumns become rotations of whole planes.
+ */
+
+/*
+ * Spreads the bytes at one position of up to four blocks into the planes.
+ */
+static inline void JFAesSoftwareLoad(UInt64 *q, const UInt8 *blocks, size_t blockCount) {
+
+	memset(q, 0, 8 * sizeof(UInt64));
+
+	for (NSUInteger position = 0; position < JFAesBlockSize; position++) {
+		UInt64 word = 0;
+		for (NSUInteger block = 0; block < blockCount; block++) {
+			word |= (UInt64) blocks[block * JFAesBlockSize + position] << (8 * block);
+		}
+
+		for (NSUInteger bit = 0; bit < 8; bit++) {
+			// Gathers bit k of the four bytes (at bits 0, 8, 16 and 24) into a nibble.
+			UInt64 nibble = ((((word >> bit) & 0x01010101) * 0x01020408) >> 24) & 0xF;
+			q[bit] |= nibble << (4 * position);
+		}
+	}
+}
+
+/*
+ * Gathers the planes back into up to four blocks.
+ */
+static inline void JFAesSoftwareStore(const UInt64 *q, UInt8 *blocks, size_t blockCount) {
+
+	for (NSUInteger position = 0; position < JFAesBlockSize; position++) {
+		UInt64 word = 0;
+		for (NSUInteger bit = 0; bit < 8; bit++) {
+			// Spreads a nibble back out to bit k of four bytes.
+			UInt64 nibble = (q[bit] >> (4 * position)) & 0xF;
+			word |= ((nibble * 0x00204081) & 0x01010101) << bit;
+		}
+
+		for (NSUInteger block = 0; block < blockCount; block++) {
+			blocks[block * JFAesBlockSize + position] = (UInt8) (word >> (8 * block));
+		}
+	}
+}
+
+static inline void JFAesSoftwareAddRoundKey(UInt64 *q, const UInt64 *roundKey) {
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		q[bit] ^= roundKey[bit];
+	}
+}
+
+/*
+ * The S-box as the 113 gate circuit of Boyar and Peralta.
+ */
+static void JFAesSoftwareSubBytes(UInt64 *q) {
+
+	UInt64 x0, x1, x2, x3, x4, x5, x6, x7;
+	UInt64 y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	UInt64 y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	UInt64 y20, y21;
+	UInt64 z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	UInt64 z10, z11, z12, z13, z14, z15, z16, z17;
+	UInt64 t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	UInt64 t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	UInt64 t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	UInt64 t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	UInt64 t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	UInt64 t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	UInt64 t60, t61, t62, t63, t64, t65, t66, t67;
+	UInt64 s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	// The top linear transformation.
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	// The non-linear section (the inversion in GF(2^8)).
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	// The bottom linear transformation (including the affine constant 0x63).
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+/*
+ * The inverse of the S-box's affine transformation, y -> A^-1 * y ^ 0x05.
+ */
+static inline void JFAesSoftwareInverseAffine(UInt64 *q) {
+
+	UInt64 y[8];
+	memcpy(y, q, sizeof(y));
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		q[bit] = y[(bit + 2) & 7] ^ y[(bit + 5) & 7] ^ y[(bit + 7) & 7];
+	}
+	q[0] = ~q[0];
+	q[2] = ~q[2];
+}
+
+/*
+ * The inverse S-box, as the inverse affine transformation around the forward S-box:
+ * with f the inverse affine transformation, f(S(x)) = x^-1, so f(S(f(y))) = f(y)^-1 = S^-1(y).
+ */
+static void JFAesSoftwareInverseSubBytes(UInt64 *q) {
+
+	JFAesSoftwareInverseAffine(q);
+	JFAesSoftwareSubBytes(q);
+	JFAesSoftwareInverseAffine(q);
+}
+
+static inline UInt64 JFAesSoftwareRotateRight(UInt64 x, unsigned count) {
+
+	return (x >> count) | (x << (64 - count));
+}
+
+static inline UInt64 JFAesSoftwareRotateLeft(UInt64 x, unsigned count) {
+
+	return (x << count) | (x >> (64 - count));
+}
+
+static inline void JFAesSoftwareShiftRows(UInt64 *q) {
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		UInt64 x = q[bit];
+		q[bit] = (x & 0x000F000F000F000FULL)
+			| JFAesSoftwareRotateRight(x & 0x00F000F000F000F0ULL, 16)
+			| JFAesSoftwareRotateRight(x & 0x0F000F000F000F00ULL, 32)
+			| JFAesSoftwareRotateRight(x & 0xF000F000F000F000ULL, 48);
+	}
+}
+
+static inline void JFAesSoftwareInverseShiftRows(UInt64 *q) {
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		UInt64 x = q[bit];
+		q[bit] = (x & 0x000F000F000F000FULL)
+			| JFAesSoftwareRotateLeft(x & 0x00F000F000F000F0ULL, 16)
+			| JFAesSoftwareRotateLeft(x & 0x0F000F000F000F00ULL, 32)
+			| JFAesSoftwareRotateLeft(x & 0xF000F000F000F000ULL, 48);
+	}
+}
+
+/*
+ * Moves every row of each column up by one (row r receives row r + 1), or by two.
+ */
+static inline UInt64 JFAesSoftwareRotateColumnByOne(UInt64 x) {
+
+	return ((x >> 4) & 0x0FFF0FFF0FFF0FFFULL) | ((x << 12) & 0xF000F000F000F000ULL);
+}
+
+static inline UInt64 JFAesSoftwareRotateColumnByTwo(UInt64 x) {
+
+	return ((x >> 8) & 0x00FF00FF00FF00FFULL) | ((x << 8) & 0xFF00FF00FF00FF00ULL);
+}
+
+/*
+ * Multiplies every byte by x in GF(2^8).
+ */
+static inline void JFAesSoftwareMultiplyByX(UInt64 *q) {
+
+	UInt64 high = q[7];
+
+	q[7] = q[6];
+	q[6] = q[5];
+	q[5] = q[4];
+	q[4] = q[3] ^ high;
+	q[3] = q[2] ^ high;
+	q[2] = q[1];
+	q[1] = q[0] ^ high;
+	q[0] = high;
+}
+
+/*
+ * b[r] = 2 * a[r] ^ 3 * a[r + 1] ^ a[r + 2] ^ a[r + 3]
+ *      = 2 * (a[r] ^ a[r + 1]) ^ a[r + 1] ^ a[r + 2] ^ a[r + 3]
+ */
+static inline void JFAesSoftwareMixColumns(UInt64 *q) {
+
+	UInt64 sum[8];
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		UInt64 rotated = JFAesSoftwareRotateColumnByOne(q[bit]);
+		UInt64 pair = q[bit] ^ rotated;
+
+		sum[bit] = rotated ^ JFAesSoftwareRotateColumnByTwo(pair);
+		q[bit] = pair;
+	}
+
+	JFAesSoftwareMultiplyByX(q);
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		q[bit] ^= sum[bit];
+	}
+}
+
+/*
+ * InvMixColumns as a premultiplication by (4x^2 + 5) followed by MixColumns:
+ * a[r] ^= 4 * (a[r] ^ a[r + 2]).
+ */
+static inline void JFAesSoftwareInverseMixColumns(UInt64 *q) {
+
+	UInt64 original[8];
+	memcpy(original, q, sizeof(original));
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		q[bit] ^= JFAesSoftwareRotateColumnByTwo(q[bit]);
+	}
+
+	JFAesSoftwareMultiplyByX(q);
+	JFAesSoftwareMultiplyByX(q);
+
+	for (NSUInteger bit = 0; bit < 8; bit++) {
+		q[bit] ^= original[bit];
+	}
+
+	JFAesSoftwareMixColumns(q);
+}
+
+static void JFAesSoftwareEncryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+	NSUInteger roundCount = schedule->roundCount;
+	UInt64 q[8];
+
+	while (blockCount > 0) {
+		size_t count = MIN(blockCount, (size_t) JFAesSoftwareParallelBlockCount);
+
+		JFAesSoftwareLoad(q, input, count);
+		JFAesSoftwareAddRoundKey(q, schedule->bitslicedRoundKeys[0]);
+
+		for (NSUInteger round = 1; round < roundCount; round++) {
+			JFAesSoftwareSubBytes(q);
+			JFAesSoftwareShiftRows(q);
+			JFAesSoftwareMixColumns(q);
+			JFAesSoftwareAddRoundKey(q, schedule->bitslicedRoundKeys[round]);
+		}
+
+		JFAesSoftwareSubBytes(q);
+		JFAesSoftwareShiftRows(q);
+		JFAesSoftwareAddRoundKey(q, schedule->bitslicedRoundKeys[roundCount]);
+		JFAesSoftwareStore(q, output, count);
+
+		input += count * JFAesBlockSize;
+		output += count * JFAesBlockSize;
+		blockCount -= count;
+	}
+
+	memset(q, 0, sizeof(q));
+}
+
+static void JFAesSoftwareDecryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+	NSUInteger roundCount = schedule->roundCount;
+	UInt64 q[8];
+
+	while (blockCount > 0) {
+		size_t count = MIN(blockCount, (size_t) JFAesSoftwareParallelBlockCount);
+
+		JFAesSoftwareLoad(q, input, count);
+		JFAesSoftwareAddRoundKey(q, schedule->bitslicedRoundKeys[roundCount]);
+
+		for (NSUInteger round = roundCount - 1; round > 0; round--) {
+			JFAesSoftwareInverseShiftRows(q);
+			JFAesSoftwareInverseSubBytes(q);
+			JFAesSoftwareAddRoundKey(q, schedule->bitslicedRoundKeys[round]);
+			JFAesSoftwareInverseMixColumns(q);
+		}
+
+		JFAesSoftwareInverseShiftRows(q);
+		JFAesSoftwareInverseSubBytes(q);
+		JFAesSoftwareAddRoundKey(q, schedule->bitslicedRoundKeys[0]);
+		JFAesSoftwareStore(q, output, count);
+
+		input += count * JFAesBlockSize;
+		output += count * JFAesBlockSize;
+		blockCount -= count;
+	}
+
+	memset(q, 0, sizeof(q));
+}
+
+/*
+ * Substitutes the four bytes of a key schedule word, in constant time like the rounds.
+ */
+static void JFAesSoftwareSubWord(UInt8 *word) {
+
+	UInt8 block[JFAesBlockSize] = { 0 };
+	UInt64 q[8];
+
+	memcpy(block, word, 4);
+	JFAesSoftwareLoad(q, block, 1);
+	JFAesSoftwareSubBytes(q);
+	JFAesSoftwareStore(q, block, 1);
+	memcpy(word, block, 4);
+
+	memset(block, 0, sizeof(block));
+	memset(q, 0, sizeof(q));
+}
+
+
+#pragma mark - AES-NI implementation
+
+#if JFAesCipherHasAesNi
+
+__attribute__((target("aes,sse2")))
+static void JFAesHardwareEncryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+	int roundCount = (int) schedule->roundCount;
+	__m128i roundKeys[JFAesMaxRoundCount + 1];
+
+	for (int round = 0; round <= roundCount; round++) {
+		roundKeys[round] = _mm_load_si128((const __m128i *) schedule->encryptionRoundKeys[round]);
+	}
+
+	while (blockCount >= JFAesHardwareParallelBlockCount) {
+		__m128i blocks[JFAesHardwareParallelBlockCount];
+
+		for (int index = 0; index < JFAesHardwareParallelBlockCount; index++) {
+			blocks[index] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) input + index), roundKeys[0]);
+		}
+		for (int round = 1; round < roundCount; round++) {
+			for (int index = 0; index < JFAesHardwareParallelBlockCount; index++) {
+				blocks[index] = _mm_aesenc_si128(blocks[index], roundKeys[round]);
+			}
+		}
+		for (int index = 0; index < JFAesHardwareParallelBlockCount; index++) {
+			_mm_storeu_si128((__m128i *) output + index, _mm_aesenclast_si128(blocks[index], roundKeys[roundCount]));
+		}
+
+		input += JFAesHardwareParallelBlockCount * JFAesBlockSize;
+		output += JFAesHardwareParallelBlockCount * JFAesBlockSize;
+		blockCount -= JFAesHardwareParallelBlockCount;
+	}
+
+	for (; blockCount > 0; blockCount--) {
+		__m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *) input), roundKeys[0]);
+
+		for (int round = 1; round < roundCount; round++) {
+			block = _mm_aesenc_si128(block, roundKeys[round]);
+		}
+		_mm_storeu_si128((__m128i *) output, _mm_aesenclast_si128(block, roundKeys[roundCount]));
+
+		input += JFAesBlockSize;
+		output += JFAesBlockSize;
+	}
+}
+
+__attribute__((target("aes,sse2")))
+static void JFAesHardwareDecryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+	int roundCount = (int) schedule->roundCount;
+	__m128i roundKeys[JFAesMaxRoundCount + 1];
+
+	for (int round = 0; round <= roundCount; round++) {
+		roundKeys[round] = _mm_load_si128((const __m128i *) schedule->decryptionRoundKeys[round]);
+	}
+
+	while (blockCount >= JFAesHardwareParallelBlockCount) {
+		__m128i blocks[JFAesHardwareParallelBlockCount];
+
+		for (int index = 0; index < JFAesHardwareParallelBlockCount; index++) {
+			blocks[index] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) input + index), roundKeys[0]);
+		}
+		for (int round = 1; round < roundCount; round++) {
+			for (int index = 0; index < JFAesHardwareParallelBlockCount; index++) {
+				blocks[index] = _mm_aesdec_si128(blocks[index], roundKeys[round]);
+			}
+		}
+		for (int index = 0; index < JFAesHardwareParallelBlockCount; index++) {
+			_mm_storeu_si128((__m128i *) output + index, _mm_aesdeclast_si128(blocks[index], roundKeys[roundCount]));
+		}
+
+		input += JFAesHardwareParallelBlockCount * JFAesBlockSize;
+		output += JFAesHardwareParallelBlockCount * JFAesBlockSize;
+		blockCount -= JFAesHardwareParallelBlockCount;
+	}
+
+	for (; blockCount > 0; blockCount--) {
+		__m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *) input), roundKeys[0]);
+
+		for (int round = 1; round < roundCount; round++) {
+			block = _mm_aesdec_si128(block, roundKeys[round]);
+		}
+		_mm_storeu_si128((__m128i *) output, _mm_aesdeclast_si128(block, roundKeys[roundCount]));
+
+		input += JFAesBlockSize;
+		output += JFAesBlockSize;
+	}
+}
+
+__attribute__((target("aes,sse2")))
+static void JFAesHardwareCbcEncryptBlocks(const JFAesKeySchedule *schedule, UInt8 *chainingBlock, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+	int roundCount = (int) schedule->roundCount;
+	__m128i roundKeys[JFAesMaxRoundCount + 1];
+
+	for (int round = 0; round <= roundCount; round++) {
+		roundKeys[round] = _mm_load_si128((const __m128i *) schedule->encryptionRoundKeys[round]);
+	}
+
+	// Each block depends on the previous one, so only a single block is ever in flight.
+	__m128i chain = _mm_loadu_si128((const __m128i *) chainingBlock);
+
+	for (; blockCount > 0; blockCount--) {
+		chain = _mm_xor_si128(_mm_loadu_si128((const __m128i *) input), chain);
+		chain = _mm_xor_si128(chain, roundKeys[0]);
+
+		for (int round = 1; round < roundCount; round++) {
+			chain = _mm_aesenc_si128(chain, roundKeys[round]);
+		}
+		chain = _mm_aesenclast_si128(chain, roundKeys[roundCount]);
+		_mm_storeu_si128((__m128i *) output, chain);
+
+		input += JFAesBlockSize;
+		output += JFAesBlockSize;
+	}
+
+	_mm_storeu_si128((__m128i *) chainingBlock, chain);
+}
+
+__attribute__((target("aes,sse2")))
+static void JFAesHardwareCbcDecryptBlocks(const JFAesKeySchedule *schedule, UInt8 *chainingBlock, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+	int roundCount = (int) schedule->roundCount;
+	__m128i roundKeys[JFAesMaxRoundCount + 1];
+
+	for (int round = 0; round <= roundCount; round++) {
+		roundKeys[round] = _mm_load_si128((const __m128i *) schedule->decryptionRoundKeys[round]);
+	}
+
+	__m128i chain = _mm_loadu_si128((const __m128i *) chainingBlock);
+
+	// Unlike encryption, the blocks decrypt independently and only the final XOR needs the previous ciphertext.
+	while (blockCount > 0) {
+		__m128i ciphertexts[JFAesHardwareParallelBlockCount];
+		__m128i blocks[JFAesHardwareParallelBlockCount];
+		int count = (int) MIN(blockCount, (size_t) JFAesHardwareParallelBlockCount);
+
+		for (int index = 0; index < count; index++) {
+			ciphertexts[index] = _mm_loadu_si128((const __m128i *) input + index);
+			blocks[index] = _mm_xor_si128(ciphertexts[index], roundKeys[0]);
+		}
+		for (int round = 1; round < roundCount; round++) {
+			for (int index = 0; index < count; index++) {
+				blocks[index] = _mm_aesdec_si128(blocks[index], roundKeys[round]);
+			}
+		}
+		for (int index = 0; index < count; index++) {
+			blocks[index] = _mm_aesdeclast_si128(blocks[index], roundKeys[roundCount]);
+			_mm_storeu_si128((__m128i *) output + index, _mm_xor_si128(blocks[index], chain));
+			chain = ciphertexts[index];
+		}
+
+		input += count * JFAesBlockSize;
+		output += count * JFAesBlockSize;
+		blockCount -= count;
+	}
+
+	_mm_storeu_si128((__m128i *) chainingBlock, chain);
+}
+
+/*
+ * Derives the decryption round keys of the equivalent inverse cipher (reversed, with InvMixColumns applied).
+ */
+__attribute__((target("aes,sse2")))
+static void JFAesHardwarePrepareDecryptionRoundKeys(JFAesKeySchedule *schedule) {
+
+	NSUInteger roundCount = schedule->roundCount;
+
+	memcpy(schedule->decryptionRoundKeys[0], schedule->encryptionRoundKeys[roundCount], JFAesBlockSize);
+	for (NSUInteger round = 1; round < roundCount; round++) {
+		__m128i roundKey = _mm_load_si128((const __m128i *) schedule->encryptionRoundKeys[roundCount - round]);
+		_mm_store_si128((__m128i *) schedule->decryptionRoundKeys[round], _mm_aesimc_si128(roundKey));
+	}
+	memcpy(schedule->decryptionRoundKeys[roundCount], schedule->encryptionRoundKeys[0], JFAesBlockSize);
+}
+
+/*
+ * Multiplies in GHASH's field, on operands byte-reversed so the bit order matches
+ * PCLMULQDQ's (the method of Intel's carry-less multiplication white paper).
+ */
+__attribute__((target("pclmul,ssse3,sse2")))
+static inline __m128i JFAesHardwareGhashMultiply(__m128i a, __m128i b) {
+
+	__m128i low = _mm_clmulepi64_si128(a, b, 0x00);
+	__m128i middle = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+	__m128i high = _mm_clmulepi64_si128(a, b, 0x11);
+
+	low = _mm_xor_si128(low, _mm_slli_si128(middle, 8));
+	high = _mm_xor_si128(high, _mm_srli_si128(middle, 8));
+
+	// Shifts the 256 bit product left by one, as the operands are bit-reflected.
+	__m128i lowCarries = _mm_srli_epi32(low, 31);
+	__m128i highCarries = _mm_srli_epi32(high, 31);
+	low = _mm_slli_epi32(low, 1);
+	high = _mm_slli_epi32(high, 1);
+	__m128i crossCarry = _mm_srli_si128(lowCarries, 12);
+	highCarries = _mm_slli_si128(highCarries, 4);
+	lowCarries = _mm_slli_si128(lowCarries, 4);
+	low = _mm_or_si128(low, lowCarries);
+	high = _mm_or_si128(high, highCarries);
+	high = _mm_or_si128(high, crossCarry);
+
+	// Reduces modulo x^128 + x^7 + x^2 + x + 1.
+	__m128i reduction = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(low, 31), _mm_slli_epi32(low, 30)), _mm_slli_epi32(low, 25));
+	__m128i reductionCarry = _mm_srli_si128(reduction, 4);
+	reduction = _mm_slli_si128(reduction, 12);
+	low = _mm_xor_si128(low, reduction);
+
+	__m128i folded = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(low, 1), _mm_srli_epi32(low, 2)), _mm_srli_epi32(low, 7));
+	folded = _mm_xor_si128(folded, reductionCarry);
+	low = _mm_xor_si128(low, folded);
+
+	return _mm_xor_si128(high, low);
+}
+
+__attribute__((target("pclmul,ssse3,sse2")))
+static void JFAesHardwareGhashUpdate(const JFAesGhashKey *ghashKey, UInt8 *state, const UInt8 *bytes, size_t length) {
+
+	const __m128i byteReversal = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i hashKey = _mm_shuffle_epi8(_mm_load_si128((const __m128i *) ghashKey->hashKey), byteReversal);
+	__m128i hash = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) state), byteReversal);
+
+	for (; length >= JFAesBlockSize; length -= JFAesBlockSize) {
+		__m128i block = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) bytes), byteReversal);
+		hash = JFAesHardwareGhashMultiply(_mm_xor_si128(hash, block), hashKey);
+		bytes += JFAesBlockSize;
+	}
+
+	if (length > 0) {
+		UInt8 lastBlock[JFAesBlockSize] = { 0 };
+		memcpy(lastBlock, bytes, length);
+
+		__m128i block = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) lastBlock), byteReversal);
+		hash = JFAesHardwareGhashMultiply(_mm_xor_si128(hash, block), hashKey);
+	}
+
+	_mm_storeu_si128((__m128i *) state, _mm_shuffle_epi8(hash, byteReversal));
+}
+
+#endif
+
+
+#pragma mark - Software GHASH
+
+/*
+ * Multiplies x by y in GHASH's field, bit by bit under masks so the time taken does not depend on the operands.
+ */
+static void JFAesSoftwareGhashMultiply(UInt64 *xHigh, UInt64 *xLow, UInt64 yHigh, UInt64 yLow) {
+
+	UInt64 productHigh = 0;
+	UInt64 productLow = 0;
+	UInt64 high = *xHigh;
+	UInt64 low = *xLow;
+
+	for (NSUInteger index = 0; index < 128; index++) {
+		// The bits of x from its most significant (GHASH's x^0) down.
+		UInt64 bit = (index < 64) ? (high >> (63 - index)) : (low >> (127 - index));
+		UInt64 mask = 0 - (bit & 1);
+		productHigh ^= yHigh & mask;
+		productLow ^= yLow & mask;
+
+		// y *= x, reducing by x^128 + x^7 + x^2 + x + 1 (0xE1 in the reflected bit order).
+		UInt64 reduction = 0 - (yLow & 1);
+		yLow = (yLow >> 1) | (yHigh << 63);
+		yHigh = (yHigh >> 1) ^ (0xE100000000000000ULL & reduction);
+	}
+
+	*xHigh = productHigh;
+	*xLow = productLow;
+}
+
+static void JFAesSoftwareGhashUpdate(const JFAesGhashKey *ghashKey, UInt8 *state, const UInt8 *bytes, size_t length) {
+
+	UInt64 high = JFAesLoadBigEndian64(state);
+	UInt64 low = JFAesLoadBigEndian64(state + 8);
+
+	for (; length >= JFAesBlockSize; length -= JFAesBlockSize) {
+		high ^= JFAesLoadBigEndian64(bytes);
+		low ^= JFAesLoadBigEndian64(bytes + 8);
+		JFAesSoftwareGhashMultiply(&high, &low, ghashKey->high, ghashKey->low);
+		bytes += JFAesBlockSize;
+	}
+
+	if (length > 0) {
+		UInt8 lastBlock[JFAesBlockSize] = { 0 };
+		memcpy(lastBlock, bytes, length);
+
+		high ^= JFAesLoadBigEndian64(lastBlock);
+		low ^= JFAesLoadBigEndian64(lastBlock + 8);
+		JFAesSoftwareGhashMultiply(&high, &low, ghashKey->high, ghashKey->low);
+	}
+
+	JFAesStoreBigEndian64(state, high);
+	JFAesStoreBigEndian64(state + 8, low);
+}
+
+
+#pragma mark - Functions
+
+BOOL JFAesHardwareAvailable(void) {
+
+#if JFAesCipherHasAesNi
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("aes") ? YES : NO;
+#else
+	return NO;
+#endif
+}
+
+BOOL JFAesCarrylessMultiplyAvailable(void) {
+
+#if JFAesCipherHasAesNi
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") ? YES : NO;
+#else
+	return NO;
+#endif
+}
+
+BOOL JFAesKeyScheduleInit(JFAesKeySchedule *schedule, const UInt8 *key, size_t keyLength) {
+
+	if (schedule == NULL || key == NULL) {
+		return NO;
+	}
+
+	if (keyLength != JFAesKeySize128 && keyLength != JFAesKeySize192 && keyLength != JFAesKeySize256) {
+		return NO;
+	}
+
+	memset(schedule, 0, sizeof(*schedule));
+
+	NSUInteger keyWordCount = keyLength / 4;
+	NSUInteger roundCount = keyWordCount + 6;
+	NSUInteger wordCount = 4 * (roundCount + 1);
+	UInt8 *words = (UInt8 *) schedule->encryptionRoundKeys;
+	UInt8 roundConstant = 0x01;
+
+	// The key expansion of FIPS-197, filling the round keys in place.
+	memcpy(words, key, keyLength);
+	for (NSUInteger index = keyWordCount; index < wordCount; index++) {
+		UInt8 word[4];
+		memcpy(word, words + 4 * (index - 1), 4);
+
+		if (index % keyWordCount == 0) {
+			UInt8 first = word[0];
+			word[0] = word[1];
+			word[1] = word[2];
+			word[2] = word[3];
+			word[3] = first;
+
+			JFAesSoftwareSubWord(word);
+			word[0] ^= roundConstant;
+			roundConstant = (UInt8) ((roundConstant << 1) ^ ((roundConstant >> 7) * 0x1B));
+		} else if (keyWordCount > 6 && index % keyWordCount == 4) {
+			JFAesSoftwareSubWord(word);
+		}
+
+		for (NSUInteger byte = 0; byte < 4; byte++) {
+			words[4 * index + byte] = words[4 * (index - keyWordCount) + byte] ^ word[byte];
+		}
+		memset(word, 0, sizeof(word));
+	}
+
+	schedule->roundCount = roundCount;
+
+	for (NSUInteger round = 0; round <= roundCount; round++) {
+		UInt8 blocks[JFAesSoftwareParallelBlockCount * JFAesBlockSize];
+
+		for (NSUInteger block = 0; block < JFAesSoftwareParallelBlockCount; block++) {
+			memcpy(blocks + block * JFAesBlockSize, schedule->encryptionRoundKeys[round], JFAesBlockSize);
+		}
+		JFAesSoftwareLoad(schedule->bitslicedRoundKeys[round], blocks, JFAesSoftwareParallelBlockCount);
+		memset(blocks, 0, sizeof(blocks));
+	}
+
+#if JFAesCipherHasAesNi
+	schedule->hardware = JFAesHardwareAvailable();
+	if (schedule->hardware) {
+		JFAesHardwarePrepareDecryptionRoundKeys(schedule);
+	}
+#endif
+
+	return YES;
+}
+
+void JFAesKeyScheduleClear(JFAesKeySchedule *schedule) {
+
+	if (schedule == NULL) {
+		return;
+	}
+
+	// Through a volatile pointer so the compiler cannot drop the stores to memory about to be released.
+	volatile UInt8 *bytes = (volatile UInt8 *) schedule;
+	for (size_t index = 0; index < sizeof(*schedule); index++) {
+		bytes[index] = 0;
+	}
+}
+
+void JFAesEncryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+#if JFAesCipherHasAesNi
+	if (schedule->hardware) {
+		JFAesHardwareEncryptBlocks(schedule, input, output, blockCount);
+		return;
+	}
+#endif
+
+	JFAesSoftwareEncryptBlocks(schedule, input, output, blockCount);
+}
+
+void JFAesDecryptBlocks(const JFAesKeySchedule *schedule, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+#if JFAesCipherHasAesNi
+	if (schedule->hardware) {
+		JFAesHardwareDecryptBlocks(schedule, input, output, blockCount);
+		return;
+	}
+#endif
+
+	JFAesSoftwareDecryptBlocks(schedule, input, output, blockCount);
+}
+
+void JFAesCbcEncryptBlocks(const JFAesKeySchedule *schedule, UInt8 *chainingBlock, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+#if JFAesCipherHasAesNi
+	if (schedule->hardware) {
+		JFAesHardwareCbcEncryptBlocks(schedule, chainingBlock, input, output, blockCount);
+		return;
+	}
+#endif
+
+	UInt8 block[JFAesBlockSize];
+
+	for (; blockCount > 0; blockCount--) {
+		for (NSUInteger index = 0; index < JFAesBlockSize; index++) {
+			block[index] = input[index] ^ chainingBlock[index];
+		}
+		JFAesSoftwareEncryptBlocks(schedule, block, chainingBlock, 1);
+		memcpy(output, chainingBlock, JFAesBlockSize);
+
+		input += JFAesBlockSize;
+		output += JFAesBlockSize;
+	}
+
+	memset(block, 0, sizeof(block));
+}
+
+void JFAesCbcDecryptBlocks(const JFAesKeySchedule *schedule, UInt8 *chainingBlock, const UInt8 *input, UInt8 *output, size_t blockCount) {
+
+#if JFAesCipherHasAesNi
+	if (schedule->hardware) {
+		JFAesHardwareCbcDecryptBlocks(schedule, chainingBlock, input, output, blockCount);
+		return;
+	}
+#endif
+
+	UInt8 ciphertexts[JFAesSoftwareParallelBlockCount * JFAesBlockSize];
+
+	// Decrypts four blocks at a time, keeping a copy of their ciphertext in case the output overwrites the input.
+	while (blockCount > 0) {
+		size_t count = MIN(blockCount, (size_t) JFAesSoftwareParallelBlockCount);
+		size_t length = count * JFAesBlockSize;
+
+		memcpy(ciphertexts, input, length);
+		JFAesSoftwareDecryptBlocks(schedule, ciphertexts, output, count);
+
+		for (NSUInteger index = 0; index < JFAesBlockSize; index++) {
+			output[index] ^= chainingBlock[index];
+		}
+		for (NSUInteger index = JFAesBlockSize; index < length; index++) {
+			output[index] ^= ciphertexts[index - JFAesBlockSize];
+		}
+		memcpy(chainingBlock, ciphertexts + length - JFAesBlockSize, JFAesBlockSize);
+
+		input += length;
+		output += length;
+		blockCount -= count;
+	}
+}
+
+size_t JFAesCbcEncrypt(const JFAesKeySchedule *schedule, const UInt8 *initializationVector, const UInt8 *input, size_t length, UInt8 *output) {
+
+	UInt8 chainingBlock[JFAesBlockSize] = { 0 };
+	if (initializationVector != NULL) {
+		memcpy(chainingBlock, initializationVector, JFAesBlockSize);
+	}
+
+	size_t wholeLength = length - length % JFAesBlockSize;
+	JFAesCbcEncryptBlocks(schedule, chainingBlock, input, output, wholeLength / JFAesBlockSize);
+
+	// PKCS7: the last block is filled with its padding length, a whole block of 16s when the input ends on a block boundary.
+	UInt8 lastBlock[JFAesBlockSize];
+	size_t remainingLength = length - wholeLength;
+	UInt8 paddingLength = (UInt8) (JFAesBlockSize - remainingLength);
+
+	memcpy(lastBlock, input + wholeLength, remainingLength);
+	memset(lastBlock + remainingLength, paddingLength, paddingLength);
+	JFAesCbcEncryptBlocks(schedule, chainingBlock, lastBlock, output + wholeLength, 1);
+
+	memset(lastBlock, 0, sizeof(lastBlock));
+
+	return wholeLength + JFAesBlockSize;
+}
+
+NSInteger JFAesCbcDecrypt(const JFAesKeySchedule *schedule, const UInt8 *initializationVector, const UInt8 *input, size_t length, UInt8 *output) {
+
+	if (length == 0 || length % JFAesBlockSize != 0) {
+		return -1;
+	}
+
+	UInt8 chainingBlock[JFAesBlockSize] = { 0 };
+	if (initializationVector != NULL) {
+		memcpy(chainingBlock, initializationVector, JFAesBlockSize);
+	}
+
+	JFAesCbcDecryptBlocks(schedule, chainingBlock, input, output, length / JFAesBlockSize);
+
+	// Checks the padding without branching on its bytes, so its validity is all that can leak.
+	const UInt8 *lastBlock = output + length - JFAesBlockSize;
+	UInt32 paddingLength = lastBlock[JFAesBlockSize - 1];
+	UInt32 invalid = ((paddingLength - 1) >> 8) | ((JFAesBlockSize - paddingLength) >> 8);
+
+	for (UInt32 index = 0; index < JFAesBlockSize; index++) {
+		// All ones for the bytes within the padding, whose value must equal its length.
+		UInt32 inPadding = ((JFAesBlockSize - 1 - index) - paddingLength) >> 8;
+		invalid |= inPadding & (lastBlock[index] ^ paddingLength);
+	}
+
+	if ((invalid & 0xFF) != 0) {
+		return -1;
+	}
+
+	return (NSInteger) (length - paddingLength);
+}
+
+void JFAesCtrCrypt(const JFAesKeySchedule *schedule, const UInt8 *counterBlock, NSUInteger counterBits, UInt64 blockOffset, const UInt8 *input, UInt8 *output, size_t length) {
+
+	UInt8 counters[JFAesCtrBatchBlockCount * JFAesBlockSize] __attribute__((aligned(16)));
+	UInt8 keystream[JFAesCtrBatchBlockCount * JFAesBlockSize] __attribute__((aligned(16)));
+	UInt64 high = JFAesLoadBigEndian64(counterBlock);
+	UInt64 low = JFAesLoadBigEndian64(counterBlock + 8);
+	UInt64 increment = blockOffset;
+
+	while (length > 0) {
+		size_t blockCount = MIN((length + JFAesBlockSize - 1) / JFAesBlockSize, (size_t) JFAesCtrBatchBlockCount);
+		size_t batchLength = MIN(length, blockCount * JFAesBlockSize);
+
+		for (NSUInteger block = 0; block < blockCount; block++) {
+			// Advances the counter by the block offset first, then by one per block.
+			if (counterBits == JFAesCounterBits32) {
+				low = (low & 0xFFFFFFFF00000000ULL) | (UInt32) ((UInt32) low + (UInt32) increment);
+			} else {
+				UInt64 advancedLow = low + increment;
+				high += (advancedLow < low) ? 1 : 0;
+				low = advancedLow;
+			}
+			increment = 1;
+
+			JFAesStoreBigEndian64(counters + block * JFAesBlockSize, high);
+			JFAesStoreBigEndian64(counters + block * JFAesBlockSize + 8, low);
+		}
+
+		JFAesEncryptBlocks(schedule, counters, keystream, blockCount);
+
+		for (size_t index = 0; index < batchLength; index++) {
+			output[index] = input[index] ^ keystream[index];
+		}
+
+		input += batchLength;
+		output += batchLength;
+		length -= batchLength;
+	}
+
+	memset(keystream, 0, sizeof(keystream));
+}
+
+void JFAesGhashKeyInit(JFAesGhashKey *ghashKey, const JFAesKeySchedule *schedule) {
+
+	UInt8 zeroes[JFAesBlockSize] = { 0 };
+
+	memset(ghashKey, 0, sizeof(*ghashKey));
+	JFAesEncryptBlocks(schedule, zeroes, ghashKey->hashKey, 1);
+	ghashKey->high = JFAesLoadBigEndian64(ghashKey->hashKey);
+	ghashKey->low = JFAesLoadBigEndian64(ghashKey->hashKey + 8);
+
+#if JFAesCipherHasAesNi
+	ghashKey->carryless = JFAesCarrylessMultiplyAvailable() && __builtin_cpu_supports("ssse3");
+#endif
+}
+
+void JFAesGhashUpdate(const JFAesGhashKey *ghashKey, UInt8 *state, const UInt8 *bytes, size_t length) {
+
+#if JFAesCipherHasAesNi
+	if (ghashKey->carryless) {
+		JFAesHardwareGhashUpdate(ghashKey, state, bytes, length);
+		return;
+	}
+#endif
+
+	JFAesSoftwareGhashUpdate(ghashKey, state, bytes, length);
+}
+
+void JFAesGhashMultiplyByPower(const JFAesGhashKey *ghashKey, UInt8 *state, UInt64 exponent) {
+
+	UInt64 high = JFAesLoadBigEndian64(state);
+	UInt64 low = JFAesLoadBigEndian64(state + 8);
+	UInt64 powerHigh = ghashKey->high;
+	UInt64 powerLow = ghashKey->low;
+
+	// Square and multiply; the exponent is a block count, not a secret.
+	while (exponent > 0) {
+		if (exponent & 1) {
+			JFAesSoftwareGhashMultiply(&high, &low, powerHigh, powerLow);
+		}
+
+		exponent >>= 1;
+		if (exponent > 0) {
+			JFAesSoftwareGhashMultiply(&powerHigh, &powerLow, powerHigh, powerLow);
+		}
+	}
+
+	JFAesStoreBigEndian64(state, high);
+	JFAesStoreBigEndian64(state + 8, low);
+}
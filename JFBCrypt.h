@@ -36,14 +36,12 @@
  * The JFBCrypt utility class.
  * This class has been tested to work on iOS 4.2.
  */
-@interface JFBCrypt : NSObject {
-
-@private
-	SInt32 *_p;
-	SInt32 *_s;
-}
+@interface JFBCrypt : NSObject
 
 + (NSString *) hashPassword: (NSString *) password withSalt: (NSString *) salt;
 + (NSString *) generateSaltWithNumberOfRounds: (SInt32) numberOfRounds;
++ (BOOL) verifyPassword: (NSString *) password againstHash: (NSString *) hashedPassword;
++ (SInt32) calibrateNumberOfRoundsForDuration: (NSTimeInterval) targetDuration;
++ (NSDictionary *) benchmarkFromNumberOfRounds: (SInt32) minimumNumberOfRounds toNumberOfRounds: (SInt32) maximumNumberOfRounds;
 
 @end
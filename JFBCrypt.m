@@ -28,16 +28,25 @@
 
 #import "JFBCrypt.h"
 
+#import "JFLatencyHistogram.h"
+#import "JFMacros.h"
+
 
 // BCrypt parameters
 #define		GENSALT_DEFAULT_LOG2_ROUNDS			10
 #define		BCRYPT_SALT_LEN						16
+#define		BCRYPT_MIN_LOG2_ROUNDS				4
+#define		BCRYPT_MAX_LOG2_ROUNDS				31
+
+// Calibration parameters
+#define		BCRYPT_CALIBRATION_ATTEMPTS			3		// Hashes timed per cost, the fastest counting
+#define		BCRYPT_BENCHMARK_DURATION			0.25	// Seconds each core spends hashing per cost
 
 // Blowfish parameters
 #define		BLOWFISH_NUM_ROUNDS					16
 
 // Initial contents of key schedule
-SInt32 P_orig[] = {
+static const UInt32 P_orig[] = {
 	0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344,
 	0xa4093822, 0x299f31d0, 0x082efa98, 0xec4e6c89,
 	0x452821e6, 0x38d01377, 0xbe5466cf, 0x34e90c6c,
@@ -45,7 +54,7 @@ SInt32 P_orig[] = {
 	0x9216d5d9, 0x8979fb1b
 };
 
-SInt32 S_orig[] = {
+static const UInt32 S_orig[] = {
 	0xd1310ba6, 0x98dfb5ac, 0x2ffd72db, 0xd01adfb7,
 	0xb8e1afed, 0x6a267e96, 0xba7c9045, 0xf12c7f99,
 	0x24a19947, 0xb3916cf7, 0x0801f2e2, 0x858efc16,
@@ -305,7 +314,7 @@ SInt32 S_orig[] = {
 };
 
 // bcrypt IV: "OrpheanBeholderScryDoubt"
-SInt32 bf_crypt_ciphertext[] = {
+static const UInt32 bf_crypt_ciphertext[] = {
 	0x4f727068, 0x65616e42, 0x65686f6c,
 	0x64657253, 0x63727944, 0x6f756274
 };
@@ -338,38 +347,198 @@ signed char index_64[] = {
 };
 
 
-@interface JFBCrypt (PrivateMethods)
-
-+ (SInt32 *) integerArrayWithOriginal: (SInt32 *) original ofLength: (SInt32) length;
-
-@end
+/*
+ * The Blowfish key schedule: the P-array and the four S-boxes, one after the other.
+ */
+typedef struct {
+	UInt32 p[BLOWFISH_NUM_ROUNDS + 2];
+	UInt32 s[1024];
+} JFBCryptBlowfishState;
 
 
+/*
+ * Enciphers a 64-bit block, held as its left and right 32-bit halves, using the Blowfish algorithm.
+ */
+static inline void JFBCryptEncipher(const JFBCryptBlowfishState *state, UInt32 *left, UInt32 *right) {
+	
+	const UInt32 *p = state->p;
+	const UInt32 *s = state->s;
+	UInt32 l = *left;
+	UInt32 r = *right;
+	
+	l ^= p[0];
+	for (NSUInteger i = 0; i <= BLOWFISH_NUM_ROUNDS - 2; i += 2) {
+		// Feistel substitution on left word
+		r ^= (((s[l >> 24] + s[0x100 | ((l >> 16) & 0xff)]) ^ s[0x200 | ((l >> 8) & 0xff)]) + s[0x300 | (l & 0xff)]) ^ p[i + 1];
+		
+		// Feistel substitution on right word
+		l ^= (((s[r >> 24] + s[0x100 | ((r >> 16) & 0xff)]) ^ s[0x200 | ((r >> 8) & 0xff)]) + s[0x300 | (r & 0xff)]) ^ p[i + 2];
+	}
+	
+	*left = r ^ p[BLOWFISH_NUM_ROUNDS + 1];
+	*right = l;
+}
 
-@implementation JFBCrypt
+/*
+ * Cyclically extracts a big-endian word of key material from the bytes, advancing the offset.
+ */
+static inline UInt32 JFBCryptStreamToWord(const UInt8 *data, size_t length, size_t *offset) {
+	
+	UInt32 word = 0;
+	size_t off = *offset;
+	
+	for (NSUInteger i = 0; i < 4; i++) {
+		word = (word << 8) | data[off];
+		off = (off + 1 == length) ? 0 : off + 1;
+	}
+	
+	*offset = off;
+	return word;
+}
 
 /*
- * Initializes and returns an autoreleased JFBCrypt instance.
+ * Initializes the Blowfish key schedule to the digits of pi.
  */
-+ (id) bCrypt {
+static inline void JFBCryptInitState(JFBCryptBlowfishState *state) {
+	
+	memcpy(state->p, P_orig, sizeof(state->p));
+	memcpy(state->s, S_orig, sizeof(state->s));
+}
 
-	id bCrypt = [[JFBCrypt alloc] init];
-	[bCrypt autorelease];
+/*
+ * Keys the Blowfish cipher using the provided key, XORing the salt into the
+ * blocks enciphered as it goes when one is given: the "enhanced key schedule" step
+ * described by Provos and Mazieres in "A Future-Adaptable Password Scheme"
+ * http://www.openbsd.org/papers/bcrypt-paper.ps
+ *
+ * Params
+ *		key				The password bytes.
+ *		keyLength		Must be greater than 0.
+ *		data			The salt bytes or NULL for the plain key schedule.
+ *		dataLength		Must be greater than 0 when data is given.
+ */
+static inline void JFBCryptKey(JFBCryptBlowfishState *state, const UInt8 *key, size_t keyLength, const UInt8 *data, size_t dataLength) {
+	
+	size_t keyOffset = 0;
+	size_t dataOffset = 0;
+	UInt32 l = 0;
+	UInt32 r = 0;
+	
+	for (NSUInteger i = 0; i < BLOWFISH_NUM_ROUNDS + 2; i++) {
+		state->p[i] ^= JFBCryptStreamToWord(key, keyLength, &keyOffset);
+	}
+	
+	for (NSUInteger i = 0; i < BLOWFISH_NUM_ROUNDS + 2; i += 2) {
+		if (data != NULL) {
+			l ^= JFBCryptStreamToWord(data, dataLength, &dataOffset);
+			r ^= JFBCryptStreamToWord(data, dataLength, &dataOffset);
+		}
+		JFBCryptEncipher(state, &l, &r);
+		state->p[i] = l;
+		state->p[i + 1] = r;
+	}
 	
-	return bCrypt;
+	for (NSUInteger i = 0; i < 1024; i += 2) {
+		if (data != NULL) {
+			l ^= JFBCryptStreamToWord(data, dataLength, &dataOffset);
+			r ^= JFBCryptStreamToWord(data, dataLength, &dataOffset);
+		}
+		JFBCryptEncipher(state, &l, &r);
+		state->s[i] = l;
+		state->s[i + 1] = r;
+	}
 }
 
 /*
- * Releases the receiver's members.
+ * Hashes the provided password with the salt for the number of rounds (Eksblowfish).
+ *
+ * Params
+ *		password		The password bytes.
+ *		passwordLength	Must be greater than 0.
+ *		salt			The BCRYPT_SALT_LEN salt bytes.
+ *		numberOfRounds	The base 2 logarithm of the number of rounds to apply.
+ *						Must be between 4 and 31.
+ *		hash			Receives the 24 hashed bytes.
+ *
+ * Returns
+ *		YES if the arguments were valid and the hash was computed, NO otherwise.
  */
-- (void) dealloc {
+static BOOL JFBCryptHash(const UInt8 *password, size_t passwordLength, const UInt8 *salt, SInt32 numberOfRounds, UInt8 *hash) {
+	
+	if (numberOfRounds < BCRYPT_MIN_LOG2_ROUNDS || numberOfRounds > BCRYPT_MAX_LOG2_ROUNDS || passwordLength == 0) {
+		// Invalid number of rounds or empty key
+		return NO;
+	}
+	
+	JFBCryptBlowfishState state;
+	UInt32 cdata[6];
+	UInt32 rounds = (UInt32) 1 << numberOfRounds;
+	
+	JFBCryptInitState(&state);
+	JFBCryptKey(&state, password, passwordLength, salt, BCRYPT_SALT_LEN);
+	
+	for (UInt32 i = 0; i < rounds; i++) {
+		JFBCryptKey(&state, password, passwordLength, NULL, 0);
+		JFBCryptKey(&state, salt, BCRYPT_SALT_LEN, NULL, 0);
+	}
+	
+	memcpy(cdata, bf_crypt_ciphertext, sizeof(cdata));
+	for (NSUInteger i = 0; i < 64; i++) {
+		for (NSUInteger j = 0; j < 6; j += 2) {
+			JFBCryptEncipher(&state, &cdata[j], &cdata[j + 1]);
+		}
+	}
+	
+	for (NSUInteger i = 0; i < 6; i++) {
+		hash[4 * i] = (UInt8) (cdata[i] >> 24);
+		hash[4 * i + 1] = (UInt8) (cdata[i] >> 16);
+		hash[4 * i + 2] = (UInt8) (cdata[i] >> 8);
+		hash[4 * i + 3] = (UInt8) cdata[i];
+	}
+	
+	// The state is derived from the password so leave none of it behind.
+	volatile UInt8 *stateBytes = (volatile UInt8 *) &state;
+	for (size_t i = 0; i < sizeof(state); i++) {
+		stateBytes[i] = 0;
+	}
+	
+	return YES;
+}
 
-	JFFree(_p);
-	JFFree(_s);
+/*
+ * Returns the time one hash of the given number of rounds takes on the calling thread, in seconds.
+ * The fastest of the attempts counts, as it is the one least disturbed by other work on the machine.
+ */
+static NSTimeInterval JFBCryptMeasureHash(SInt32 numberOfRounds, NSUInteger attempts) {
+	
+	// A typical password, terminated as $2a$ hashes it.
+	static const UInt8 password[] = "correct horse battery staple";
+	static const UInt8 salt[BCRYPT_SALT_LEN] = {
+		0x6a, 0x09, 0xe6, 0x67, 0xbb, 0x67, 0xae, 0x85, 0x3c, 0x6e, 0xf3, 0x72, 0xa5, 0x4f, 0xf5, 0x3a
+	};
+	static volatile UInt8 sink;
+	
+	UInt8 hash[24];
+	UInt64 fastest = UINT64_MAX;
+	
+	for (NSUInteger attempt = 0; attempt < attempts; attempt++) {
+		UInt64 start = JFLatencyHistogramNow();
+		JFBCryptHash(password, sizeof(password), salt, numberOfRounds, hash);
+		UInt64 duration = JFLatencyHistogramNow() - start;
+		
+		// Use the hash so the work cannot be optimized away.
+		sink = hash[0];
+		fastest = MIN(fastest, duration);
+	}
 	
-	[super dealloc];
+	return (NSTimeInterval) fastest / 1000000000.0;
 }
 
+
+
+
+@implementation JFBCrypt
+
 /*
  * Encodes an NSData composed of signed chararacters and returns slightly modified Base64 encoded string.
  *
@@ -522,249 +691,6 @@ signed char index_64[] = {
 }
 
 
-/*
- * Enciphers the provided array using the Blowfish algorithm.
- *
- * Params
- *		lr		The left-right array continaing two 32-bit half blocks.
- *		off		The offset into the array.
- */
-- (void) encipher: (SInt32 []) lr off: (SInt32) off {
-	
-	if (off < 0) {
-		// Invalid offset.
-		return;
-	}
-
-	SInt32 i, n, l = lr[off], r = lr[off + 1];
-	
-	l ^= _p[0];
-	for (i = 0; i <= BLOWFISH_NUM_ROUNDS - 2;) {
-		// Feistel substitution on left word
-		n = _s[(l >> 24) & 0xff];
-		n += _s[0x100 | ((l >> 16) & 0xff)];
-		n ^= _s[0x200 | ((l >> 8) & 0xff)];
-		n += _s[0x300 | (l & 0xff)];
-		r ^= n ^ _p[++i];
-		
-		// Feistel substitution on right word
-		n = _s[(r >> 24) & 0xff];
-		n += _s[0x100 | ((r >> 16) & 0xff)];
-		n ^= _s[0x200 | ((r >> 8) & 0xff)];
-		n += _s[0x300 | (r & 0xff)];
-		l ^= n ^ _p[++i];
-	}
-	lr[off] = r ^ _p[BLOWFISH_NUM_ROUNDS + 1];
-	lr[off + 1] = l;
-}
-
-
-/*
- * Cycically extracts a word of key material from the provided NSData.
- *
- * Params
- *		d		The NSData from which the word will be extracted.
- *		offp	The "pointer" (as a one-entry array) to the current offset into data.
- *
- * Returns
- *		The next word of material from the data.
- */
-+ (SInt32) streamToWord: (NSData *) d off: (SInt32 *) offp {
-	
-	signed char *data = (signed char *) [d bytes];
-	SInt32 dataLength = [d length];
-	SInt32 i;
-	SInt32 word = 0;
-	SInt32 off = offp[0];
-	
-	for (i = 0; i < 4; i++) {
-		word = (word << 8) | (data[off] & 0xff);
-		off = (off + 1) % dataLength;
-	}
-	
-	offp[0] = off;
-	return word;
-}
-
-
-/*
- * Initializes the blowfish key schedule.
- */
-- (void) initKey {
-	
-	if (_p == nil) {
-		_p = [JFBCrypt integerArrayWithOriginal: P_orig
-									   ofLength: 18];
-	}
-	
-	if (_s == nil) {
-		_s = [JFBCrypt integerArrayWithOriginal: S_orig
-									   ofLength: 1024];
-	}
-}
-
-
-/*
- * Returns an integer array copied from the provided one.
- * NOTE: It is the caller's responsibility to free the array.
- *
- * Params
- *		original		The original integer array.
- *		length			The length to copy.
- *
- * Returns
- *		The copied array.
- */
-+ (SInt32 *) integerArrayWithOriginal: (SInt32 *) original ofLength: (SInt32) length {
-
-	SInt32 *copied = malloc(sizeof(SInt32) * length);
-	
-	for (SInt32 loop = 0; loop < length; loop++) {
-		copied[loop] = original[loop];
-	}
-	
-	return copied;
-}
-
-
-/*
- * Keys the receiver's blowfish cipher using the provided key.
- *
- * Params
- *		key		The array containing the key.
- */
-- (void) key: (NSData *) key {
-	
-	SInt32 i;
-	SInt32 koffp[] = {0};
-	SInt32 lr[] = {0, 0};
-	SInt32 plen = 18;
-	SInt32 slen = 1024;
-	
-	for (i = 0; i < plen; i++) {
-		_p[i] = _p[i] ^ [JFBCrypt streamToWord: key off: koffp];
-	}
-	
-	for (i = 0; i < plen; i += 2) {
-		[self encipher: lr off: 0];
-		_p[i] = lr[0];
-		_p[i + 1] = lr[1];
-	}
-	
-	for (i = 0; i < slen; i += 2) {
-		[self encipher: lr off: 0];
-		_s[i] = lr[0];
-		_s[i + 1] = lr[1];
-	}
-}
-
-
-/*
- * Performs the "enhanced key schedule" step described by
- * Provos and Mazieres in "A Future-Adaptable Password Scheme"
- * http://www.openbsd.org/papers/bcrypt-paper.ps
- *
- * Params
- *		data		The salt data.
- *		key			The password data.
- */
-- (void) enhanceKeyScheduleWithData: (NSData *) data key: (NSData *) key {
-	
-	SInt32 i;
-	SInt32 koffp[] = {0}, doffp[] = {0};
-	SInt32 lr[] = {0, 0};
-	SInt32 plen = 18;
-	SInt32 slen = 1024;
-	
-	for (i = 0; i < plen; i++) {
-		_p[i] = _p[i] ^ [JFBCrypt streamToWord: key off: koffp];
-	}
-	
-	for (i = 0; i < plen; i += 2) {
-		lr[0] ^= [JFBCrypt streamToWord: data off: doffp];
-		lr[1] ^= [JFBCrypt streamToWord: data off: doffp];
-		[self encipher: lr off: 0];
-		_p[i] = lr[0];
-		_p[i + 1] = lr[1];
-	}
-	
-	for (i = 0; i < slen; i += 2) {
-		lr[0] ^= [JFBCrypt streamToWord: data off: doffp];
-		lr[1] ^= [JFBCrypt streamToWord: data off: doffp];
-		[self encipher: lr off: 0];
-		_s[i] = lr[0];
-		_s[i + 1] = lr[1];
-	}
-}
-
-
-/*
- * Hashes the provided password with the salt for the number of rounds.
- *
- * Params
- *		password		The password to hash.
- *		salt			The salt to use in the hash.
- *						Must be 16 characters in length.
- *		numberOfRounds	The number of rounds to apply.
- *						Must be between 4 and 31.
- *
- * Returns
- *		The hashed password.
- */
-- (NSData *) hashPassword: (NSData *) password withSalt: (NSData *) salt rounds: (SInt32) numberOfRounds {
-	
-	SInt32 rounds, i, j;
-	SInt32 *cdata = [JFBCrypt integerArrayWithOriginal: bf_crypt_ciphertext
-											  ofLength: 6];
-	
-	SInt32 clen = 6;
-	signed char *ret;
-	
-	if (numberOfRounds < 4 || numberOfRounds > 31) {
-		// Invalid number of rounds
-		JFFree(cdata);
-		return nil;
-	}
-	
-	rounds = 1 << numberOfRounds;
-	if ([salt length] != BCRYPT_SALT_LEN) {
-		// Invalid salt length
-		JFFree(cdata);
-		return nil;
-	}
-	
-	[self initKey];
-	[self enhanceKeyScheduleWithData: salt
-								 key: password];
-	
-	for (i = 0; i < rounds; i++) {
-		[self key: password];
-		[self key: salt];
-	}
-	
-	for (i = 0; i < 64; i++) {
-		for (j = 0; j < (clen >> 1); j++) {
-			[self encipher: cdata off: j << 1];
-		}
-	}
-	
-	ret = malloc(clen * 4);
-	for (i = 0, j = 0; i < clen; i++) {
-		ret[j++] = (signed char) ((cdata[i] >> 24) & 0xff);
-		ret[j++] = (signed char) ((cdata[i] >> 16) & 0xff);
-		ret[j++] = (signed char) ((cdata[i] >> 8) & 0xff);
-		ret[j++] = (signed char) (cdata[i] & 0xff);
-	}
-	
-	NSData *val = [NSData dataWithBytes: ret
-								 length: clen * 4];
-	JFFree(ret);
-	JFFree(cdata);
-
-	return val;
-}
-
-
 /*
  * Hashes the provided password with the salt.
  *
@@ -778,7 +704,6 @@ signed char index_64[] = {
  */
 + (NSString *) hashPassword: (NSString *) password withSalt: (NSString *) salt {
 	
-	JFBCrypt *bCrypt = nil;
 	NSString *realSalt;
 	NSData *passwordData;
 	NSData *saltData;
@@ -787,7 +712,7 @@ signed char index_64[] = {
 	SInt32 rounds, off = 0;
 	NSMutableString *hashedPassword = [NSMutableString stringWithCapacity: 100];
 	
-	if ([salt characterAtIndex: 0] != '$' || [salt characterAtIndex: 1] != '2') {
+	if ([salt length] < 4 || [salt characterAtIndex: 0] != '$' || [salt characterAtIndex: 1] != '2') {
 		// Invalid salt version.
 		return nil;
 	}
@@ -803,6 +728,11 @@ signed char index_64[] = {
 		off = 4;
 	}
 	
+	if ([salt length] < off + 25) {
+		// Truncated salt
+		return nil;
+	}
+	
 	// Extract number of rounds
 	if ([salt characterAtIndex: off + 2] > '$') {
 		// Missing salt rounds
@@ -821,10 +751,20 @@ signed char index_64[] = {
 	saltData = [JFBCrypt decode_base64: realSalt
 						   ofMaxLength: BCRYPT_SALT_LEN];
 	
-	bCrypt = [JFBCrypt bCrypt];
-	hashedData = [bCrypt hashPassword: passwordData
-							 withSalt: saltData
-							   rounds: rounds];
+	if ([saltData length] != BCRYPT_SALT_LEN) {
+		// Invalid salt length
+		return nil;
+	}
+	
+	UInt8 hash[24];
+	if (!JFBCryptHash([passwordData bytes], [passwordData length], [saltData bytes], rounds, hash)) {
+		// Invalid number of rounds or empty password
+		return nil;
+	}
+	
+	hashedData = [NSData dataWithBytes: hash
+								length: sizeof(hash)];
+	bzero(hash, sizeof(hash));
 	
 	[hashedPassword appendString: @"$2"];
 	if (minor >= 'a') {
@@ -875,4 +815,131 @@ signed char index_64[] = {
 	return salt;
 }
 
+
+/*
+ * Finds the highest number of rounds whose hash takes no longer than the target duration
+ * on this machine, for use with generateSaltWithNumberOfRounds:.
+ * The hash is timed at increasing numbers of rounds, each doubling the work, which stops
+ * before the next would exceed the target, so calibrating takes about twice the target duration.
+ * Calibrate on an otherwise idle machine, since on a busy one the result comes out too low.
+ *
+ * Params
+ *		targetDuration		The longest a hash may take, in seconds.
+ *
+ * Returns
+ *		The number of rounds, at least 4 even if a hash of 4 rounds exceeds the target.
+ */
++ (SInt32) calibrateNumberOfRoundsForDuration: (NSTimeInterval) targetDuration {
+	
+	SInt32 numberOfRounds = BCRYPT_MIN_LOG2_ROUNDS;
+	NSTimeInterval duration = JFBCryptMeasureHash(numberOfRounds, BCRYPT_CALIBRATION_ATTEMPTS);
+	
+	while (numberOfRounds < BCRYPT_MAX_LOG2_ROUNDS && duration * 2.0 <= targetDuration) {
+		numberOfRounds++;
+		
+		// Only repeat the hashes short enough to be thrown off by noise.
+		duration = JFBCryptMeasureHash(numberOfRounds, (duration < 0.05) ? BCRYPT_CALIBRATION_ATTEMPTS : 1);
+	}
+	
+	if (duration > targetDuration && numberOfRounds > BCRYPT_MIN_LOG2_ROUNDS) {
+		// The doubling overshot the estimate.
+		numberOfRounds--;
+	}
+	
+	return numberOfRounds;
+}
+
+
+/*
+ * Measures the hashing throughput of this machine for each number of rounds in the range.
+ * Every active processor hashes at once, as a loaded server would, for about a quarter
+ * of a second per number of rounds (or a single hash, if that takes longer).
+ * Measuring 4 to 16 rounds takes several seconds to a minute depending on the machine.
+ *
+ * Params
+ *		minimumNumberOfRounds		The lowest number of rounds to measure, at least 4.
+ *		maximumNumberOfRounds		The highest number of rounds to measure, at most 31.
+ *
+ * Returns
+ *		The hashes per second per processor (NSNumber doubles) keyed by number of rounds (NSNumber),
+ *		or nil if the range is invalid.
+ */
++ (NSDictionary *) benchmarkFromNumberOfRounds: (SInt32) minimumNumberOfRounds toNumberOfRounds: (SInt32) maximumNumberOfRounds {
+	
+	if (minimumNumberOfRounds < BCRYPT_MIN_LOG2_ROUNDS || maximumNumberOfRounds > BCRYPT_MAX_LOG2_ROUNDS || minimumNumberOfRounds > maximumNumberOfRounds) {
+		return nil;
+	}
+	
+	NSUInteger coreCount = [[NSProcessInfo processInfo] activeProcessorCount];
+	NSMutableDictionary *results = [NSMutableDictionary dictionaryWithCapacity: maximumNumberOfRounds - minimumNumberOfRounds + 1];
+	double *rates = calloc(coreCount, sizeof(double));
+	JFReturnNilIfNil(rates);
+	
+	for (SInt32 numberOfRounds = minimumNumberOfRounds; numberOfRounds <= maximumNumberOfRounds; numberOfRounds++) {
+		dispatch_apply(coreCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t core) {
+			NSUInteger hashCount = 0;
+			NSTimeInterval elapsed = 0.0;
+			
+			while (elapsed < BCRYPT_BENCHMARK_DURATION) {
+				elapsed += JFBCryptMeasureHash(numberOfRounds, 1);
+				hashCount++;
+			}
+			
+			rates[core] = hashCount / elapsed;
+		});
+		
+		double rate = 0.0;
+		for (NSUInteger core = 0; core < coreCount; core++) {
+			rate += rates[core];
+		}
+		
+		[results setObject: [NSNumber numberWithDouble: rate / coreCount]
+					forKey: [NSNumber numberWithInt: numberOfRounds]];
+	}
+	
+	free(rates);
+	
+	return results;
+}
+
+
+/*
+ * Checks a password against a previously hashed password, as stored.
+ * The hashes are compared in constant time so the comparison does not reveal
+ * how much of a guessed hash was right.
+ *
+ * Params
+ *		password		The password to check.
+ *		hashedPassword	The hashed password, whose salt and rounds the password is hashed with.
+ *
+ * Returns
+ *		YES if the password matches, NO if it does not or the hashed password is malformed.
+ */
++ (BOOL) verifyPassword: (NSString *) password againstHash: (NSString *) hashedPassword {
+	
+	JFReturnNoIfNil(password);
+	JFReturnNoIfNil(hashedPassword);
+	
+	NSString *candidate = [JFBCrypt hashPassword: password
+										withSalt: hashedPassword];
+	JFReturnNoIfNil(candidate);
+	
+	NSData *candidateData = [candidate dataUsingEncoding: NSUTF8StringEncoding];
+	NSData *hashedData = [hashedPassword dataUsingEncoding: NSUTF8StringEncoding];
+	if ([candidateData length] != [hashedData length]) {
+		// The length of a bcrypt hash is public, only its contents are not.
+		return NO;
+	}
+	
+	const UInt8 *candidateBytes = [candidateData bytes];
+	const UInt8 *hashedBytes = [hashedData bytes];
+	UInt8 difference = 0;
+	
+	for (NSUInteger index = 0; index < [hashedData length]; index++) {
+		difference |= candidateBytes[index] ^ hashedBytes[index];
+	}
+	
+	return (difference == 0);
+}
+
 @end
@@ -0,0 +1,127 @@
+//
+//  JFBCryptService.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFBCrypt.h"
+#import "JFLatencyHistogram.h"
+
+
+// The worker count denoting one worker per active processor.
+#define JFBCryptServiceAllProcessors			0
+
+// The number of hashes and verifications which may wait for a worker by default.
+#define JFBCryptServiceDefaultQueueCapacity		1024
+
+
+/*
+ * The statistics of a bcrypt service.
+ * Latency buckets are described in JFLatencyHistogram.h.
+ */
+typedef struct {
+
+	// The hashes and verifications accepted.
+	UInt64 submittedCount;
+
+	// The hashes and verifications turned away because the queue was full or the service shut down.
+	UInt64 rejectedCount;
+
+	// The hashes and verifications finished.
+	UInt64 hashCount;
+	UInt64 verificationCount;
+
+	// The verifications which found the password did not match.
+	UInt64 failedVerificationCount;
+
+	// The most hashes and verifications ever waiting for a worker at once.
+	UInt64 peakQueueLength;
+
+	// The durations from being submitted to being picked up by a worker.
+	UInt64 queueLatencyBuckets[JFLatencyHistogramBucketCount];
+
+	// The durations of the hashes and verifications themselves.
+	UInt64 serviceLatencyBuckets[JFLatencyHistogramBucketCount];
+
+} __attribute__((aligned(64))) JFBCryptServiceStatistics;
+
+
+typedef void (^JFBCryptServiceHashCompletion)(NSString *hashedPassword);
+typedef void (^JFBCryptServiceVerificationCompletion)(BOOL verified);
+
+// Called with the hashed passwords in submission order, NSNull where hashing failed.
+typedef void (^JFBCryptServiceBatchHashCompletion)(NSArray *hashedPasswords);
+
+// Called with an NSNumber boolean per password, in submission order.
+typedef void (^JFBCryptServiceBatchVerificationCompletion)(NSArray *verifications);
+
+
+@class JFBCryptServiceWorkQueue;
+
+
+/*
+ * Hashes and verifies passwords asynchronously on a dedicated pool of worker threads,
+ * keeping the expensive bcrypt work off request threads.
+ *
+ * The queue in front of the workers is bounded: once it is full further work is rejected
+ * (the submitting method returns NO) rather than queued behind seconds of earlier work,
+ * so callers can shed load during a burst of logins.
+ * The items of a batch are spread across the workers and its completion is called once all are done.
+ *
+ * Completions are called on a worker thread and should hand anything lengthy to another queue.
+ *
+ * Usage Example:
+ * JFBCryptService *service = [[JFBCryptService alloc] init];
+ * BOOL accepted = [service verifyPassword: password
+ *                             againstHash: storedHash
+ *                              completion: ^(BOOL verified) {
+ *     ...
+ * }];
+ */
+@interface JFBCryptService : NSObject {
+
+@private
+	// The queue shared with (and kept alive by) the worker threads.
+	JFBCryptServiceWorkQueue *_workQueue;
+
+	NSUInteger _workerCount;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) NSUInteger workerCount;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) init;
+- (id) initWithWorkerCount: (NSUInteger) workerCount queueCapacity: (NSUInteger) queueCapacity;
+
+
+#pragma mark - Methods
+
+- (BOOL) hashPassword: (NSString *) password withSalt: (NSString *) salt completion: (JFBCryptServiceHashCompletion) completion;
+- (BOOL) verifyPassword: (NSString *) password againstHash: (NSString *) hashedPassword completion: (JFBCryptServiceVerificationCompletion) completion;
+- (BOOL) hashPasswords: (NSArray *) passwords withSalts: (NSArray *) salts completion: (JFBCryptServiceBatchHashCompletion) completion;
+- (BOOL) verifyPasswords: (NSArray *) passwords againstHashes: (NSArray *) hashedPasswords completion: (JFBCryptServiceBatchVerificationCompletion) completion;
+- (NSUInteger) queueLength;
+- (JFBCryptServiceStatistics) statistics;
+- (void) shutdown;
+
+@end
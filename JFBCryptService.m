@@ -0,0 +1,550 @@
+//
+//  JFBCryptService.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFBCryptService.h"
+
+#import "JFMacros.h"
+
+
+// Increments a statistics counter without locking, as any worker may be updating it.
+#define JFBCryptServiceCount(statistics, counter, amount) __atomic_fetch_add(&(statistics)->counter, (amount), __ATOMIC_RELAXED)
+
+
+typedef void (^JFBCryptServiceWork)(void);
+
+// Computes the result of one item of a batch.
+typedef id (^JFBCryptServiceItemWork)(NSUInteger index);
+
+
+/*
+ * A hash or verification waiting for a worker.
+ */
+@interface JFBCryptServiceJob : NSObject {
+
+@public
+	// The time the job was submitted, for the queue latency.
+	UInt64 _submissionTime;
+
+	JFBCryptServiceWork _work;
+}
+
+@end
+
+
+@implementation JFBCryptServiceJob
+
+#if  __has_feature(objc_arc)
+
+#else
+
+- (void) dealloc {
+
+	[_work release];
+	[super dealloc];
+}
+
+#endif
+
+@end
+
+
+/*
+ * The bounded queue of jobs and the loop the worker threads run on it.
+ * The worker threads retain the queue so it outlives the service until they have drained it.
+ */
+@interface JFBCryptServiceWorkQueue : NSObject {
+
+@private
+	// The condition guarding the jobs, on which idle workers wait.
+	NSCondition *_condition;
+
+	NSMutableArray *_jobs;
+	NSUInteger _capacity;
+
+	// The flag denoting whether the service has shut down, after which no jobs are accepted.
+	BOOL _shutDown;
+
+@public
+	JFBCryptServiceStatistics *_statistics;
+}
+
+- (id) initWithCapacity: (NSUInteger) capacity;
+- (BOOL) addWork: (NSArray *) works;
+- (NSUInteger) jobCount;
+- (void) work;
+- (void) shutdown;
+
+@end
+
+
+@implementation JFBCryptServiceWorkQueue
+
+- (id) initWithCapacity: (NSUInteger) capacity {
+
+	self = [super init];
+
+	if (self) {
+		if (posix_memalign((void **) &_statistics, 64, sizeof(JFBCryptServiceStatistics)) != 0) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+		memset(_statistics, 0, sizeof(JFBCryptServiceStatistics));
+
+		_condition = [[NSCondition alloc] init];
+		_jobs = [[NSMutableArray alloc] initWithCapacity: capacity];
+		_capacity = capacity;
+	}
+
+	return self;
+}
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+
+	JFFree(_statistics);
+}
+
+#else
+
+- (void) dealloc {
+
+	JFFree(_statistics);
+	[_condition release];
+	[_jobs release];
+	[super dealloc];
+}
+
+#endif
+
+/*
+ * Queues the work, all of it or (if it does not fit or the service has shut down) none of it.
+ *
+ * Return
+ *		YES if the work was queued.
+ */
+- (BOOL) addWork: (NSArray *) works {
+
+	NSUInteger count = [works count];
+	UInt64 now = JFLatencyHistogramNow();
+
+	[_condition lock];
+
+	if (_shutDown || [_jobs count] + count > _capacity) {
+		[_condition unlock];
+		JFBCryptServiceCount(_statistics, rejectedCount, count);
+		return NO;
+	}
+
+	for (JFBCryptServiceWork work in works) {
+		JFBCryptServiceJob *job = [[JFBCryptServiceJob alloc] init];
+		job->_submissionTime = now;
+		job->_work = [work copy];
+		[_jobs addObject: job];
+#if !__has_feature(objc_arc) // NON ARC
+		[job release];
+#endif
+	}
+
+	UInt64 queueLength = [_jobs count];
+	if (queueLength > __atomic_load_n(&_statistics->peakQueueLength, __ATOMIC_RELAXED)) {
+		// Only ever raised while the lock is held.
+		__atomic_store_n(&_statistics->peakQueueLength, queueLength, __ATOMIC_RELAXED);
+	}
+
+	if (count == 1) {
+		[_condition signal];
+	} else {
+		[_condition broadcast];
+	}
+
+	[_condition unlock];
+
+	JFBCryptServiceCount(_statistics, submittedCount, count);
+
+	return YES;
+}
+
+- (NSUInteger) jobCount {
+
+	[_condition lock];
+	NSUInteger count = [_jobs count];
+	[_condition unlock];
+
+	return count;
+}
+
+/*
+ * Runs jobs in submission order on the calling (worker) thread
+ * until the service has shut down and every queued job has run.
+ */
+- (void) work {
+
+	while (YES) {
+		@autoreleasepool {
+			[_condition lock];
+
+			while ([_jobs count] == 0 && !_shutDown) {
+				[_condition wait];
+			}
+
+			if ([_jobs count] == 0) {
+				// Shut down and drained.
+				[_condition unlock];
+				break;
+			}
+
+			JFBCryptServiceJob *job = [_jobs objectAtIndex: 0];
+#if !__has_feature(objc_arc) // NON ARC
+			[job retain];
+#endif
+			[_jobs removeObjectAtIndex: 0];
+
+			[_condition unlock];
+
+			JFLatencyHistogramRecordSince(_statistics->queueLatencyBuckets, job->_submissionTime);
+
+			UInt64 start = JFLatencyHistogramNow();
+			job->_work();
+			JFLatencyHistogramRecordSince(_statistics->serviceLatencyBuckets, start);
+
+#if !__has_feature(objc_arc) // NON ARC
+			[job release];
+#endif
+		}
+	}
+}
+
+/*
+ * Stops accepting jobs and lets the workers exit once the queued ones have run.
+ */
+- (void) shutdown {
+
+	[_condition lock];
+	_shutDown = YES;
+	[_condition broadcast];
+	[_condition unlock];
+}
+
+@end
+
+
+@interface JFBCryptService (PrivateMethods)
+
+- (BOOL) submitBatchOfCount: (NSUInteger) count work: (JFBCryptServiceItemWork) itemWork completion: (void (^)(NSArray *results)) completion;
+
+@end
+
+
+@implementation JFBCryptService
+
+
+#pragma mark - Properties
+
+@synthesize workerCount = _workerCount;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) init {
+
+	return [self initWithWorkerCount: JFBCryptServiceAllProcessors
+					   queueCapacity: JFBCryptServiceDefaultQueueCapacity];
+}
+
+/*
+ * Initializes the service and starts its worker threads.
+ *
+ * Params
+ *		workerCount		The number of worker threads, or JFBCryptServiceAllProcessors for one per active processor.
+ *						bcrypt is CPU-bound, so more workers than processors only adds queueing inside the scheduler.
+ *		queueCapacity	The number of hashes and verifications which may wait for a worker
+ *						(0 for JFBCryptServiceDefaultQueueCapacity).
+ *
+ * Return
+ *		The running service.  Shut it down (or release it) to stop the workers.
+ */
+- (id) initWithWorkerCount: (NSUInteger) workerCount queueCapacity: (NSUInteger) queueCapacity {
+
+	self = [super init];
+
+	if (self) {
+		if (workerCount == JFBCryptServiceAllProcessors) {
+			workerCount = [[NSProcessInfo processInfo] activeProcessorCount];
+		}
+
+		if (queueCapacity == 0) {
+			queueCapacity = JFBCryptServiceDefaultQueueCapacity;
+		}
+
+		_workQueue = [[JFBCryptServiceWorkQueue alloc] initWithCapacity: queueCapacity];
+		if (_workQueue == nil) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+
+		_workerCount = MAX(workerCount, (NSUInteger) 1);
+
+		for (NSUInteger worker = 0; worker < _workerCount; worker++) {
+			NSThread *thread = [[NSThread alloc] initWithTarget: _workQueue
+													   selector: @selector(work)
+														 object: nil];
+			[thread setName: @"JFBCryptService.worker"];
+			[thread start];
+#if !__has_feature(objc_arc) // NON ARC
+			[thread release];
+#endif
+		}
+	}
+
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+
+	[_workQueue shutdown];
+}
+
+#else
+
+- (void) dealloc {
+
+	[_workQueue shutdown];
+	[_workQueue release];
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Methods
+
+/*
+ * Hashes the password on a worker thread.
+ *
+ * Params
+ *		password		The password to hash.
+ *		salt			The salt, as generated by generateSaltWithNumberOfRounds:.
+ *		completion		Called with the hashed password, or nil if the salt is invalid.
+ *
+ * Return
+ *		YES if the hash was queued, NO if the queue is full or the service has shut down
+ *		(the completion is then never called).
+ */
+- (BOOL) hashPassword: (NSString *) password withSalt: (NSString *) salt completion: (JFBCryptServiceHashCompletion) completion {
+
+	JFReturnNoIfNil(completion);
+
+	JFBCryptServiceStatistics *statistics = _workQueue->_statistics;
+	JFBCryptServiceWork work = ^{
+		NSString *hashedPassword = [JFBCrypt hashPassword: password
+												 withSalt: salt];
+		JFBCryptServiceCount(statistics, hashCount, 1);
+
+		completion(hashedPassword);
+	};
+
+	return [_workQueue addWork: [NSArray arrayWithObject: work]];
+}
+
+/*
+ * Checks the password against the hashed password on a worker thread, as verifyPassword:againstHash: of JFBCrypt does.
+ *
+ * Params
+ *		completion		Called with YES if the password matches.
+ *
+ * Return
+ *		YES if the verification was queued, NO if the queue is full or the service has shut down
+ *		(the completion is then never called).
+ */
+- (BOOL) verifyPassword: (NSString *) password againstHash: (NSString *) hashedPassword completion: (JFBCryptServiceVerificationCompletion) completion {
+
+	JFReturnNoIfNil(completion);
+
+	JFBCryptServiceStatistics *statistics = _workQueue->_statistics;
+	JFBCryptServiceWork work = ^{
+		BOOL verified = [JFBCrypt verifyPassword: password
+									 againstHash: hashedPassword];
+		JFBCryptServiceCount(statistics, verificationCount, 1);
+		if (!verified) {
+			JFBCryptServiceCount(statistics, failedVerificationCount, 1);
+		}
+
+		completion(verified);
+	};
+
+	return [_workQueue addWork: [NSArray arrayWithObject: work]];
+}
+
+/*
+ * Hashes each password with the salt at the same index, spread across the workers.
+ *
+ * Params
+ *		salts			The salts, as many as there are passwords.
+ *		completion		Called once with every hashed password.
+ *
+ * Return
+ *		YES if the batch was queued, NO if the counts differ or the whole batch does not fit in the queue.
+ */
+- (BOOL) hashPasswords: (NSArray *) passwords withSalts: (NSArray *) salts completion: (JFBCryptServiceBatchHashCompletion) completion {
+
+	JFReturnNoIfNil(completion);
+
+	if ([passwords count] != [salts count]) {
+		return NO;
+	}
+
+	JFBCryptServiceStatistics *statistics = _workQueue->_statistics;
+
+	return [self submitBatchOfCount: [passwords count]
+							   work: ^id (NSUInteger index) {
+								   NSString *hashedPassword = [JFBCrypt hashPassword: [passwords objectAtIndex: index]
+																			withSalt: [salts objectAtIndex: index]];
+								   JFBCryptServiceCount(statistics, hashCount, 1);
+
+								   return hashedPassword;
+							   }
+						 completion: completion];
+}
+
+/*
+ * Checks each password against the hashed password at the same index, spread across the workers.
+ *
+ * Params
+ *		hashedPasswords		The hashed passwords, as many as there are passwords.
+ *		completion			Called once with every result.
+ *
+ * Return
+ *		YES if the batch was queued, NO if the counts differ or the whole batch does not fit in the queue.
+ */
+- (BOOL) verifyPasswords: (NSArray *) passwords againstHashes: (NSArray *) hashedPasswords completion: (JFBCryptServiceBatchVerificationCompletion) completion {
+
+	JFReturnNoIfNil(completion);
+
+	if ([passwords count] != [hashedPasswords count]) {
+		return NO;
+	}
+
+	JFBCryptServiceStatistics *statistics = _workQueue->_statistics;
+
+	return [self submitBatchOfCount: [passwords count]
+							   work: ^id (NSUInteger index) {
+								   BOOL verified = [JFBCrypt verifyPassword: [passwords objectAtIndex: index]
+																 againstHash: [hashedPasswords objectAtIndex: index]];
+								   JFBCryptServiceCount(statistics, verificationCount, 1);
+								   if (!verified) {
+									   JFBCryptServiceCount(statistics, failedVerificationCount, 1);
+								   }
+
+								   return [NSNumber numberWithBool: verified];
+							   }
+						 completion: completion];
+}
+
+/*
+ * Returns the number of hashes and verifications waiting for a worker.
+ */
+- (NSUInteger) queueLength {
+
+	return [_workQueue jobCount];
+}
+
+/*
+ * Returns a snapshot of the statistics.  May be called from any thread.
+ */
+- (JFBCryptServiceStatistics) statistics {
+
+	JFBCryptServiceStatistics statistics;
+	const UInt64 *source = (const UInt64 *) _workQueue->_statistics;
+	UInt64 *destination = (UInt64 *) &statistics;
+
+	for (NSUInteger index = 0; index < sizeof(JFBCryptServiceStatistics) / sizeof(UInt64); index++) {
+		destination[index] = __atomic_load_n(&source[index], __ATOMIC_RELAXED);
+	}
+
+	return statistics;
+}
+
+/*
+ * Stops accepting work.  The queued hashes and verifications still run and complete,
+ * after which the worker threads exit.
+ */
+- (void) shutdown {
+
+	[_workQueue shutdown];
+}
+
+
+#pragma mark - Private methods
+
+/*
+ * Queues one job per item and calls the completion with the results, in item order,
+ * once the last of them has finished on whichever worker ran it.
+ */
+- (BOOL) submitBatchOfCount: (NSUInteger) count work: (JFBCryptServiceItemWork) itemWork completion: (void (^)(NSArray *results)) completion {
+
+	if (count == 0) {
+		completion([NSArray array]);
+		return YES;
+	}
+
+	NSMutableArray *results = [NSMutableArray arrayWithCapacity: count];
+	NSMutableArray *works = [NSMutableArray arrayWithCapacity: count];
+	__block NSUInteger remainingCount = count;
+
+	for (NSUInteger index = 0; index < count; index++) {
+		[results addObject: [NSNull null]];
+
+		JFBCryptServiceWork work = ^{
+			id result = itemWork(index);
+			BOOL finished;
+
+			@synchronized (results) {
+				if (result != nil) {
+					[results replaceObjectAtIndex: index
+									   withObject: result];
+				}
+
+				remainingCount--;
+				finished = (remainingCount == 0);
+			}
+
+			if (finished) {
+				completion(results);
+			}
+		};
+
+		JFBCryptServiceWork copiedWork = [work copy];
+		[works addObject: copiedWork];
+#if !__has_feature(objc_arc) // NON ARC
+		[copiedWork release];
+#endif
+	}
+
+	return [_workQueue addWork: works];
+}
+
+@end
@@ -22,13 +22,32 @@
 
 #import <Foundation/Foundation.h>
 
+#import "JFBase64Core.h"
+
+
+// The smallest and largest lengths measured by benchmarkEncodingAndDecoding.
+#define JFBase64BenchmarkMinLength		16
+#define JFBase64BenchmarkMaxLength		(64 * 1024 * 1024)
+
+// The keys of the rates benchmarkEncodingAndDecoding reports for each length.
+#define JFBase64BenchmarkEncodeKey		@"encode"
+#define JFBase64BenchmarkDecodeKey		@"decode"
+
 
 @interface JFBase64 : NSObject
 
-+ (void) initialize;
 + (NSString *) encode: (const uint8_t *) input length: (NSInteger) length;
 + (NSString *) encode: (NSData *) rawBytes;
 + (NSData *) decode: (const char *) string length: (NSInteger) inputLength;
 + (NSData *) decode: (NSString *) string;
 
++ (NSString *) encode: (NSData *) rawBytes options: (NSUInteger) options;
++ (NSData *) decode: (NSString *) string options: (NSUInteger) options;
++ (NSUInteger) encodedLengthForLength: (NSUInteger) length options: (NSUInteger) options;
++ (NSUInteger) decodedLengthForString: (const char *) string length: (NSUInteger) length;
++ (NSInteger) encode: (const uint8_t *) input length: (NSUInteger) length intoBuffer: (char *) output capacity: (NSUInteger) capacity options: (NSUInteger) options;
++ (NSInteger) decode: (const char *) string length: (NSUInteger) length intoBuffer: (uint8_t *) output capacity: (NSUInteger) capacity options: (NSUInteger) options;
+
++ (NSDictionary *) benchmarkEncodingAndDecoding;
+
 @end
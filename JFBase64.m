@@ -20,56 +20,44 @@
 
 #import "JFBase64.h"
 
-#define ArrayLength(x) (sizeof(x)/sizeof(*(x)))
+#import "JFGC.h"
+#import "JFMacros.h"
+#import "JFLatencyHistogram.h"
 
-static char encodingTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-static char decodingTable[128];
 
+// The characters of a string copied to the stack and decoded at a time.
+#define JFBase64StringChunkLength		1024
 
-@implementation JFBase64
+// The number of seconds the benchmark encodes (and decodes) each length for.
+#define JFBase64BenchmarkDuration		0.25
+
+// The number of bytes the benchmark encodes or decodes between looking at the clock.
+#define JFBase64BenchmarkBatchLength	(1024 * 1024)
 
-+ (void) initialize {
-	
-	if (self == [JFBase64 class]) {
-		memset(decodingTable, 0, ArrayLength(decodingTable));
-		for (NSInteger i = 0; i < ArrayLength(encodingTable); i++) {
-			decodingTable[encodingTable[i]] = i;
-		}
-	}
-}
 
+@interface JFBase64 (PrivateMethods)
+
++ (NSString *) stringByEncoding: (const uint8_t *) input length: (NSUInteger) length options: (NSUInteger) options;
++ (double) measureEncoding: (BOOL) encoding input: (const void *) input length: (NSUInteger) length output: (void *) output;
+
+@end
+
+
+@implementation JFBase64
 
+/*
+ * Encodes the bytes as padded Base64.
+ * The fastest encoder the CPU supports (AVX2, SSSE3 or scalar) is used.
+ */
 + (NSString *) encode: (const uint8_t *) input length: (NSInteger) length {
 	
-    NSMutableData *data = [NSMutableData dataWithLength: ((length + 2) / 3) * 4];
-    uint8_t *output = (uint8_t*) data.mutableBytes;
-	
-    for (NSInteger i = 0; i < length; i += 3) {
-        NSInteger value = 0;
-        for (NSInteger j = i; j < (i + 3); j++) {
-            value <<= 8;
-			
-            if (j < length) {
-                value |= (0xFF & input[j]);
-            }
-        }
-		
-        NSInteger index = (i / 3) * 4;
-        output[index + 0] = encodingTable[(value >> 18) & 0x3F];
-        output[index + 1] = encodingTable[(value >> 12) & 0x3F];
-        output[index + 2] = (i + 1) < length ? encodingTable[(value >> 6) & 0x3F] : '=';
-        output[index + 3] = (i + 2) < length ? encodingTable[(value >> 0) & 0x3F] : '=';
-    }
-	
-#if __has_feature(objc_arc)
-	return [[NSString alloc] initWithData: data
-								 encoding: NSASCIIStringEncoding];
-#else
-	return [[[NSString alloc] initWithData: data
-                                  encoding: NSASCIIStringEncoding] autorelease];
+	if ((input == NULL && length > 0) || length < 0) {
+		return nil;
+	}
 	
-#endif
-    
+	return [self stringByEncoding: input
+						   length: length
+						  options: JFBase64OptionsNone];
 }
 
 + (NSString*) encode: (NSData *) rawBytes {
@@ -78,44 +66,263 @@ static char decodingTable[128];
 				 length: rawBytes.length];
 }
 
+/*
+ * Decodes padded Base64.
+ * Returns nil if the length is not a multiple of 4 or the input holds anything but
+ * the Base64 alphabet and trailing padding (whitespace included).
+ */
 + (NSData *) decode: (const char *) string length: (NSInteger) inputLength {
 	
-	if ((string == NULL) || (inputLength % 4 != 0)) {
+	if ((string == NULL) || (inputLength < 0) || (inputLength % 4 != 0)) {
 		return nil;
 	}
 	
-	while (inputLength > 0 && string[inputLength - 1] == '=') {
-		inputLength--;
+	NSMutableData *data = [NSMutableData dataWithLength: JFBase64DecodedLength(string, inputLength)];
+	if (JFBase64Decode(string, inputLength, data.mutableBytes, JFBase64OptionsNone) < 0) {
+		return nil;
 	}
 	
-	NSInteger outputLength = inputLength * 3 / 4;
-	NSMutableData *data = [NSMutableData dataWithLength: outputLength];
-	uint8_t* output = data.mutableBytes;
-	
-	NSInteger inputPoint = 0;
-	NSInteger outputPoint = 0;
-	while (inputPoint < inputLength) {
-		char i0 = string[inputPoint++];
-		char i1 = string[inputPoint++];
-		char i2 = inputPoint < inputLength ? string[inputPoint++] : 'A'; /* 'A' will decode to \0 */
-		char i3 = inputPoint < inputLength ? string[inputPoint++] : 'A';
+	return data;
+}
+
++ (NSData *) decode: (NSString *) string {
+	
+	return [self decode: string
+				options: JFBase64OptionsNone];
+}
+
+/*
+ * Encodes the bytes as Base64.
+ *
+ * Params
+ *		options		JFBase64OptionUrlSafe and/or JFBase64OptionNoPadding, or JFBase64OptionsNone.
+ */
++ (NSString *) encode: (NSData *) rawBytes options: (NSUInteger) options {
+	
+	JFReturnNilIfNil(rawBytes);
+	
+	return [self stringByEncoding: rawBytes.bytes
+						   length: rawBytes.length
+						  options: options];
+}
+
+/*
+ * Decodes Base64 straight from the characters of the string, a chunk at a time through a buffer
+ * on the stack, rather than through a C string copy of it.
+ *
+ * Params
+ *		options		JFBase64OptionUrlSafe and/or JFBase64OptionNoPadding (padding then being optional), or JFBase64OptionsNone.
+ *
+ * Return
+ *		The decoded bytes or nil if the string is not valid Base64.
+ */
++ (NSData *) decode: (NSString *) string options: (NSUInteger) options {
+	
+	JFReturnNilIfNil(string);
+	
+	NSUInteger length = string.length;
+	NSMutableData *data = [NSMutableData dataWithLength: (length / 4) * 3 + 2];
+	uint8_t *output = data.mutableBytes;
+	NSUInteger outputLength = 0;
+	
+	JFBase64Stream stream;
+	JFBase64StreamInit(&stream, NO, options);
+	
+	char chunk[JFBase64StringChunkLength];
+	NSRange range = NSMakeRange(0, length);
+	
+	while (range.length > 0) {
+		NSUInteger chunkLength = 0;
+		[string getBytes: chunk
+			   maxLength: sizeof(chunk)
+			  usedLength: &chunkLength
+				encoding: NSASCIIStringEncoding
+				 options: 0
+				   range: range
+		  remainingRange: &range];
 		
-		output[outputPoint++] = (decodingTable[i0] << 2) | (decodingTable[i1] >> 4);
-		if (outputPoint < outputLength) {
-			output[outputPoint++] = ((decodingTable[i1] & 0xf) << 4) | (decodingTable[i2] >> 2);
+		if (chunkLength == 0) {
+			// A character outside ASCII, so outside the alphabet.
+			return nil;
 		}
-		if (outputPoint < outputLength) {
-			output[outputPoint++] = ((decodingTable[i2] & 0x3) << 6) | decodingTable[i3];
+		
+		NSInteger decodedLength = JFBase64StreamUpdate(&stream, (const UInt8 *) chunk, chunkLength, output + outputLength);
+		if (decodedLength < 0) {
+			return nil;
 		}
+		outputLength += decodedLength;
+	}
+	
+	NSInteger decodedLength = JFBase64StreamFinish(&stream, output + outputLength);
+	if (decodedLength < 0) {
+		return nil;
 	}
 	
+	[data setLength: outputLength + decodedLength];
 	return data;
 }
 
-+ (NSData *) decode: (NSString *) string {
+/*
+ * Returns the length of the Base64 encoding of the given number of bytes.
+ */
++ (NSUInteger) encodedLengthForLength: (NSUInteger) length options: (NSUInteger) options {
+	
+	return JFBase64EncodedLength(length, options);
+}
+
+/*
+ * Returns the exact length of the bytes the Base64 characters decode to, provided they are valid.
+ */
++ (NSUInteger) decodedLengthForString: (const char *) string length: (NSUInteger) length {
+	
+	if (string == NULL) {
+		return 0;
+	}
+	
+	return JFBase64DecodedLength(string, length);
+}
+
+/*
+ * Encodes the bytes into a caller-provided buffer, allocating nothing.
+ *
+ * Params
+ *		capacity	The size of the output buffer, at least encodedLengthForLength: length options: options.
+ *
+ * Return
+ *		The number of characters written (not null-terminated) or -1 if the buffer is too small.
+ */
++ (NSInteger) encode: (const uint8_t *) input length: (NSUInteger) length intoBuffer: (char *) output capacity: (NSUInteger) capacity options: (NSUInteger) options {
+	
+	if ((input == NULL && length > 0) || output == NULL || capacity < JFBase64EncodedLength(length, options)) {
+		return -1;
+	}
+	
+	return (NSInteger) JFBase64Encode(input, length, output, options);
+}
+
+/*
+ * Decodes the characters into a caller-provided buffer, allocating nothing.
+ *
+ * Params
+ *		capacity	The size of the output buffer, at least decodedLengthForString: string length: length.
+ *
+ * Return
+ *		The number of bytes written or -1 if the buffer is too small or the characters are not valid Base64.
+ */
++ (NSInteger) decode: (const char *) string length: (NSUInteger) length intoBuffer: (uint8_t *) output capacity: (NSUInteger) capacity options: (NSUInteger) options {
+	
+	if (string == NULL || output == NULL || capacity < JFBase64DecodedLength(string, length)) {
+		return -1;
+	}
+	
+	return JFBase64Decode(string, length, output, options);
+}
+
+/*
+ * Measures the encoding and decoding throughput of this machine for lengths from JFBase64BenchmarkMinLength
+ * to JFBase64BenchmarkMaxLength bytes, quadrupling each time, for about a quarter of a second each.
+ * Measuring all of them takes several seconds.
+ *
+ * Return
+ *		For each length (NSNumber), the gigabytes (10^9 bytes) of raw data encoded and decoded per second
+ *		(NSNumber doubles keyed by JFBase64BenchmarkEncodeKey and JFBase64BenchmarkDecodeKey),
+ *		or nil if the buffers could not be allocated.
+ */
++ (NSDictionary *) benchmarkEncodingAndDecoding {
+	
+	uint8_t *input = malloc(JFBase64BenchmarkMaxLength);
+	char *encoded = malloc(JFBase64EncodedLength(JFBase64BenchmarkMaxLength, JFBase64OptionsNone));
+	if (input == NULL || encoded == NULL) {
+		JFFree(input);
+		JFFree(encoded);
+		return nil;
+	}
+	
+	for (NSUInteger index = 0; index < JFBase64BenchmarkMaxLength; index++) {
+		input[index] = (uint8_t) (index * 131 + (index >> 8));
+	}
+	
+	NSMutableDictionary *results = [NSMutableDictionary dictionary];
+	
+	for (NSUInteger length = JFBase64BenchmarkMinLength; length <= JFBase64BenchmarkMaxLength; length *= 4) {
+		double encodeRate = [self measureEncoding: YES
+											input: input
+										   length: length
+										   output: encoded];
+		
+		// Decoding the encoding of the same bytes, into the input buffer they came from.
+		double decodeRate = [self measureEncoding: NO
+											input: encoded
+										   length: length
+										   output: input];
+		
+		[results setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+							 [NSNumber numberWithDouble: encodeRate], JFBase64BenchmarkEncodeKey,
+							 [NSNumber numberWithDouble: decodeRate], JFBase64BenchmarkDecodeKey,
+							 nil]
+					forKey: [NSNumber numberWithUnsignedInteger: length]];
+	}
+	
+	JFFree(input);
+	JFFree(encoded);
+	
+	return results;
+}
+
+
+#pragma mark - Private methods
+
+/*
+ * Encodes into a single buffer the returned string takes over, rather than into data copied into a string.
+ */
++ (NSString *) stringByEncoding: (const uint8_t *) input length: (NSUInteger) length options: (NSUInteger) options {
+	
+	size_t encodedLength = JFBase64EncodedLength(length, options);
+	char *output = malloc(MAX(encodedLength, (size_t) 1));
+	JFReturnNilIfNil(output);
+	
+	JFBase64Encode(input, length, output, options);
+	
+	NSString *string = [[NSString alloc] initWithBytesNoCopy: output
+													  length: encodedLength
+													encoding: NSASCIIStringEncoding
+												freeWhenDone: YES];
+	
+#if __has_feature(objc_arc)
+	return string;
+#else
+	return [string autorelease];
+#endif
+}
+
+/*
+ * Encodes the length bytes (or decodes their encoding) repeatedly for JFBase64BenchmarkDuration seconds.
+ *
+ * Return
+ *		The gigabytes of raw data encoded or decoded per second.
+ */
++ (double) measureEncoding: (BOOL) encoding input: (const void *) input length: (NSUInteger) length output: (void *) output {
+	
+	size_t encodedLength = JFBase64EncodedLength(length, JFBase64OptionsNone);
+	NSUInteger batchCount = MAX(JFBase64BenchmarkBatchLength / length, (NSUInteger) 1);
+	NSUInteger repetitionCount = 0;
+	UInt64 start = JFLatencyHistogramNow();
+	UInt64 elapsed = 0;
+	
+	while (elapsed < (UInt64) (JFBase64BenchmarkDuration * 1000000000.0)) {
+		for (NSUInteger batch = 0; batch < batchCount; batch++) {
+			if (encoding) {
+				JFBase64Encode(input, length, output, JFBase64OptionsNone);
+			} else {
+				JFBase64Decode(input, encodedLength, output, JFBase64OptionsNone);
+			}
+		}
+		
+		repetitionCount += batchCount;
+		elapsed = JFLatencyHistogramNow() - start;
+	}
 	
-	return [self decode: [string cStringUsingEncoding: NSASCIIStringEncoding]
-				 length: string.length];
+	return (double) length * repetitionCount / elapsed;
 }
 
 @end
@@ -0,0 +1,152 @@
+//
+//  JFBase64Core.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+
+// The implementations of the encoder and decoder, the fastest the CPU supports being chosen at runtime.
+#define JFBase64ImplementationScalar		0
+#define JFBase64ImplementationSsse3			1
+#define JFBase64ImplementationAvx2			2
+
+
+// The options of the encoder and decoder, combined with a bitwise OR.
+#define JFBase64OptionsNone					0
+
+// The URL and filename safe alphabet of RFC 4648, with '-' and '_' in place of '+' and '/'.
+#define JFBase64OptionUrlSafe				(1 << 0)
+
+// Encoding leaves out the trailing '=' padding, and decoding accepts input with or without it.
+#define JFBase64OptionNoPadding				(1 << 1)
+
+
+/*
+ * The state of an encoding or decoding carried from chunk to chunk:
+ * up to 2 bytes not yet encoded, or up to 4 characters not yet decoded (the group which may be the padded last one).
+ * Initialize it with JFBase64StreamInit; it holds no resources.
+ */
+typedef struct {
+
+	NSUInteger options;
+
+	// The flag denoting whether the stream encodes (or decodes).
+	BOOL encoding;
+
+	UInt8 pendingBytes[4];
+	NSUInteger pendingLength;
+
+} JFBase64Stream;
+
+
+/*
+ * Returns the implementation the encoder and decoder use on this CPU.
+ */
+NSUInteger JFBase64Implementation(void);
+
+/*
+ * Returns the length of the Base64 encoding of the given number of bytes.
+ */
+static inline size_t JFBase64EncodedLength(size_t length, NSUInteger options) {
+
+	if ((options & JFBase64OptionNoPadding) != 0) {
+		return (length / 3) * 4 + ((length % 3 != 0) ? length % 3 + 1 : 0);
+	}
+
+	return ((length + 2) / 3) * 4;
+}
+
+/*
+ * Returns the length of the bytes the Base64 input decodes to, assuming it is valid.
+ */
+static inline size_t JFBase64DecodedLength(const char *input, size_t length) {
+
+	if (length >= 4 && length % 4 == 0) {
+		length -= (input[length - 1] == '=') + (input[length - 1] == '=' && input[length - 2] == '=');
+	}
+
+	return (length / 4) * 3 + ((length % 4 > 1) ? length % 4 - 1 : 0);
+}
+
+/*
+ * Encodes the bytes as Base64 (RFC 4648).
+ *
+ * Params
+ *		output		Room for JFBase64EncodedLength(length, options) characters, not null-terminated.
+ *
+ * Return
+ *		The number of characters written.
+ */
+size_t JFBase64Encode(const UInt8 *input, size_t length, char *output, NSUInteger options);
+
+/*
+ * Decodes Base64 (RFC 4648), validating every character.
+ *
+ * Params
+ *		output		Room for JFBase64DecodedLength(input, length) bytes.
+ *
+ * Return
+ *		The number of bytes written, or -1 if the input holds anything but the alphabet and up to two
+ *		trailing '=', or its length is impossible (not a multiple of 4 unless padding is optional).
+ */
+NSInteger JFBase64Decode(const char *input, size_t length, UInt8 *output, NSUInteger options);
+
+
+#pragma mark - Streams
+
+void JFBase64StreamInit(JFBase64Stream *stream, BOOL encoding, NSUInteger options);
+
+/*
+ * Returns the most output an update of the given length can produce (exactly that much when encoding).
+ */
+static inline size_t JFBase64StreamUpdateLength(const JFBase64Stream *stream, size_t length) {
+
+	size_t totalLength = stream->pendingLength + length;
+
+	if (stream->encoding) {
+		return (totalLength / 3) * 4;
+	}
+
+	// A whole group is always held back as it may be the padded last one.
+	return (totalLength > 0) ? ((totalLength - 1) / 4) * 3 : 0;
+}
+
+// The most output JFBase64StreamFinish can produce.
+#define JFBase64StreamMaxFinishLength		4
+
+/*
+ * Encodes or decodes the next chunk of the input.
+ *
+ * Params
+ *		output		Room for JFBase64StreamUpdateLength(stream, length) bytes or characters.
+ *
+ * Return
+ *		The number of bytes or characters written, or -1 if decoding found an invalid character.
+ */
+NSInteger JFBase64StreamUpdate(JFBase64Stream *stream, const UInt8 *input, size_t length, UInt8 *output);
+
+/*
+ * Encodes or decodes (and checks the padding of) whatever the stream has held back.
+ *
+ * Params
+ *		output		Room for JFBase64StreamMaxFinishLength bytes or characters.
+ *
+ * Return
+ *		The number of bytes or characters written, or -1 if decoding found the end of the input invalid.
+ */
+NSInteger JFBase64StreamFinish(JFBase64Stream *stream, UInt8 *output);
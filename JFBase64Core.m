@@ -0,0 +1,604 @@
+//
+//  JFBase64Core.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFBase64Core.h"
+
+#import <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JFBase64CoreHasSimd			1
+#import <immintrin.h>
+#else
+#define JFBase64CoreHasSimd			0
+#endif
+
+
+// The alphabets, standard and URL-safe, indexed by the JFBase64OptionUrlSafe bit of the options.
+#define JFBase64Alphabet(options)		((options) & JFBase64OptionUrlSafe)
+
+static const char JFBase64EncodingTables[2][65] = {
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+};
+
+// The index of each character, 0xff for characters outside the alphabet.
+static const UInt8 JFBase64DecodingTables[2][256] = {
+	{
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+		0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+		0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+	},
+	{
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff,
+		0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+		0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+		0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+	}
+};
+
+
+#pragma mark - Scalar implementation
+
+/*
+ * Encodes whole groups of 3 bytes as 4 characters each.
+ */
+static void JFBase64ScalarEncodeGroups(const UInt8 *input, size_t groupCount, char *output, NSUInteger alphabet) {
+
+	const char *encodingTable = JFBase64EncodingTables[alphabet];
+
+	for (size_t group = 0; group < groupCount; group++) {
+		UInt32 value = ((UInt32) input[0] << 16) | ((UInt32) input[1] << 8) | input[2];
+
+		output[0] = encodingTable[value >> 18];
+		output[1] = encodingTable[(value >> 12) & 0x3f];
+		output[2] = encodingTable[(value >> 6) & 0x3f];
+		output[3] = encodingTable[value & 0x3f];
+
+		input += 3;
+		output += 4;
+	}
+}
+
+/*
+ * Decodes whole groups of 4 characters as 3 bytes each.
+ * Invalid characters are only checked for once the groups are decoded, so validation costs a single OR per character.
+ *
+ * Return
+ *		NO if any character is outside the alphabet.
+ */
+static BOOL JFBase64ScalarDecodeGroups(const UInt8 *input, size_t groupCount, UInt8 *output, NSUInteger alphabet) {
+
+	const UInt8 *decodingTable = JFBase64DecodingTables[alphabet];
+	UInt32 invalid = 0;
+
+	for (size_t group = 0; group < groupCount; group++) {
+		UInt32 a = decodingTable[input[0]];
+		UInt32 b = decodingTable[input[1]];
+		UInt32 c = decodingTable[input[2]];
+		UInt32 d = decodingTable[input[3]];
+		invalid |= a | b | c | d;
+
+		UInt32 value = (a << 18) | (b << 12) | (c << 6) | d;
+		output[0] = (UInt8) (value >> 16);
+		output[1] = (UInt8) (value >> 8);
+		output[2] = (UInt8) value;
+
+		input += 4;
+		output += 3;
+	}
+
+	// Only the invalid value has the top bit set.
+	return ((invalid & 0x80) == 0);
+}
+
+
+#pragma mark - SSSE3 and AVX2 implementations
+
+// The SIMD paths follow the approach of Wojciech Muła and Daniel Lemire ("Faster Base64 Encoding and Decoding
+// Using AVX2 Instructions"): bytes are split into 6 bit indices with shuffles and multiplies, and indices
+// become characters (and characters indices) by adding an offset looked up from the high nibble with pshufb.
+// Each path stops early and leaves whatever it did not process to the scalar implementation,
+// which also reports any invalid character.
+
+#if JFBase64CoreHasSimd
+
+/*
+ * Spreads 12 bytes (3 per 32 bit lane) into 16 indices of 6 bits, one per byte.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i JFBase64Ssse3Unpack(__m128i bytes) {
+
+	bytes = _mm_shuffle_epi8(bytes, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+	__m128i high = _mm_mulhi_epu16(_mm_and_si128(bytes, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+	__m128i low = _mm_mullo_epi16(_mm_and_si128(bytes, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+
+	return _mm_or_si128(high, low);
+}
+
+/*
+ * Turns indices into characters by adding the offset of the alphabet range each falls in.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i JFBase64Ssse3IndicesToCharacters(__m128i indices, __m128i offsets) {
+
+	// 0..25 map to 13, 26..51 to 0, 52..61 to 1..10, 62 to 11 and 63 to 12.
+	__m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+	return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+/*
+ * Packs 16 indices of 6 bits into 12 bytes, leaving the last 4 bytes zero.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i JFBase64Ssse3Pack(__m128i indices) {
+
+	__m128i pairs = _mm_maddubs_epi16(indices, _mm_set1_epi32(0x01400140));
+	__m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+
+	return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static size_t JFBase64Ssse3Encode(const UInt8 *input, size_t length, char *output, NSUInteger alphabet) {
+
+	const char *encodingTable = JFBase64EncodingTables[alphabet];
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+										  '0' - 52, '0' - 52, '0' - 52, encodingTable[62] - 62, encodingTable[63] - 63, 'A', 0, 0);
+	size_t consumed = 0;
+
+	// Each step reads 16 bytes but only consumes 12.
+	while (length - consumed >= 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *) (input + consumed));
+		_mm_storeu_si128((__m128i *) output, JFBase64Ssse3IndicesToCharacters(JFBase64Ssse3Unpack(bytes), offsets));
+
+		consumed += 12;
+		output += 16;
+	}
+
+	return consumed;
+}
+
+/*
+ * Decodes whole groups of characters until fewer than 24 remain or an invalid character turns up.
+ *
+ * Return
+ *		The number of characters consumed.
+ */
+__attribute__((target("ssse3")))
+static size_t JFBase64Ssse3Decode(const UInt8 *input, size_t length, UInt8 *output, NSUInteger alphabet) {
+
+	// Bit sets of the character classes each low and high nibble rules out, which only cover every class for invalid characters.
+	const __m128i lowClasses = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+											 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i highClasses = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+											  0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+
+	// The offsets turning characters into indices, by high nibble ('/' shares its high nibble with '+').
+	const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+	const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i plus = _mm_set1_epi8('+');
+	const __m128i minus = _mm_set1_epi8('-');
+	const __m128i underscore = _mm_set1_epi8('_');
+	size_t consumed = 0;
+
+	// Each step writes 16 bytes but only produces 12, so keep enough input for the rest to overwrite.
+	while (length - consumed >= 24) {
+		__m128i characters = _mm_loadu_si128((const __m128i *) (input + consumed));
+		if (alphabet == JFBase64Alphabet(JFBase64OptionUrlSafe)) {
+			// Turn '-' and '_' into '+' and '/', which must not appear themselves.
+			__m128i standard = _mm_or_si128(_mm_cmpeq_epi8(characters, plus), _mm_cmpeq_epi8(characters, slash));
+			if (_mm_movemask_epi8(standard) != 0) {
+				break;
+			}
+
+			characters = _mm_add_epi8(characters, _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(characters, minus), _mm_set1_epi8('+' - '-')),
+															   _mm_and_si128(_mm_cmpeq_epi8(characters, underscore), _mm_set1_epi8('/' - '_'))));
+		}
+		__m128i highNibbles = _mm_and_si128(_mm_srli_epi32(characters, 4), nibbleMask);
+		__m128i lowNibbles = _mm_and_si128(characters, nibbleMask);
+
+		__m128i classes = _mm_and_si128(_mm_shuffle_epi8(lowClasses, lowNibbles), _mm_shuffle_epi8(highClasses, highNibbles));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(classes, _mm_setzero_si128())) != 0xffff) {
+			break;
+		}
+
+		__m128i offsetIndices = _mm_add_epi8(_mm_cmpeq_epi8(characters, slash), highNibbles);
+		__m128i indices = _mm_add_epi8(characters, _mm_shuffle_epi8(offsets, offsetIndices));
+		_mm_storeu_si128((__m128i *) output, JFBase64Ssse3Pack(indices));
+
+		consumed += 16;
+		output += 12;
+	}
+
+	return consumed;
+}
+
+__attribute__((target("avx2")))
+static size_t JFBase64Avx2Encode(const UInt8 *input, size_t length, char *output, NSUInteger alphabet) {
+
+	const char *encodingTable = JFBase64EncodingTables[alphabet];
+	const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+											1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+											 '0' - 52, '0' - 52, '0' - 52, encodingTable[62] - 62, encodingTable[63] - 63, 'A', 0, 0,
+											 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+											 '0' - 52, '0' - 52, '0' - 52, encodingTable[62] - 62, encodingTable[63] - 63, 'A', 0, 0);
+	size_t consumed = 0;
+
+	// Each step reads 28 bytes (12 into each 128 bit lane) but only consumes 24.
+	while (length - consumed >= 28) {
+		__m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (input + consumed))),
+												_mm_loadu_si128((const __m128i *) (input + consumed + 12)), 1);
+		bytes = _mm256_shuffle_epi8(bytes, spread);
+
+		__m256i high = _mm256_mulhi_epu16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		__m256i low = _mm256_mullo_epi16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		__m256i indices = _mm256_or_si256(high, low);
+
+		__m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+		range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+		_mm256_storeu_si256((__m256i *) output, _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range)));
+
+		consumed += 24;
+		output += 32;
+	}
+
+	return consumed;
+}
+
+/*
+ * Decodes whole groups of characters until fewer than 48 remain or an invalid character turns up.
+ *
+ * Return
+ *		The number of characters consumed.
+ */
+__attribute__((target("avx2")))
+static size_t JFBase64Avx2Decode(const UInt8 *input, size_t length, UInt8 *output, NSUInteger alphabet) {
+
+	const __m256i lowClasses = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+												0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+												0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+												0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i highClasses = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+												 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+												 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+												 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+											 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+										  2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	const __m256i nibbleMask = _mm256_set1_epi8(0x0f);
+	const __m256i slash = _mm256_set1_epi8('/');
+	const __m256i plus = _mm256_set1_epi8('+');
+	const __m256i minus = _mm256_set1_epi8('-');
+	const __m256i underscore = _mm256_set1_epi8('_');
+	size_t consumed = 0;
+
+	// Each step writes 32 bytes but only produces 24, so keep enough input for the rest to overwrite.
+	while (length - consumed >= 48) {
+		__m256i characters = _mm256_loadu_si256((const __m256i *) (input + consumed));
+		if (alphabet == JFBase64Alphabet(JFBase64OptionUrlSafe)) {
+			__m256i standard = _mm256_or_si256(_mm256_cmpeq_epi8(characters, plus), _mm256_cmpeq_epi8(characters, slash));
+			if (_mm256_movemask_epi8(standard) != 0) {
+				break;
+			}
+
+			characters = _mm256_add_epi8(characters, _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(characters, minus), _mm256_set1_epi8('+' - '-')),
+																	 _mm256_and_si256(_mm256_cmpeq_epi8(characters, underscore), _mm256_set1_epi8('/' - '_'))));
+		}
+		__m256i highNibbles = _mm256_and_si256(_mm256_srli_epi32(characters, 4), nibbleMask);
+		__m256i lowNibbles = _mm256_and_si256(characters, nibbleMask);
+
+		if (!_mm256_testz_si256(_mm256_shuffle_epi8(lowClasses, lowNibbles), _mm256_shuffle_epi8(highClasses, highNibbles))) {
+			break;
+		}
+
+		__m256i offsetIndices = _mm256_add_epi8(_mm256_cmpeq_epi8(characters, slash), highNibbles);
+		__m256i indices = _mm256_add_epi8(characters, _mm256_shuffle_epi8(offsets, offsetIndices));
+
+		__m256i pairs = _mm256_maddubs_epi16(indices, _mm256_set1_epi32(0x01400140));
+		__m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+		__m256i bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, pack), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm256_storeu_si256((__m256i *) output, bytes);
+
+		consumed += 32;
+		output += 24;
+	}
+
+	return consumed;
+}
+
+#endif
+
+
+#pragma mark - Groups
+
+/*
+ * Encodes whole groups of 3 bytes with the fastest implementation available.
+ */
+static void JFBase64EncodeGroups(const UInt8 *input, size_t groupCount, char *output, NSUInteger alphabet) {
+
+	size_t length = groupCount * 3;
+	size_t consumed = 0;
+
+#if JFBase64CoreHasSimd
+	NSUInteger implementation = JFBase64Implementation();
+
+	if (implementation == JFBase64ImplementationAvx2) {
+		consumed = JFBase64Avx2Encode(input, length, output, alphabet);
+	}
+	if (implementation >= JFBase64ImplementationSsse3) {
+		consumed += JFBase64Ssse3Encode(input + consumed, length - consumed, output + consumed / 3 * 4, alphabet);
+	}
+#endif
+
+	JFBase64ScalarEncodeGroups(input + consumed, (length - consumed) / 3, output + consumed / 3 * 4, alphabet);
+}
+
+/*
+ * Decodes whole groups of 4 characters with the fastest implementation available.
+ *
+ * Return
+ *		NO if any character is outside the alphabet.
+ */
+static BOOL JFBase64DecodeGroups(const UInt8 *input, size_t groupCount, UInt8 *output, NSUInteger alphabet) {
+
+	size_t length = groupCount * 4;
+	size_t consumed = 0;
+
+#if JFBase64CoreHasSimd
+	NSUInteger implementation = JFBase64Implementation();
+
+	if (implementation == JFBase64ImplementationAvx2) {
+		consumed = JFBase64Avx2Decode(input, length, output, alphabet);
+	}
+	if (implementation >= JFBase64ImplementationSsse3) {
+		consumed += JFBase64Ssse3Decode(input + consumed, length - consumed, output + consumed / 4 * 3, alphabet);
+	}
+#endif
+
+	return JFBase64ScalarDecodeGroups(input + consumed, (length - consumed) / 4, output + consumed / 4 * 3, alphabet);
+}
+
+
+#pragma mark - Functions
+
+NSUInteger JFBase64Implementation(void) {
+
+#if JFBase64CoreHasSimd
+	static NSUInteger implementation = (NSUInteger) -1;
+
+	NSUInteger cachedImplementation = __atomic_load_n(&implementation, __ATOMIC_RELAXED);
+	if (cachedImplementation != (NSUInteger) -1) {
+		return cachedImplementation;
+	}
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		cachedImplementation = JFBase64ImplementationAvx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		cachedImplementation = JFBase64ImplementationSsse3;
+	} else {
+		cachedImplementation = JFBase64ImplementationScalar;
+	}
+
+	__atomic_store_n(&implementation, cachedImplementation, __ATOMIC_RELAXED);
+	return cachedImplementation;
+#else
+	return JFBase64ImplementationScalar;
+#endif
+}
+
+size_t JFBase64Encode(const UInt8 *input, size_t length, char *output, NSUInteger options) {
+
+	NSUInteger alphabet = JFBase64Alphabet(options);
+	const char *encodingTable = JFBase64EncodingTables[alphabet];
+	size_t groupCount = length / 3;
+
+	JFBase64EncodeGroups(input, groupCount, output, alphabet);
+
+	size_t consumed = groupCount * 3;
+	size_t produced = groupCount * 4;
+
+	// Encode the last 1 or 2 bytes, padded unless asked not to.
+	size_t remainder = length - consumed;
+	if (remainder > 0) {
+		UInt32 value = (UInt32) input[consumed] << 16;
+		if (remainder == 2) {
+			value |= (UInt32) input[consumed + 1] << 8;
+		}
+
+		output[produced++] = encodingTable[value >> 18];
+		output[produced++] = encodingTable[(value >> 12) & 0x3f];
+		if (remainder == 2) {
+			output[produced++] = encodingTable[(value >> 6) & 0x3f];
+		}
+
+		if ((options & JFBase64OptionNoPadding) == 0) {
+			output[produced++] = '=';
+			if (remainder == 1) {
+				output[produced++] = '=';
+			}
+		}
+	}
+
+	return produced;
+}
+
+NSInteger JFBase64Decode(const char *input, size_t length, UInt8 *output, NSUInteger options) {
+
+	NSUInteger alphabet = JFBase64Alphabet(options);
+	const UInt8 *decodingTable = JFBase64DecodingTables[alphabet];
+	const UInt8 *characters = (const UInt8 *) input;
+
+	if (length % 4 == 0) {
+		// Strip the padding, if any.
+		if (length > 0 && characters[length - 1] == '=') {
+			length--;
+			if (characters[length - 1] == '=') {
+				length--;
+			}
+		}
+	} else if ((options & JFBase64OptionNoPadding) == 0) {
+		return -1;
+	}
+
+	size_t groupCount = length / 4;
+	size_t remainder = length % 4;
+	if (remainder == 1) {
+		// A single character only holds 6 bits, not a whole byte.
+		return -1;
+	}
+
+	if (!JFBase64DecodeGroups(characters, groupCount, output, alphabet)) {
+		return -1;
+	}
+
+	size_t produced = groupCount * 3;
+
+	// Decode the last 2 or 3 characters of an incomplete group.
+	if (remainder > 0) {
+		const UInt8 *last = characters + groupCount * 4;
+		UInt32 a = decodingTable[last[0]];
+		UInt32 b = decodingTable[last[1]];
+		UInt32 c = (remainder == 3) ? decodingTable[last[2]] : 0;
+		if (((a | b | c) & 0x80) != 0) {
+			return -1;
+		}
+
+		UInt32 value = (a << 18) | (b << 12) | (c << 6);
+		output[produced++] = (UInt8) (value >> 16);
+		if (remainder == 3) {
+			output[produced++] = (UInt8) (value >> 8);
+		}
+	}
+
+	return (NSInteger) produced;
+}
+
+
+#pragma mark - Stream functions
+
+void JFBase64StreamInit(JFBase64Stream *stream, BOOL encoding, NSUInteger options) {
+
+	memset(stream, 0, sizeof(JFBase64Stream));
+	stream->encoding = encoding;
+	stream->options = options;
+}
+
+NSInteger JFBase64StreamUpdate(JFBase64Stream *stream, const UInt8 *input, size_t length, UInt8 *output) {
+
+	NSUInteger alphabet = JFBase64Alphabet(stream->options);
+	size_t groupLength = stream->encoding ? 3 : 4;
+	size_t totalLength = stream->pendingLength + length;
+	size_t produced = 0;
+
+	// Decoding holds back the last group, even if whole, as only at the end is it known whether it is padded.
+	size_t heldBackLength = totalLength % groupLength;
+	if (!stream->encoding && heldBackLength == 0 && totalLength > 0) {
+		heldBackLength = groupLength;
+	}
+
+	if (totalLength - heldBackLength == 0) {
+		memcpy(stream->pendingBytes + stream->pendingLength, input, length);
+		stream->pendingLength += length;
+		return 0;
+	}
+
+	// Complete the group held back from the previous update.
+	if (stream->pendingLength > 0) {
+		size_t fillLength = groupLength - stream->pendingLength;
+		memcpy(stream->pendingBytes + stream->pendingLength, input, fillLength);
+		input += fillLength;
+		length -= fillLength;
+		stream->pendingLength = 0;
+
+		if (stream->encoding) {
+			JFBase64EncodeGroups(stream->pendingBytes, 1, (char *) output, alphabet);
+			produced = 4;
+		} else {
+			if (!JFBase64DecodeGroups(stream->pendingBytes, 1, output, alphabet)) {
+				return -1;
+			}
+			produced = 3;
+		}
+	}
+
+	size_t groupCount = (length - heldBackLength) / groupLength;
+	if (stream->encoding) {
+		JFBase64EncodeGroups(input, groupCount, (char *) output + produced, alphabet);
+		produced += groupCount * 4;
+	} else {
+		if (!JFBase64DecodeGroups(input, groupCount, output + produced, alphabet)) {
+			return -1;
+		}
+		produced += groupCount * 3;
+	}
+
+	memcpy(stream->pendingBytes, input + groupCount * groupLength, heldBackLength);
+	stream->pendingLength = heldBackLength;
+
+	return (NSInteger) produced;
+}
+
+NSInteger JFBase64StreamFinish(JFBase64Stream *stream, UInt8 *output) {
+
+	NSInteger produced;
+
+	if (stream->encoding) {
+		produced = (NSInteger) JFBase64Encode(stream->pendingBytes, stream->pendingLength, (char *) output, stream->options);
+	} else {
+		produced = JFBase64Decode((const char *) stream->pendingBytes, stream->pendingLength, output, stream->options);
+	}
+
+	stream->pendingLength = 0;
+
+	return produced;
+}
@@ -0,0 +1,68 @@
+//
+//  JFBase64StreamCoder.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFBase64Core.h"
+
+
+/*
+ * Encodes or decodes Base64 piece by piece, so large blobs can be piped through it in constant memory.
+ * The concatenated output of every update and the finish is the same as the one-shot JFBase64 output
+ * for the whole input, while at most 2 bytes (encoding) or 4 characters (decoding) are held back between calls.
+ * Chunks may be split anywhere.
+ *
+ * Usage Example:
+ * JFBase64StreamCoder *encoder = [[JFBase64StreamCoder alloc] initForEncodingWithOptions: JFBase64OptionUrlSafe];
+ * while ((chunk = [reader nextChunk]) != nil) {
+ *     [writer write: [encoder update: chunk]];
+ * }
+ * [writer write: [encoder finish]];
+ */
+@interface JFBase64StreamCoder : NSObject {
+
+@private
+	JFBase64Stream _stream;
+
+	// The flag denoting whether the stream has been finished or has failed.
+	BOOL _finished;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly, getter=isEncoding) BOOL encoding;
+@property (nonatomic, readonly, getter=isFinished) BOOL finished;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initForEncodingWithOptions: (NSUInteger) options;
+- (id) initForDecodingWithOptions: (NSUInteger) options;
+
+
+#pragma mark - Methods
+
+- (NSUInteger) outputLengthForUpdateOfLength: (NSUInteger) length;
+- (NSData *) update: (NSData *) data;
+- (NSData *) finish;
+- (NSInteger) updateBytes: (const void *) bytes length: (NSUInteger) length output: (void *) output;
+- (NSInteger) finishWithOutput: (void *) output;
+
+@end
@@ -0,0 +1,181 @@
+//
+//  JFBase64StreamCoder.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFBase64StreamCoder.h"
+
+#import "JFMacros.h"
+
+
+@implementation JFBase64StreamCoder
+
+
+#pragma mark - Properties
+
+@synthesize finished = _finished;
+
+- (BOOL) isEncoding {
+
+	return _stream.encoding;
+}
+
+
+#pragma mark - Object lifecycle methods
+
+/*
+ * Initializes an encoder.
+ *
+ * Params
+ *		options		JFBase64OptionUrlSafe and/or JFBase64OptionNoPadding, or JFBase64OptionsNone.
+ */
+- (id) initForEncodingWithOptions: (NSUInteger) options {
+
+	self = [super init];
+
+	if (self) {
+		JFBase64StreamInit(&_stream, YES, options);
+	}
+
+	return self;
+}
+
+/*
+ * Initializes a decoder.
+ *
+ * Params
+ *		options		JFBase64OptionUrlSafe and/or JFBase64OptionNoPadding (padding then being optional), or JFBase64OptionsNone.
+ */
+- (id) initForDecodingWithOptions: (NSUInteger) options {
+
+	self = [super init];
+
+	if (self) {
+		JFBase64StreamInit(&_stream, NO, options);
+	}
+
+	return self;
+}
+
+
+#pragma mark - Methods
+
+/*
+ * Returns the room the output of an update of the given length needs.
+ */
+- (NSUInteger) outputLengthForUpdateOfLength: (NSUInteger) length {
+
+	return JFBase64StreamUpdateLength(&_stream, length);
+}
+
+/*
+ * Processes the next piece of the stream.
+ *
+ * Return
+ *		The output produced (possibly empty, as a partial group is held back) or nil if the stream
+ *		has finished or an invalid character was found.
+ */
+- (NSData *) update: (NSData *) data {
+
+	JFReturnNilIfNil(data);
+
+	NSUInteger length = [data length];
+	NSMutableData *output = [NSMutableData dataWithLength: [self outputLengthForUpdateOfLength: length]];
+	NSInteger outputLength = [self updateBytes: [data bytes]
+										length: length
+										output: [output mutableBytes]];
+	if (outputLength < 0) {
+		return nil;
+	}
+
+	[output setLength: (NSUInteger) outputLength];
+	return output;
+}
+
+/*
+ * Ends the stream, encoding the last bytes (with padding unless asked not to)
+ * or decoding the last characters and checking the padding.
+ *
+ * Return
+ *		The last of the output or nil if the stream had already finished or its end was invalid.
+ */
+- (NSData *) finish {
+
+	UInt8 output[JFBase64StreamMaxFinishLength];
+
+	NSInteger outputLength = [self finishWithOutput: output];
+	if (outputLength < 0) {
+		return nil;
+	}
+
+	return [NSData dataWithBytes: output
+						  length: (NSUInteger) outputLength];
+}
+
+/*
+ * Processes the next piece of the stream into a caller-provided buffer.
+ *
+ * Params
+ *		output	Room for outputLengthForUpdateOfLength: length bytes (may be NULL when that is 0).
+ *
+ * Return
+ *		The number of bytes written to the output or -1 if the stream has finished or an invalid character was found.
+ */
+- (NSInteger) updateBytes: (const void *) bytes length: (NSUInteger) length output: (void *) output {
+
+	if (_finished) {
+		return -1;
+	}
+
+	if (length == 0) {
+		return 0;
+	}
+
+	// A piece completing no group writes nothing, so the output may then be NULL (as an empty data's bytes can be).
+	if (bytes == NULL || (output == NULL && JFBase64StreamUpdateLength(&_stream, length) > 0)) {
+		return -1;
+	}
+
+	NSInteger outputLength = JFBase64StreamUpdate(&_stream, bytes, length, output);
+	if (outputLength < 0) {
+		_finished = YES;
+	}
+
+	return outputLength;
+}
+
+/*
+ * Ends the stream into a caller-provided buffer.
+ *
+ * Params
+ *		output	Room for JFBase64StreamMaxFinishLength bytes.
+ *
+ * Return
+ *		The number of bytes written to the output or -1 if the stream had already finished or its end was invalid.
+ */
+- (NSInteger) finishWithOutput: (void *) output {
+
+	if (_finished || output == NULL) {
+		return -1;
+	}
+
+	_finished = YES;
+
+	return JFBase64StreamFinish(&_stream, output);
+}
+
+@end
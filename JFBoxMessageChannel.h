@@ -0,0 +1,103 @@
+//
+//  JFBoxMessageChannel.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFSocketReader.h"
+#import "JFSocketWriter.h"
+
+
+// The default maximum byte size of a single message.
+#define JFBoxMessageChannelDefaultMaxFrameSize		(16 * 1024 * 1024)
+
+// The byte size up to which small messages are coalesced into a single buffer before being queued on the writer.
+#define JFBoxMessageChannelCoalesceByteLimit		(16 * 1024)
+
+// The maximum byte size of a frame header (a varint encoded 64 bit length).
+#define JFBoxMessageChannelMaxHeaderSize			10
+
+
+typedef void (^JFBoxMessageChannelMessageHandler) (NSData * /* message */);
+
+
+/*
+ * Frames BOX messages (the output of JFBoxEncoder) over a socket.
+ *
+ * Each message is preceded by its byte length as an unsigned LEB128 varint, so small messages cost a
+ * single header byte.  Outgoing small messages are coalesced into one buffer so many of them go out in
+ * a single write, while large ones are queued on the writer as is.  Incoming frames are parsed straight
+ * out of the reader's buffer, several per read, and a frame whose header announces more than maxFrameSize
+ * bytes is rejected before its body is buffered.
+ *
+ * Usage Example:
+ * JFBoxMessageChannel *channel = [[JFBoxMessageChannel alloc] initWithSocket: socket];
+ * [channel enqueueMessage: [encoder data]];
+ * [channel flush];
+ * [channel receiveMessagesWithHandler: ^(NSData *message) {
+ *     JFBoxDecoder *decoder = [JFBoxDecoder boxDecoderWithData: message];
+ *     ...
+ * }];
+ */
+@interface JFBoxMessageChannel : NSObject {
+
+@private
+	// The reader the frames are parsed from.
+	JFSocketReader *_reader;
+
+	// The writer the frames are queued on.
+	JFSocketWriter *_writer;
+
+	// The maximum byte size of a single message.
+	UInt64 _maxFrameSize;
+
+	// The small frames waiting to be queued on the writer as one segment.
+	NSMutableData *_coalescedFrames;
+
+	// The flag denoting whether an oversized or malformed frame was received.
+	BOOL _encounteredError;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) JFSocketReader *reader;
+@property (nonatomic, readonly) JFSocketWriter *writer;
+@property (nonatomic, assign) UInt64 maxFrameSize;
+@property (nonatomic, readonly, getter=encounteredError) BOOL encounteredError;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithSocket: (NSInteger) socket;
+- (id) initWithReader: (JFSocketReader *) reader writer: (JFSocketWriter *) writer;
+
+
+#pragma mark - Sending methods
+
+- (BOOL) enqueueMessage: (NSData *) message;
+- (void) moveCoalescedFramesToWriter;
+- (NSInteger) flush;
+
+
+#pragma mark - Receiving methods
+
+- (NSInteger) receiveMessagesWithHandler: (JFBoxMessageChannelMessageHandler) handler;
+- (NSInteger) processBufferedMessagesWithHandler: (JFBoxMessageChannelMessageHandler) handler;
+
+@end
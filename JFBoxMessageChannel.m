@@ -0,0 +1,321 @@
+//
+//  JFBoxMessageChannel.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFBoxMessageChannel.h"
+
+#import "JFGC.h"
+#import "JFMacros.h"
+#import <errno.h>
+
+
+/*
+ * Writes the length as an unsigned LEB128 varint.
+ * Returns the number of header bytes written.
+ */
+static inline NSUInteger JFBoxMessageChannelEncodeHeader(UInt64 length, UInt8 *header) {
+
+	NSUInteger headerLength = 0;
+
+	while (length >= 0x80) {
+		header[headerLength++] = (UInt8) (length | 0x80);
+		length >>= 7;
+	}
+	header[headerLength++] = (UInt8) length;
+
+	return headerLength;
+}
+
+/*
+ * Reads an unsigned LEB128 varint from the available bytes.
+ * Returns the number of header bytes read, 0 if the header is incomplete or -1 if it is malformed
+ * (longer than JFBoxMessageChannelMaxHeaderSize or encoding a value beyond 64 bits).
+ */
+static inline NSInteger JFBoxMessageChannelDecodeHeader(const UInt8 *bytes, NSUInteger availableLength, UInt64 *length) {
+
+	UInt64 value = 0;
+
+	for (NSUInteger index = 0; index < JFBoxMessageChannelMaxHeaderSize; index++) {
+		if (index == availableLength) {
+			return 0;
+		}
+
+		UInt8 byte = bytes[index];
+
+		// The tenth byte only holds the top bit of a 64 bit length; anything more would overflow.
+		if (index == 9 && byte > 1) {
+			return -1;
+		}
+
+		value |= ((UInt64) (byte & 0x7F)) << (7 * index);
+
+		if ((byte & 0x80) == 0) {
+			*length = value;
+			return index + 1;
+		}
+	}
+
+	return -1;
+}
+
+
+@implementation JFBoxMessageChannel
+
+
+#pragma mark - Properties
+
+@synthesize reader = _reader;
+@synthesize writer = _writer;
+@synthesize maxFrameSize = _maxFrameSize;
+@synthesize encounteredError = _encounteredError;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithSocket: (NSInteger) socket {
+
+	JFSocketReader *reader = [[JFSocketReader alloc] initWithSocket: socket];
+	JFSocketWriter *writer = [[JFSocketWriter alloc] initWithSocket: socket];
+
+	self = [self initWithReader: reader
+						 writer: writer];
+
+#if !__has_feature(objc_arc) // NON ARC
+	[reader release];
+	[writer release];
+#endif
+
+	return self;
+}
+
+/*
+ * Initializes a channel over an existing reader and writer, such as those an event loop hands to its handlers.
+ */
+- (id) initWithReader: (JFSocketReader *) reader writer: (JFSocketWriter *) writer {
+
+	self = [super init];
+
+	if (self) {
+		if (reader == nil || writer == nil) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+
+#if !__has_feature(objc_arc) // NON ARC
+		_reader = [reader retain];
+		_writer = [writer retain];
+#else
+		_reader = reader;
+		_writer = writer;
+#endif
+		_maxFrameSize = JFBoxMessageChannelDefaultMaxFrameSize;
+		_coalescedFrames = [[NSMutableData alloc] initWithCapacity: JFBoxMessageChannelCoalesceByteLimit];
+	}
+
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+#else
+
+- (void) dealloc {
+
+	JFRelease(_reader);
+	JFRelease(_writer);
+	JFRelease(_coalescedFrames);
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Sending methods
+
+/*
+ * Frames the message and queues it to be written on the next flush.
+ * Small messages are copied into the coalescing buffer, large ones are queued without copying.
+ *
+ * Params
+ *		message		The BOX encoded message.
+ *
+ * Return
+ *		NO if the message is larger than maxFrameSize (and so would be rejected by the peer)
+ *		or the writer is full, in which case the message should be enqueued again once the writer has drained.
+ */
+- (BOOL) enqueueMessage: (NSData *) message {
+
+	JFReturnNoIfNil(message);
+
+	NSUInteger length = [message length];
+	if (length > _maxFrameSize || [_writer isFull]) {
+		return NO;
+	}
+
+	UInt8 header[JFBoxMessageChannelMaxHeaderSize];
+	NSUInteger headerLength = JFBoxMessageChannelEncodeHeader(length, header);
+	[_coalescedFrames appendBytes: header
+						   length: headerLength];
+
+	if (length < JFBoxMessageChannelCoalesceByteLimit) {
+		[_coalescedFrames appendData: message];
+
+		if ([_coalescedFrames length] >= JFBoxMessageChannelCoalesceByteLimit) {
+			[self moveCoalescedFramesToWriter];
+		}
+
+		return YES;
+	}
+
+	// The header goes out with the frames before it, the body as its own segment.
+	NSData *body = [message copy];
+	[_writer enqueueSegments: [NSArray arrayWithObjects: _coalescedFrames, body, nil]];
+#if !__has_feature(objc_arc) // NON ARC
+	[body release];
+	[_coalescedFrames release];
+#endif
+	_coalescedFrames = [[NSMutableData alloc] initWithCapacity: JFBoxMessageChannelCoalesceByteLimit];
+
+	return YES;
+}
+
+/*
+ * Queues the coalesced frames on the writer as a single segment, unless the writer is full.
+ */
+- (void) moveCoalescedFramesToWriter {
+
+	if ([_coalescedFrames length] == 0) {
+		return;
+	}
+
+	if (![_writer enqueueData: _coalescedFrames]) {
+		// The frames stay coalesced until the writer drains.
+		return;
+	}
+
+#if !__has_feature(objc_arc) // NON ARC
+	[_coalescedFrames release];
+#endif
+	_coalescedFrames = [[NSMutableData alloc] initWithCapacity: JFBoxMessageChannelCoalesceByteLimit];
+}
+
+/*
+ * Writes the queued frames until none remain or the socket would block.
+ *
+ * Return
+ *		The number of bytes written or -1 on error.
+ */
+- (NSInteger) flush {
+
+	[self moveCoalescedFramesToWriter];
+
+	return [_writer flush];
+}
+
+
+#pragma mark - Receiving methods
+
+/*
+ * Reads once from the socket and passes every complete message received to the handler.
+ *
+ * Return
+ *		The number of messages handled, 0 when none is complete yet or the peer closed the connection
+ *		(see the reader's endOfStream), or -1 on a read error or an oversized or malformed frame.
+ */
+- (NSInteger) receiveMessagesWithHandler: (JFBoxMessageChannelMessageHandler) handler {
+
+	if ([_reader readFromSocket] < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		return -1;
+	}
+
+	return [self processBufferedMessagesWithHandler: handler];
+}
+
+/*
+ * Passes every complete message already in the reader's buffer to the handler, then consumes them.
+ * The message data points straight into the reader's buffer and is only valid during the handler call,
+ * so handlers must copy it to keep it.
+ *
+ * Return
+ *		The number of messages handled or -1 on an oversized or malformed frame, after which the channel should be closed.
+ */
+- (NSInteger) processBufferedMessagesWithHandler: (JFBoxMessageChannelMessageHandler) handler {
+
+	JFReturnZeroIfNil(handler);
+
+	if (_encounteredError) {
+		return -1;
+	}
+
+	NSInteger messageCount = 0;
+
+	while (YES) {
+		NSUInteger availableLength = [_reader byteCount];
+		if (availableLength == 0) {
+			break;
+		}
+
+		NSUInteger peekLength = MIN(availableLength, (NSUInteger) JFBoxMessageChannelMaxHeaderSize);
+		const UInt8 *bytes = [_reader contiguousBytesOfLength: peekLength];
+		UInt64 length = 0;
+		NSInteger headerLength = JFBoxMessageChannelDecodeHeader(bytes, peekLength, &length);
+
+		if (headerLength < 0 || length > _maxFrameSize) {
+			// Reject the frame before buffering its body.
+			_encounteredError = YES;
+			return -1;
+		}
+
+		if (headerLength == 0) {
+			break;
+		}
+
+		NSUInteger frameLength = headerLength + (NSUInteger) length;
+		if (availableLength < frameLength) {
+			// Make room for the whole frame so the remainder can be read in as few reads as possible.
+			// The frame is within maxFrameSize, which bounds the buffer rather than the reader's default maximum.
+			if ([_reader maximumCapacity] < frameLength) {
+				[_reader setMaximumCapacity: frameLength];
+			}
+			[_reader ensureFreeByteCount: frameLength - availableLength];
+			break;
+		}
+
+		bytes = [_reader contiguousBytesOfLength: frameLength];
+
+		@autoreleasepool {
+			NSData *message = [[NSData alloc] initWithBytesNoCopy: (void *) (bytes + headerLength)
+														   length: (NSUInteger) length
+													 freeWhenDone: NO];
+			handler(message);
+#if !__has_feature(objc_arc) // NON ARC
+			[message release];
+#endif
+		}
+
+		[_reader consumeByteCount: frameLength];
+		messageCount++;
+	}
+
+	return messageCount;
+}
+
+@end
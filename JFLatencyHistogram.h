@@ -0,0 +1,97 @@
+//
+//  JFLatencyHistogram.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import <time.h>
+
+
+/*
+ * The number of buckets in a latency histogram.
+ * Bucket n counts durations of [2^n, 2^(n+1)) nanoseconds, bucket 0 also counts zero durations
+ * and the last bucket counts everything longer (about 9 minutes and up).
+ */
+#define JFLatencyHistogramBucketCount		40
+
+
+/*
+ * Returns a monotonic timestamp in nanoseconds suitable for measuring durations.
+ */
+static inline UInt64 JFLatencyHistogramNow(void) {
+	
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return ((UInt64) now.tv_sec * 1000000000ull) + (UInt64) now.tv_nsec;
+}
+
+/*
+ * Returns the index of the bucket counting the provided duration.
+ */
+static inline NSUInteger JFLatencyHistogramBucketForDuration(UInt64 nanoseconds) {
+	
+	if (nanoseconds == 0) {
+		return 0;
+	}
+	
+	NSUInteger bucket = 63 - __builtin_clzll(nanoseconds);
+	if (bucket >= JFLatencyHistogramBucketCount) {
+		bucket = JFLatencyHistogramBucketCount - 1;
+	}
+	
+	return bucket;
+}
+
+/*
+ * Counts the duration since the provided start timestamp into the histogram buckets.
+ * Safe to call concurrently on shared buckets.
+ */
+static inline void JFLatencyHistogramRecordSince(UInt64 *buckets, UInt64 start) {
+	
+	UInt64 now = JFLatencyHistogramNow();
+	UInt64 duration = (now > start) ? now - start : 0;
+	
+	__atomic_fetch_add(&buckets[JFLatencyHistogramBucketForDuration(duration)], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns the upper bound in nanoseconds of the bucket holding the provided percentile (0.0 to 1.0),
+ * or 0 if the histogram is empty.
+ */
+static inline UInt64 JFLatencyHistogramPercentile(const UInt64 *buckets, double percentile) {
+	
+	UInt64 total = 0;
+	for (NSUInteger bucket = 0; bucket < JFLatencyHistogramBucketCount; bucket++) {
+		total += buckets[bucket];
+	}
+	
+	if (total == 0) {
+		return 0;
+	}
+	
+	UInt64 threshold = (UInt64) ceil(total * percentile);
+	UInt64 seen = 0;
+	for (NSUInteger bucket = 0; bucket < JFLatencyHistogramBucketCount; bucket++) {
+		seen += buckets[bucket];
+		if (seen >= threshold && seen > 0) {
+			return 1ull << (bucket + 1);
+		}
+	}
+	
+	return 1ull << JFLatencyHistogramBucketCount;
+}
@@ -20,11 +20,32 @@
 #import <Foundation/Foundation.h>
 
 #import "JFPopularityCacheable.h"
+#import "JFPopularityCacheStatistics.h"
+#import "JFPopularityCacheDiskTier.h"
 
 
 // The default max capacity
 #define JFPopularityCacheDefaultMaxCapacity		10
 
+// The version of the snapshot file format written by saveSnapshotToPath:
+// (2 adds each entry's load time; version 1 snapshots still load).
+#define JFPopularityCacheSnapshotFormatVersion	(UInt16) 2
+
+// The oldest snapshot file format version loadSnapshotFromPath: reads.
+#define JFPopularityCacheSnapshotMinFormatVersion	(UInt16) 1
+
+
+/*
+ * The loader block used by read-through lookups.
+ * It is run at most once at a time per key and returns the object to cache for that key, or nil if there is none.
+ */
+typedef id (^JFPopularityCacheLoader) (NSString * /* key */);
+
+/*
+ * Implement this block handler to be notified of the result of an asynchronous read-through lookup.
+ */
+typedef void (^JFPopularityCacheLoadCompletionHandler) (id /* object or nil */);
+
 /*
  * The popularity cache.
  * Objects fall out of the cache from the rear when the object count exceeds the maximum capacity.
@@ -40,12 +61,44 @@
 	
 	// The popularity rank.
 	NSMutableArray *_popularity;
+	
+	// The read-through loads currently in progress, keyed by cache key.
+	NSMutableDictionary *_loads;
+	
+	// The times at which loader-provided objects were loaded, keyed by cache key.
+	NSMutableDictionary *_loadTimes;
+	
+	// The times at which cached nil loader results expire, keyed by cache key.
+	NSMutableDictionary *_negativeExpiryTimes;
+	
+	// The number of seconds a loader-provided object stays fresh (0 means forever).
+	NSTimeInterval _loadedObjectLifetime;
+	
+	// The number of seconds a nil loader result is remembered (0 means not at all).
+	NSTimeInterval _negativeLifetime;
+	
+	// The fraction of the loaded object lifetime after which a hit triggers a background reload (0 means never).
+	double _refreshAheadFactor;
+	
+	// The flag denoting whether statistics are being kept.
+	BOOL _statisticsEnabled;
+	
+	// The statistics counter stripes (NULL until statistics are first enabled).
+	JFPopularityCacheStatistics *_statisticsStripes;
+	
+	// The optional tier into which evicted JFBoxEncodable objects spill.
+	JFPopularityCacheDiskTier *_diskTier;
 }
 
 
 #pragma mark - Properties
 
 @property (nonatomic, readonly) NSDictionary *cache;
+@property (nonatomic, assign) NSTimeInterval loadedObjectLifetime;
+@property (nonatomic, assign) NSTimeInterval negativeLifetime;
+@property (nonatomic, assign) double refreshAheadFactor;
+@property (nonatomic, assign) BOOL statisticsEnabled;
+@property (nonatomic, retain) JFPopularityCacheDiskTier *diskTier;
 
 
 #pragma mark - Methods
@@ -59,5 +112,27 @@
 - (id) removeLastObject;
 - (BOOL) containsObject: (id) object;
 - (id) objectWithKey: (NSString *) key;
+- (id) objectWithKey: (NSString *) key loader: (JFPopularityCacheLoader) loader;
+- (void) objectWithKey: (NSString *) key loader: (JFPopularityCacheLoader) loader completion: (JFPopularityCacheLoadCompletionHandler) completion;
+
+
+#pragma mark - Bulk methods
+
+- (NSDictionary *) objectsForKeys: (NSArray *) keys;
+- (NSDictionary *) objectsForKeys: (NSArray *) keys missingKeys: (NSArray **) missingKeys;
+- (NSUInteger) addObjects: (NSArray *) objects forKeys: (NSArray *) keys;
+- (NSArray *) removeObjectsForKeys: (NSArray *) keys;
+
+
+#pragma mark - Snapshot methods
+
+- (BOOL) saveSnapshotToPath: (NSString *) path;
+- (BOOL) loadSnapshotFromPath: (NSString *) path;
+
+
+#pragma mark - Statistics methods
+
+- (JFPopularityCacheStatistics) statistics;
+- (void) resetStatistics;
 
 @end
\ No newline at end of file
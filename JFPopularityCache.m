@@ -19,6 +19,162 @@
 
 #import "JFPopularityCache.h"
 
+#import "JFGC.h"
+#import "JFBoxEncoder.h"
+#import "JFBoxDecoder.h"
+#import "JFMacros.h"
+
+
+// The stripe number (index + 1) the current thread updates, 0 until first assigned.
+static __thread NSUInteger JFPopularityCacheThreadStripeNumber = 0;
+
+// The next stripe number to hand out to a thread.
+static NSUInteger JFPopularityCacheNextStripeNumber = 0;
+
+// Increments a statistics counter without locking.
+#define JFPopularityCacheCount(statistics, counter) __atomic_fetch_add(&(statistics)->counter, 1, __ATOMIC_RELAXED)
+
+
+/*
+ * Returns the statistics stripe the calling thread updates, or NULL if statistics are disabled.
+ * Checking the enabled flag is the only cost paid while statistics are off.
+ */
+static inline JFPopularityCacheStatistics *JFPopularityCacheStripeForCurrentThread(JFPopularityCacheStatistics **stripes, BOOL *enabled) {
+	
+	if (!__atomic_load_n(enabled, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+	
+	if (JFPopularityCacheThreadStripeNumber == 0) {
+		NSUInteger stripeNumber = __atomic_fetch_add(&JFPopularityCacheNextStripeNumber, 1, __ATOMIC_RELAXED);
+		JFPopularityCacheThreadStripeNumber = (stripeNumber % JFPopularityCacheStatisticsStripeCount) + 1;
+	}
+	
+	return &(*stripes)[JFPopularityCacheThreadStripeNumber - 1];
+}
+
+
+/*
+ * A single read-through load shared by every caller asking for the same key while it is in progress.
+ */
+@interface JFPopularityCacheLoad : NSObject {
+	
+@private
+	// The condition on which synchronous callers wait for the load to finish.
+	NSCondition *_condition;
+	
+	// The loaded object (nil if the loader found none).
+	id _object;
+	
+	// The flag denoting whether the loader has returned.
+	BOOL _finished;
+	
+	// The completion handlers of asynchronous callers.
+	NSMutableArray *_completionHandlers;
+}
+
+- (BOOL) addCompletionHandler: (JFPopularityCacheLoadCompletionHandler) completion;
+- (id) waitForObject;
+- (void) finishWithObject: (id) object;
+
+@end
+
+
+@implementation JFPopularityCacheLoad
+
+- (id) init {
+	
+	self = [super init];
+	
+	_condition = [[NSCondition alloc] init];
+	_completionHandlers = [[NSMutableArray alloc] initWithCapacity: 1];
+	
+	return self;
+}
+
+#if  __has_feature(objc_arc)
+
+#else
+
+- (void) dealloc {
+	
+	[_condition release];
+	[_object release];
+	[_completionHandlers release];
+	[super dealloc];
+}
+
+#endif
+
+/*
+ * Registers a handler to be called once the load finishes.
+ *
+ * Return
+ *		YES if the handler was registered, NO if the load had already finished (the caller should then call it directly).
+ */
+- (BOOL) addCompletionHandler: (JFPopularityCacheLoadCompletionHandler) completion {
+	
+	BOOL added = NO;
+	
+	[_condition lock];
+	if (!_finished) {
+		id handler = [completion copy];
+		[_completionHandlers addObject: handler];
+#if !__has_feature(objc_arc) // NON ARC
+		[handler release];
+#endif
+		added = YES;
+	}
+	[_condition unlock];
+	
+	return added;
+}
+
+/*
+ * Blocks the calling thread until the load finishes.
+ *
+ * Return
+ *		The loaded object or nil.
+ */
+- (id) waitForObject {
+	
+	id object;
+	
+	[_condition lock];
+	while (!_finished) {
+		[_condition wait];
+	}
+	object = _object;
+	[_condition unlock];
+	
+	return object;
+}
+
+/*
+ * Publishes the loaded object to waiting callers and calls any registered completion handlers.
+ */
+- (void) finishWithObject: (id) object {
+	
+	NSArray *completionHandlers;
+	
+	[_condition lock];
+#if !__has_feature(objc_arc) // NON ARC
+	[object retain];
+#endif
+	_object = object;
+	_finished = YES;
+	completionHandlers = [NSArray arrayWithArray: _completionHandlers];
+	[_completionHandlers removeAllObjects];
+	[_condition broadcast];
+	[_condition unlock];
+	
+	for (JFPopularityCacheLoadCompletionHandler completion in completionHandlers) {
+		completion(object);
+	}
+}
+
+@end
+
 
 @implementation JFPopularityCache
 
@@ -26,6 +182,11 @@
 #pragma mark - Properties
 
 @synthesize cache = _cache;
+@synthesize loadedObjectLifetime = _loadedObjectLifetime;
+@synthesize negativeLifetime = _negativeLifetime;
+@synthesize refreshAheadFactor = _refreshAheadFactor;
+@synthesize statisticsEnabled = _statisticsEnabled;
+@synthesize diskTier = _diskTier;
 
 
 #pragma mark - Object lifecycle methods
@@ -42,6 +203,9 @@
 	
 	_cache = [[NSMutableDictionary alloc] initWithCapacity: JFPopularityCacheDefaultMaxCapacity];
 	_popularity = [[NSMutableArray alloc] initWithCapacity: JFPopularityCacheDefaultMaxCapacity];
+	_loads = [[NSMutableDictionary alloc] init];
+	_loadTimes = [[NSMutableDictionary alloc] init];
+	_negativeExpiryTimes = [[NSMutableDictionary alloc] init];
 	_maxCapacity = JFPopularityCacheDefaultMaxCapacity;
 	
 	return self;
@@ -49,12 +213,22 @@
 
 #if  __has_feature(objc_arc)
 
+- (void) dealloc {
+	
+	JFFree(_statisticsStripes);
+}
+
 #else
 
 - (void) dealloc {
 	
 	[_cache release];
 	[_popularity release];
+	[_loads release];
+	[_loadTimes release];
+	[_negativeExpiryTimes release];
+	[_diskTier release];
+	JFFree(_statisticsStripes);
 	[super dealloc];
 }
 
@@ -104,8 +278,12 @@
 		@synchronized (_popularity) {
 			[_cache removeAllObjects];
 			[_popularity removeAllObjects];
+			[_loadTimes removeAllObjects];
+			[_negativeExpiryTimes removeAllObjects];
 		}
 	}
+	
+	[_diskTier clear];
 }
 
 - (id) addObject: (id) object withKey: (NSString *) key {
@@ -118,6 +296,9 @@
 		return nil;
 	}
 	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	UInt64 start = (statistics != NULL) ? JFLatencyHistogramNow() : 0;
+	
 	if (![self containsObject: object]) {
 		// The object does not exist in the cache so add it...
 		@synchronized (_cache) {
@@ -134,6 +315,10 @@
                 }
 			}
 		}
+		
+		if (statistics != NULL) {
+			JFPopularityCacheCount(statistics, insertCount);
+		}
 	} else {
 		// The object is in the cache so just reorder the popularity.
 		@synchronized (_popularity) {
@@ -147,46 +332,78 @@
 		}
 	}
 	
+	/*
+	 * The object in memory supersedes any spilled to disk under the same key.
+	 * It is removed only once the object is in memory, so an older copy spilled concurrently
+	 * is either removed here or dropped by the spill itself (see removeSupersededDiskKeys:).
+	 */
+	[_diskTier removeObjectWithKey: key];
+	
 	NSUInteger objectCount = [self objectCount];
 	if (objectCount > _maxCapacity) {
 		// There is one too many objects in the cache so remove the last one.
 		[self removeLastObject];
 	}
 	
+	if (statistics != NULL) {
+		JFLatencyHistogramRecordSince(statistics->putLatencyBuckets, start);
+	}
+	
 	return object;
 }
 
 - (id) removeObjectWithKey: (NSString *) key {
 	
+	id object = [self discardObjectWithKey: key];
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	if (statistics != NULL && object != nil) {
+		JFPopularityCacheCount(statistics, removalCount);
+	}
+	
+	return object;
+}
+
+/*
+ * Removes the object with the key (and any other keys it is stored under) without counting it as a removal.
+ *
+ * Return
+ *		The removed object or nil.
+ */
+- (id) discardObjectWithKey: (NSString *) key {
+	
 	if ([key length] == 0) {
 		return nil;
 	}
 	
+	[_diskTier removeObjectWithKey: key];
+	
 	id object;
 	
-	// Return the element if it exists.
+	/*
+	 * The object is looked up and removed under the same locks, always taken cache first,
+	 * so that concurrent removals and loads can neither interleave nor deadlock.
+	 */
 	@synchronized (_cache) {
-		object = [_cache objectForKey: key];
-	}
-	
-	if (object == nil) {
-		return nil;
-	}
-	
-	// The object will be removed now.
-	@synchronized (_popularity) {
-		NSUInteger index = [_popularity indexOfObject: object];
-		[_popularity removeObjectAtIndex: index];
-		NSArray *allKeys = [_cache allKeysForObject: object];
-		[_cache removeObjectsForKeys: allKeys];
-        
-        [object retain];
-        if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
-            if ([object respondsToSelector: @selector(wasRemovedFromPopularityCache:)]) {
-                [object wasRemovedFromPopularityCache: self];
-            }
-        }
-        [object release];
+		@synchronized (_popularity) {
+			object = [_cache objectForKey: key];
+			if (object == nil) {
+				return nil;
+			}
+			
+			// The object will be removed now.
+			[[object retain] autorelease];
+			[_popularity removeObjectIdenticalTo: object];
+			NSArray *allKeys = [_cache allKeysForObject: object];
+			[_cache removeObjectsForKeys: allKeys];
+			[_loadTimes removeObjectsForKeys: allKeys];
+			
+			if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
+				if ([object respondsToSelector: @selector(wasRemovedFromPopularityCache:)]) {
+					[object wasRemovedFromPopularityCache: self];
+				}
+			}
+		}
 	}
 
 	return object;
@@ -199,13 +416,21 @@
 	}
 	
 	id <NSObject> object = nil;
-	@synchronized (_popularity) {
-		@synchronized (_cache) {
+	NSArray *allKeys = nil;
+	NSTimeInterval loadTime = 0.0;
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
 			object = [_popularity lastObject];
-            [object retain];
-			NSArray *allKeys = [_cache allKeysForObject: object];
+			if (object == nil) {
+				return nil;
+			}
+			
+            [[object retain] autorelease];
+			allKeys = [_cache allKeysForObject: object];
+			loadTime = [[_loadTimes objectForKey: [allKeys lastObject]] doubleValue];
 			[_popularity removeLastObject];
 			[_cache removeObjectsForKeys: allKeys];
+			[_loadTimes removeObjectsForKeys: allKeys];
             
             if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
                 if ([object respondsToSelector: @selector(wasRemovedFromPopularityCache:)]) {
@@ -213,10 +438,22 @@
                                  withObject: self];
                 }
             }
-            [object release];
         }
 	}
 	
+	if (_diskTier != nil && [object conformsToProtocol: @protocol(JFBoxEncodable)]) {
+		// Spill the object to disk rather than dropping it.
+		[_diskTier storeObject: (id <JFBoxEncodable>) object
+					  withKeys: allKeys
+					 timestamp: loadTime];
+		[self removeSupersededDiskKeys: allKeys];
+	}
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	if (statistics != NULL) {
+		JFPopularityCacheCount(statistics, evictionCount);
+	}
+	
 	return object;
 }
 
@@ -238,6 +475,9 @@
 
 - (id) objectWithKey: (NSString *) key {
 	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	UInt64 start = (statistics != NULL) ? JFLatencyHistogramNow() : 0;
+	
 	id object;
 	
 	// Return the element if it exists.
@@ -245,6 +485,20 @@
 		object = [_cache objectForKey: key];
 	}
 	
+	if (object == nil && _diskTier != nil) {
+		// A memory miss may still be a disk hit.
+		object = [self promoteObjectWithKey: key];
+	}
+	
+	if (statistics != NULL) {
+		if (object != nil) {
+			JFPopularityCacheCount(statistics, hitCount);
+		} else {
+			JFPopularityCacheCount(statistics, missCount);
+		}
+		JFLatencyHistogramRecordSince(statistics->getLatencyBuckets, start);
+	}
+	
 	if (object == nil) {
 		return nil;
 	}
@@ -252,4 +506,1067 @@
 	return object;
 }
 
-@end
\ No newline at end of file
+
+/*
+ * Returns the object for the key, loading and caching it on a miss.
+ * Concurrent callers missing on the same key share a single run of the loader and all receive its result.
+ *
+ * Params
+ *		key			The key of the object.
+ *					Must not be empty.
+ *		loader		The block which loads the object on a miss.
+ *					If nil this method behaves like objectWithKey:.
+ *
+ * Return
+ *		The cached or loaded object, or nil if there is none.
+ */
+- (id) objectWithKey: (NSString *) key loader: (JFPopularityCacheLoader) loader {
+	
+	if ([key length] == 0) {
+		return nil;
+	}
+	
+	if (loader == nil) {
+		return [self objectWithKey: key];
+	}
+	
+	BOOL found;
+	id object = [self freshObjectWithKey: key
+								  loader: loader
+								   found: &found];
+	if (found) {
+		return object;
+	}
+	
+	BOOL leader;
+	JFPopularityCacheLoad *load = [self joinLoadForKey: key
+												leader: &leader
+										  cachedObject: &object];
+	if (load == nil) {
+		// A load finished after the miss above.
+		return object;
+	}
+	
+	if (leader) {
+		// This caller is the first to miss so it runs the loader on behalf of everyone else.
+		[self performLoad: load
+				   forKey: key
+			   withLoader: loader];
+	}
+	
+	return [load waitForObject];
+}
+
+/*
+ * Asynchronously returns the object for the key, loading and caching it on a miss.
+ * On a hit the completion handler is called immediately on the calling thread,
+ * otherwise it is called on the thread which ran the loader.
+ *
+ * Params
+ *		key			The key of the object.
+ *					Must not be empty.
+ *		loader		The block which loads the object on a miss.
+ *					If nil the completion handler receives the result of objectWithKey:.
+ *		completion	The handler to receive the object or nil.
+ *					Must not be nil.
+ */
+- (void) objectWithKey: (NSString *) key loader: (JFPopularityCacheLoader) loader completion: (JFPopularityCacheLoadCompletionHandler) completion {
+	
+	if (completion == nil) {
+		return;
+	}
+	
+	if ([key length] == 0 || loader == nil) {
+		completion([self objectWithKey: key]);
+		return;
+	}
+	
+	BOOL found;
+	id object = [self freshObjectWithKey: key
+								  loader: loader
+								   found: &found];
+	if (found) {
+		completion(object);
+		return;
+	}
+	
+	BOOL leader;
+	JFPopularityCacheLoad *load = [self joinLoadForKey: key
+												leader: &leader
+										  cachedObject: &object];
+	if (load == nil) {
+		// A load finished after the miss above.
+		completion(object);
+		return;
+	}
+	
+	if (![load addCompletionHandler: completion]) {
+		// The load finished in the meantime.
+		completion([load waitForObject]);
+	}
+	
+	if (leader) {
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			[self performLoad: load
+					   forKey: key
+				   withLoader: loader];
+		});
+	}
+}
+
+
+#pragma mark - Read-through methods
+
+/*
+ * Looks up the key taking loaded object lifetimes and remembered nil results into account.
+ * A hit on an object old enough to be refreshed ahead schedules a background reload.
+ *
+ * Params
+ *		key			The key of the object.
+ *		loader		The loader used for refreshing ahead.
+ *		found		Receives YES if the lookup was answered (possibly with a remembered nil), NO if the loader must run.
+ *
+ * Return
+ *		The fresh object or nil.
+ */
+- (id) freshObjectWithKey: (NSString *) key loader: (JFPopularityCacheLoader) loader found: (BOOL *) found {
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	UInt64 start = (statistics != NULL) ? JFLatencyHistogramNow() : 0;
+	
+	id object = [self unrecordedFreshObjectWithKey: key
+											loader: loader
+											 found: found];
+	
+	if (statistics != NULL) {
+		if (*found && object == nil) {
+			JFPopularityCacheCount(statistics, negativeHitCount);
+		} else if (*found) {
+			JFPopularityCacheCount(statistics, hitCount);
+		} else {
+			JFPopularityCacheCount(statistics, missCount);
+		}
+		JFLatencyHistogramRecordSince(statistics->getLatencyBuckets, start);
+	}
+	
+	return object;
+}
+
+/*
+ * Performs the lookup of freshObjectWithKey:loader:found: without updating statistics.
+ */
+- (id) unrecordedFreshObjectWithKey: (NSString *) key loader: (JFPopularityCacheLoader) loader found: (BOOL *) found {
+	
+	*found = NO;
+	
+	id object;
+	NSNumber *loadTime;
+	NSNumber *negativeExpiryTime;
+	@synchronized (_cache) {
+		object = [_cache objectForKey: key];
+		loadTime = [_loadTimes objectForKey: key];
+		negativeExpiryTime = [_negativeExpiryTimes objectForKey: key];
+	}
+	
+	if (object == nil && _diskTier != nil) {
+		// A memory miss is checked against disk before falling through to the loader.
+		object = [self promoteObjectWithKey: key];
+		@synchronized (_cache) {
+			loadTime = [_loadTimes objectForKey: key];
+		}
+	}
+	
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	
+	if (object != nil) {
+		if (loadTime == nil || _loadedObjectLifetime <= 0.0) {
+			// The object never expires.
+			*found = YES;
+			return object;
+		}
+		
+		NSTimeInterval age = now - [loadTime doubleValue];
+		if (age >= _loadedObjectLifetime) {
+			// The object has expired so treat this as a miss.
+			[self discardObjectWithKey: key];
+			return nil;
+		}
+		
+		if (_refreshAheadFactor > 0.0 && age >= _loadedObjectLifetime * _refreshAheadFactor) {
+			// The object is hot and about to expire so reload it in the background.
+			[self refreshObjectWithKey: key
+							withLoader: loader];
+		}
+		
+		*found = YES;
+		return object;
+	}
+	
+	if (negativeExpiryTime != nil) {
+		if (now < [negativeExpiryTime doubleValue]) {
+			// The loader recently found nothing for this key.
+			*found = YES;
+			return nil;
+		}
+		
+		@synchronized (_cache) {
+			[_negativeExpiryTimes removeObjectForKey: key];
+		}
+	}
+	
+	return nil;
+}
+
+/*
+ * Returns the load in progress for the key, starting one if there is none.
+ *
+ * Params
+ *		key			The key being loaded.
+ *		leader		Receives YES if the caller started the load and must run the loader.
+ *
+ * Return
+ *		The shared load.
+ */
+- (JFPopularityCacheLoad *) joinLoadForKey: (NSString *) key leader: (BOOL *) leader {
+	
+	return [self joinLoadForKey: key
+						 leader: leader
+				   cachedObject: NULL];
+}
+
+/*
+ * Returns the load in progress for the key, starting one if there is none and the cache still misses.
+ * A load finishing between the caller's miss and this call has already cached its result,
+ * so the cache is checked again before a new load is started.
+ *
+ * Params
+ *		key				The key being loaded.
+ *		leader			Receives YES if the caller started the load and must run the loader.
+ *		cachedObject	Receives the fresh object (or nil for a remembered nil result) if the cache now answers.
+ *						If NULL the cache is not checked again, as when refreshing an object ahead of its expiry.
+ *
+ * Return
+ *		The shared load, or nil if the cache now answers.
+ */
+- (JFPopularityCacheLoad *) joinLoadForKey: (NSString *) key leader: (BOOL *) leader cachedObject: (id *) cachedObject {
+	
+	JFPopularityCacheLoad *load;
+	
+	@synchronized (_loads) {
+		load = [_loads objectForKey: key];
+		*leader = (load == nil);
+		if (load == nil) {
+			if (cachedObject != NULL && [self cachedFreshObjectWithKey: key
+																object: cachedObject]) {
+				*leader = NO;
+				return nil;
+			}
+			
+			load = [[JFPopularityCacheLoad alloc] init];
+			[_loads setObject: load
+					   forKey: key];
+#if !__has_feature(objc_arc) // NON ARC
+			[load autorelease];
+#endif
+		}
+		
+#if !__has_feature(objc_arc) // NON ARC
+		// Keep the load alive after it leaves the dictionary.
+		[[load retain] autorelease];
+#endif
+	}
+	
+	return load;
+}
+
+/*
+ * Checks the memory cache alone for a fresh object or a remembered nil result, without side effects.
+ * Loads cache their result before leaving the loads dictionary, so under the loads lock
+ * this sees the result of any load which has just finished.
+ *
+ * Return
+ *		YES if the cache answers, the object (possibly nil) being placed into the receiver.
+ */
+- (BOOL) cachedFreshObjectWithKey: (NSString *) key object: (id *) object {
+	
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	
+	@synchronized (_cache) {
+		id cachedObject = [_cache objectForKey: key];
+		
+		if (cachedObject != nil) {
+			NSNumber *loadTime = [_loadTimes objectForKey: key];
+			if (loadTime != nil && _loadedObjectLifetime > 0.0 && now - [loadTime doubleValue] >= _loadedObjectLifetime) {
+				// The object has expired so it must be loaded again.
+				return NO;
+			}
+			
+#if !__has_feature(objc_arc) // NON ARC
+			[[cachedObject retain] autorelease];
+#endif
+			*object = cachedObject;
+			return YES;
+		}
+		
+		NSNumber *negativeExpiryTime = [_negativeExpiryTimes objectForKey: key];
+		if (negativeExpiryTime != nil && now < [negativeExpiryTime doubleValue]) {
+			*object = nil;
+			return YES;
+		}
+	}
+	
+	return NO;
+}
+
+/*
+ * Reloads the key in the background unless a load for it is already in progress.
+ */
+- (void) refreshObjectWithKey: (NSString *) key withLoader: (JFPopularityCacheLoader) loader {
+	
+	BOOL leader;
+	JFPopularityCacheLoad *load = [self joinLoadForKey: key
+												leader: &leader];
+	if (!leader) {
+		return;
+	}
+	
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+		[self performLoad: load
+				   forKey: key
+			   withLoader: loader];
+	});
+}
+
+/*
+ * Runs the loader, caches its result and hands the result to everyone sharing the load.
+ */
+- (void) performLoad: (JFPopularityCacheLoad *) load forKey: (NSString *) key withLoader: (JFPopularityCacheLoader) loader {
+	
+	id object = loader(key);
+	
+	[self storeLoadedObject: object
+					 forKey: key];
+	
+	@synchronized (_loads) {
+		[_loads removeObjectForKey: key];
+	}
+	
+	[load finishWithObject: object];
+}
+
+/*
+ * Caches a loader result, remembering nil results if negative caching is enabled.
+ */
+- (void) storeLoadedObject: (id) object forKey: (NSString *) key {
+	
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	id existingObject;
+	@synchronized (_cache) {
+		existingObject = [_cache objectForKey: key];
+	}
+	
+	if (object == nil) {
+		if (existingObject != nil) {
+			// A refresh found nothing so the stale object must go.
+			[self discardObjectWithKey: key];
+		}
+		
+		if (_negativeLifetime > 0.0) {
+			@synchronized (_cache) {
+				[_negativeExpiryTimes setObject: [NSNumber numberWithDouble: now + _negativeLifetime]
+										 forKey: key];
+			}
+		}
+		return;
+	}
+	
+	if (existingObject != nil && existingObject != object) {
+		// A refresh produced a new object so replace the stale one.
+		[self discardObjectWithKey: key];
+	}
+	
+	[self addObject: object
+			withKey: key];
+	
+	@synchronized (_cache) {
+		if ([_cache objectForKey: key] == object) {
+			[_loadTimes setObject: [NSNumber numberWithDouble: now]
+						   forKey: key];
+		}
+		[_negativeExpiryTimes removeObjectForKey: key];
+	}
+}
+
+
+#pragma mark - Bulk methods
+
+/*
+ * Returns the objects for the keys, taking the cache lock once for the whole batch.
+ */
+- (NSDictionary *) objectsForKeys: (NSArray *) keys {
+	
+	return [self objectsForKeys: keys
+					missingKeys: NULL];
+}
+
+/*
+ * Returns the objects for the keys, taking the cache lock once for the whole batch.
+ * Like objectWithKey: lookups do not change the popularity order.
+ *
+ * Params
+ *		keys			The keys to look up.
+ *		missingKeys		Receives the keys with no object, in the order requested, so the caller can load them in one batch.
+ *						May be NULL.
+ *
+ * Return
+ *		The found objects keyed by their keys.
+ */
+- (NSDictionary *) objectsForKeys: (NSArray *) keys missingKeys: (NSArray **) missingKeys {
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	UInt64 start = (statistics != NULL) ? JFLatencyHistogramNow() : 0;
+	
+	NSUInteger keyCount = [keys count];
+	NSMutableDictionary *objects = [NSMutableDictionary dictionaryWithCapacity: keyCount];
+	NSMutableArray *missing = [NSMutableArray arrayWithCapacity: keyCount];
+	
+	@synchronized (_cache) {
+		for (NSString *key in keys) {
+			id object = [_cache objectForKey: key];
+			if (object != nil) {
+				[objects setObject: object
+							forKey: key];
+			} else {
+				[missing addObject: key];
+			}
+		}
+	}
+	
+	if (_diskTier != nil && [missing count] > 0) {
+		// Memory misses may still be disk hits.
+		NSMutableArray *stillMissing = [NSMutableArray arrayWithCapacity: [missing count]];
+		for (NSString *key in missing) {
+			id object = [self promoteObjectWithKey: key];
+			if (object != nil) {
+				[objects setObject: object
+							forKey: key];
+			} else {
+				[stillMissing addObject: key];
+			}
+		}
+		missing = stillMissing;
+	}
+	
+	if (statistics != NULL) {
+		__atomic_fetch_add(&statistics->hitCount, keyCount - [missing count], __ATOMIC_RELAXED);
+		__atomic_fetch_add(&statistics->missCount, [missing count], __ATOMIC_RELAXED);
+		JFLatencyHistogramRecordSince(statistics->getLatencyBuckets, start);
+	}
+	
+	if (missingKeys != NULL) {
+		*missingKeys = missing;
+	}
+	
+	return objects;
+}
+
+/*
+ * Adds the objects with their keys, taking the locks once for the whole batch.
+ * The result is the same as adding the objects one by one in order with addObject:withKey:,
+ * so the last object of the batch ends up the most popular, but the popularity order
+ * is rearranged in a single pass and any overflow is evicted in one go.
+ *
+ * Params
+ *		objects		The objects to add.
+ *		keys		The keys of the objects.
+ *					Must be as many as there are objects.
+ *
+ * Return
+ *		The number of objects added or made more popular.
+ */
+- (NSUInteger) addObjects: (NSArray *) objects forKeys: (NSArray *) keys {
+	
+	NSUInteger objectCount = [objects count];
+	if (objectCount == 0 || objectCount != [keys count]) {
+		return 0;
+	}
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	UInt64 start = (statistics != NULL) ? JFLatencyHistogramNow() : 0;
+	
+	NSUInteger acceptedCount = 0;
+	NSUInteger insertCount = 0;
+	
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
+			NSHashTable *present = [NSHashTable hashTableWithOptions: NSPointerFunctionsObjectPersonality];
+			for (id object in _popularity) {
+				[present addObject: object];
+			}
+			
+			// Store the objects in order, so an object given under several keys is stored under the first of them.
+			NSMutableArray *accepted = [NSMutableArray arrayWithCapacity: objectCount];
+			NSHashTable *inserted = [NSHashTable hashTableWithOptions: NSPointerFunctionsObjectPersonality];
+			
+			for (NSUInteger index = 0; index < objectCount; index++) {
+				id object = [objects objectAtIndex: index];
+				NSString *key = [keys objectAtIndex: index];
+				JFSkipIfNo([key isKindOfClass: [NSString class]]);
+				JFSkipIfEmptyString(key);
+				
+				[accepted addObject: object];
+				
+				// The object is in the cache (or was just added) so only its popularity changes.
+				JFSkipIfYes([present containsObject: object]);
+				[present addObject: object];
+				[inserted addObject: object];
+				
+				[_cache setObject: object
+						   forKey: key];
+				insertCount++;
+				
+				if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
+					if ([object respondsToSelector: @selector(wasAddedToPopularityCache:)]) {
+						[object wasAddedToPopularityCache: self];
+					}
+				}
+			}
+			acceptedCount = [accepted count];
+			
+			// The batch objects, most popular (last added) first, each appearing once.
+			NSMutableArray *batch = [NSMutableArray arrayWithCapacity: acceptedCount];
+			NSHashTable *batched = [NSHashTable hashTableWithOptions: NSPointerFunctionsObjectPersonality];
+			NSHashTable *moved = [NSHashTable hashTableWithOptions: NSPointerFunctionsObjectPersonality];
+			
+			for (id object in [accepted reverseObjectEnumerator]) {
+				JFSkipIfYes([batched containsObject: object]);
+				[batched addObject: object];
+				[batch addObject: object];
+				
+				if (![inserted containsObject: object]) {
+					// The object was already in the cache so it moves to the front.
+					[moved addObject: object];
+				}
+			}
+			
+			if ([moved count] > 0) {
+				NSMutableIndexSet *movedIndexes = [NSMutableIndexSet indexSet];
+				NSUInteger popularityCount = [_popularity count];
+				for (NSUInteger index = 0; index < popularityCount; index++) {
+					if ([moved containsObject: [_popularity objectAtIndex: index]]) {
+						[movedIndexes addIndex: index];
+					}
+				}
+				[_popularity removeObjectsAtIndexes: movedIndexes];
+			}
+			
+			[_popularity insertObjects: batch
+							 atIndexes: [NSIndexSet indexSetWithIndexesInRange: NSMakeRange(0, [batch count])]];
+		}
+	}
+	
+	// The objects in memory supersede any spilled to disk under the same keys (see addObject:withKey:).
+	[_diskTier removeObjectsWithKeys: keys];
+	
+	[self evictOverflowingObjects];
+	
+	if (statistics != NULL) {
+		__atomic_fetch_add(&statistics->insertCount, insertCount, __ATOMIC_RELAXED);
+		JFLatencyHistogramRecordSince(statistics->putLatencyBuckets, start);
+	}
+	
+	return acceptedCount;
+}
+
+/*
+ * Removes the objects for the keys (and any other keys they are stored under), taking the locks once for the whole batch.
+ *
+ * Return
+ *		The removed objects.
+ */
+- (NSArray *) removeObjectsForKeys: (NSArray *) keys {
+	
+	JFReturnNilIfEmptyArray(keys);
+	
+	[_diskTier removeObjectsWithKeys: keys];
+	
+	NSMutableArray *removed = [NSMutableArray arrayWithCapacity: [keys count]];
+	
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
+			NSHashTable *removedObjects = [NSHashTable hashTableWithOptions: NSPointerFunctionsObjectPointerPersonality];
+			
+			for (NSString *key in keys) {
+				id object = [_cache objectForKey: key];
+				JFSkipIfNil(object);
+				JFSkipIfYes([removedObjects containsObject: object]);
+				
+				[removedObjects addObject: object];
+				[removed addObject: object];
+				
+				NSArray *allKeys = [_cache allKeysForObject: object];
+				[_cache removeObjectsForKeys: allKeys];
+				[_loadTimes removeObjectsForKeys: allKeys];
+			}
+			
+			if ([removed count] > 0) {
+				NSMutableIndexSet *removedIndexes = [NSMutableIndexSet indexSet];
+				NSUInteger popularityCount = [_popularity count];
+				for (NSUInteger index = 0; index < popularityCount; index++) {
+					if ([removedObjects containsObject: [_popularity objectAtIndex: index]]) {
+						[removedIndexes addIndex: index];
+					}
+				}
+				[_popularity removeObjectsAtIndexes: removedIndexes];
+			}
+			
+			for (id object in removed) {
+				if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
+					if ([object respondsToSelector: @selector(wasRemovedFromPopularityCache:)]) {
+						[object performSelector: @selector(wasRemovedFromPopularityCache:)
+								 withObject: self];
+					}
+				}
+			}
+		}
+	}
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	if (statistics != NULL) {
+		__atomic_fetch_add(&statistics->removalCount, [removed count], __ATOMIC_RELAXED);
+	}
+	
+	return removed;
+}
+
+/*
+ * Evicts objects from the rear of the cache until it is within its max capacity,
+ * taking the locks once and spilling the evicted objects to the disk tier afterwards.
+ */
+- (void) evictOverflowingObjects {
+	
+	NSMutableArray *evicted = [NSMutableArray array];
+	NSMutableArray *evictedKeys = [NSMutableArray array];
+	NSMutableArray *evictedLoadTimes = [NSMutableArray array];
+	
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
+			while ([_cache count] > _maxCapacity && [_popularity count] > 0) {
+				id object = [_popularity lastObject];
+				NSArray *allKeys = [_cache allKeysForObject: object];
+				
+				[evicted addObject: object];
+				[evictedKeys addObject: allKeys];
+				[evictedLoadTimes addObject: [NSNumber numberWithDouble: [[_loadTimes objectForKey: [allKeys lastObject]] doubleValue]]];
+				
+				[_popularity removeLastObject];
+				[_cache removeObjectsForKeys: allKeys];
+				[_loadTimes removeObjectsForKeys: allKeys];
+				
+				if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
+					if ([object respondsToSelector: @selector(wasRemovedFromPopularityCache:)]) {
+						[object performSelector: @selector(wasRemovedFromPopularityCache:)
+								 withObject: self];
+					}
+				}
+			}
+		}
+	}
+	
+	NSUInteger evictedCount = [evicted count];
+	if (evictedCount == 0) {
+		return;
+	}
+	
+	if (_diskTier != nil) {
+		for (NSUInteger index = 0; index < evictedCount; index++) {
+			id object = [evicted objectAtIndex: index];
+			JFSkipIfNo([object conformsToProtocol: @protocol(JFBoxEncodable)]);
+			
+			// Spill the object to disk rather than dropping it.
+			[_diskTier storeObject: object
+						  withKeys: [evictedKeys objectAtIndex: index]
+						 timestamp: [[evictedLoadTimes objectAtIndex: index] doubleValue]];
+			[self removeSupersededDiskKeys: [evictedKeys objectAtIndex: index]];
+		}
+	}
+	
+	JFPopularityCacheStatistics *statistics = JFPopularityCacheStripeForCurrentThread(&_statisticsStripes, &_statisticsEnabled);
+	if (statistics != NULL) {
+		__atomic_fetch_add(&statistics->evictionCount, evictedCount, __ATOMIC_RELAXED);
+	}
+}
+
+
+#pragma mark - Disk tier methods
+
+/*
+ * Removes from the disk tier the keys of a just spilled object which a newer object took in memory
+ * while the spill was in progress, as the spill happens outside of the cache lock.
+ * Objects are added to memory before their keys are removed from disk, so whichever of the two runs last
+ * removes the stale copy.
+ */
+- (void) removeSupersededDiskKeys: (NSArray *) keys {
+	
+	NSMutableArray *supersededKeys = nil;
+	
+	@synchronized (_cache) {
+		for (NSString *key in keys) {
+			JFSkipIfNil([_cache objectForKey: key]);
+			
+			if (supersededKeys == nil) {
+				supersededKeys = [NSMutableArray arrayWithCapacity: [keys count]];
+			}
+			[supersededKeys addObject: key];
+		}
+	}
+	
+	if (supersededKeys != nil) {
+		[_diskTier removeObjectsWithKeys: supersededKeys];
+	}
+}
+
+/*
+ * Moves the object stored under the key from the disk tier back to the front of the cache,
+ * under every key it was stored with.
+ *
+ * Return
+ *		The promoted object, or nil if the disk tier has none under the key.
+ */
+- (id) promoteObjectWithKey: (NSString *) key {
+	
+	NSArray *keys = nil;
+	NSTimeInterval loadTime = 0.0;
+	id object = [_diskTier takeObjectWithKey: key
+										keys: &keys
+								   timestamp: &loadTime];
+	JFReturnNilIfNil(object);
+	
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
+			BOOL stored = NO;
+			for (NSString *objectKey in keys) {
+				if ([_cache objectForKey: objectKey] != nil) {
+					// Another object took this key in the meantime.
+					continue;
+				}
+				
+				[_cache setObject: object
+						   forKey: objectKey];
+				if (loadTime > 0.0) {
+					[_loadTimes setObject: [NSNumber numberWithDouble: loadTime]
+								   forKey: objectKey];
+				}
+				stored = YES;
+			}
+			
+			if (!stored) {
+				return object;
+			}
+			
+			[_popularity insertObject: object
+							  atIndex: 0];
+			
+			if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
+				if ([object respondsToSelector: @selector(wasAddedToPopularityCache:)]) {
+					[object wasAddedToPopularityCache: self];
+				}
+			}
+		}
+	}
+	
+	while ([self objectCount] > _maxCapacity) {
+		// Make room by spilling the least popular objects in turn.
+		[self removeLastObject];
+	}
+	
+	return object;
+}
+
+
+#pragma mark - Snapshot methods
+
+/*
+ * Saves the JFBoxEncodable conforming objects of the cache, most popular first, to a snapshot file.
+ * Objects which do not conform to JFBoxEncodable are left out.
+ *
+ * The snapshot is a BOX stream holding the format version, the entry count and then, per entry,
+ * the array of keys the object is stored under, the time it was loaded (0 if it was added rather than loaded)
+ * and the object itself, so loaded objects keep aging towards the loaded object lifetime once restored.
+ *
+ * Params
+ *		path		The path of the snapshot file.
+ *					Any existing file is atomically replaced.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
+- (BOOL) saveSnapshotToPath: (NSString *) path {
+	
+	if ([path length] == 0) {
+		return NO;
+	}
+	
+	NSMutableArray *objects = [NSMutableArray arrayWithCapacity: [self objectCount]];
+	NSMutableArray *keyArrays = [NSMutableArray arrayWithCapacity: [self objectCount]];
+	NSMutableArray *loadTimes = [NSMutableArray arrayWithCapacity: [self objectCount]];
+	
+	// Copy the entries under the locks and encode them after releasing them.
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
+			// Group the keys by object once rather than searching the cache for each object.
+			NSMapTable *keysByObject = [NSMapTable mapTableWithKeyOptions: NSPointerFunctionsObjectPointerPersonality
+															 valueOptions: NSPointerFunctionsStrongMemory];
+			for (NSString *key in _cache) {
+				id object = [_cache objectForKey: key];
+				NSMutableArray *keys = [keysByObject objectForKey: object];
+				if (keys == nil) {
+					keys = [NSMutableArray arrayWithCapacity: 1];
+					[keysByObject setObject: keys
+									 forKey: object];
+				}
+				[keys addObject: key];
+			}
+			
+			for (id object in _popularity) {
+				JFSkipIfNo([object conformsToProtocol: @protocol(JFBoxEncodable)]);
+				
+				NSArray *keys = [keysByObject objectForKey: object];
+				JFSkipIfNil(keys);
+				
+				// The keys of an object share its load time, if it was loaded.
+				NSNumber *loadTime = nil;
+				for (NSString *key in keys) {
+					loadTime = [_loadTimes objectForKey: key];
+					if (loadTime != nil) {
+						break;
+					}
+				}
+				
+				[objects addObject: object];
+				[keyArrays addObject: keys];
+				[loadTimes addObject: (loadTime != nil) ? loadTime : [NSNumber numberWithDouble: 0.0]];
+			}
+		}
+	}
+	
+	NSMutableData *data = [NSMutableData dataWithCapacity: [objects count] * 100];
+	JFBoxEncoder *encoder = [JFBoxEncoder boxEncoderWithData: data];
+	
+	[encoder encodeUInt16: JFPopularityCacheSnapshotFormatVersion];
+	[encoder encodeUInt64: [objects count]];
+	
+	NSUInteger entryCount = [objects count];
+	for (NSUInteger entry = 0; entry < entryCount; entry++) {
+		[encoder encodeArray: [keyArrays objectAtIndex: entry]];
+		[encoder encodeDouble: [[loadTimes objectAtIndex: entry] doubleValue]];
+		[encoder encodeBoxEncodable: [objects objectAtIndex: entry]];
+	}
+	
+	return [data writeToFile: path
+				  atomically: YES];
+}
+
+/*
+ * Loads a snapshot saved by saveSnapshotToPath: into the cache, restoring the popularity order.
+ * The file is memory mapped and decoded in a single forward pass, and the decoded entries are
+ * appended behind any objects already in the cache without re-sorting.
+ * Entries whose keys are already in use and entries beyond the max capacity are skipped.
+ * Loaded objects keep their saved load times; those of version 1 snapshots, which have none,
+ * are stamped with the time of this call so they age from now.
+ *
+ * Params
+ *		path		The path of the snapshot file.
+ *
+ * Return
+ *		YES if the snapshot was read without error, NO otherwise.
+ *		A truncated or corrupt snapshot still loads the entries before the damage,
+ *		which are the most popular ones.
+ */
+- (BOOL) loadSnapshotFromPath: (NSString *) path {
+	
+	if ([path length] == 0) {
+		return NO;
+	}
+	
+	NSData *data = [NSData dataWithContentsOfFile: path
+										  options: NSDataReadingMappedIfSafe
+											error: nil];
+	JFReturnNoIfNil(data);
+	
+	JFBoxDecoder *decoder = [JFBoxDecoder boxDecoderWithData: data];
+	JFReturnNoIfNil(decoder);
+	
+	UInt16 formatVersion = [decoder decodeUInt16WithError: nil];
+	if ([decoder encounteredError] || formatVersion < JFPopularityCacheSnapshotMinFormatVersion
+		|| formatVersion > JFPopularityCacheSnapshotFormatVersion) {
+		return NO;
+	}
+	
+	UInt64 entryCount = [decoder decodeUInt64WithError: nil];
+	if ([decoder encounteredError]) {
+		return NO;
+	}
+	
+	NSUInteger room = 0;
+	NSUInteger objectCount = [self objectCount];
+	if (_maxCapacity > objectCount) {
+		room = _maxCapacity - objectCount;
+	}
+	
+	NSUInteger decodeCount = (entryCount < room) ? (NSUInteger) entryCount : room;
+	NSMutableArray *objects = [NSMutableArray arrayWithCapacity: decodeCount];
+	NSMutableArray *keyArrays = [NSMutableArray arrayWithCapacity: decodeCount];
+	NSMutableArray *loadTimes = [NSMutableArray arrayWithCapacity: decodeCount];
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	BOOL complete = YES;
+	
+	for (NSUInteger entry = 0; entry < decodeCount; entry++) {
+		NSArray *keys = [decoder decodeArrayWithError: nil];
+		NSTimeInterval loadTime = now;
+		if (formatVersion >= 2) {
+			loadTime = [decoder decodeDoubleWithError: nil];
+		}
+		id <JFBoxEncodable> object = [decoder decodeBoxEncodableWithError: nil];
+		if ([decoder encounteredError] || object == nil) {
+			complete = NO;
+			break;
+		}
+		
+		[objects addObject: object];
+		[keyArrays addObject: keys];
+		[loadTimes addObject: [NSNumber numberWithDouble: loadTime]];
+	}
+	
+	@synchronized (_cache) {
+		@synchronized (_popularity) {
+			NSUInteger loadedCount = [objects count];
+			for (NSUInteger entry = 0; entry < loadedCount && [_cache count] < _maxCapacity; entry++) {
+				id object = [objects objectAtIndex: entry];
+				NSArray *keys = [keyArrays objectAtIndex: entry];
+				
+				// Only entries whose keys are all valid and unused are restored.
+				BOOL usable = ([keys count] > 0);
+				for (NSString *key in keys) {
+					if (![key isKindOfClass: [NSString class]] || [key length] == 0 || [_cache objectForKey: key] != nil) {
+						usable = NO;
+						break;
+					}
+				}
+				JFSkipIfNo(usable);
+				
+				NSNumber *loadTime = [loadTimes objectAtIndex: entry];
+				for (NSString *key in keys) {
+					[_cache setObject: object
+							   forKey: key];
+					if ([loadTime doubleValue] > 0.0) {
+						[_loadTimes setObject: loadTime
+									   forKey: key];
+					}
+				}
+				
+				// The snapshot is ordered most popular first so appending preserves its order.
+				[_popularity addObject: object];
+				
+				if ([object conformsToProtocol: @protocol(JFPopularityCacheable)]) {
+					if ([object respondsToSelector: @selector(wasAddedToPopularityCache:)]) {
+						[object wasAddedToPopularityCache: self];
+					}
+				}
+			}
+		}
+	}
+	
+	return complete;
+}
+
+
+#pragma mark - Statistics methods
+
+/*
+ * Enables or disables the keeping of statistics.
+ * Counters are kept (not reset) while statistics are disabled.
+ */
+- (void) setStatisticsEnabled: (BOOL) statisticsEnabled {
+	
+	@synchronized (self) {
+		if (statisticsEnabled && _statisticsStripes == NULL) {
+			/*
+			 * The stripes are allocated once and only freed with the cache
+			 * so threads which saw the enabled flag never touch freed memory.
+			 */
+			void *stripes = NULL;
+			if (posix_memalign(&stripes, 64, sizeof(JFPopularityCacheStatistics) * JFPopularityCacheStatisticsStripeCount) != 0) {
+				return;
+			}
+			memset(stripes, 0, sizeof(JFPopularityCacheStatistics) * JFPopularityCacheStatisticsStripeCount);
+			_statisticsStripes = stripes;
+		}
+		
+		__atomic_store_n(&_statisticsEnabled, statisticsEnabled, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * Returns a snapshot of the statistics summed across all stripes.
+ * The snapshot is all zeroes if statistics were never enabled.
+ */
+- (JFPopularityCacheStatistics) statistics {
+	
+	JFPopularityCacheStatistics snapshot;
+	memset(&snapshot, 0, sizeof(snapshot));
+	
+	@synchronized (self) {
+		if (_statisticsStripes == NULL) {
+			return snapshot;
+		}
+		
+		for (NSUInteger stripeIndex = 0; stripeIndex < JFPopularityCacheStatisticsStripeCount; stripeIndex++) {
+			JFPopularityCacheStatistics *stripe = &_statisticsStripes[stripeIndex];
+			
+			snapshot.hitCount += __atomic_load_n(&stripe->hitCount, __ATOMIC_RELAXED);
+			snapshot.missCount += __atomic_load_n(&stripe->missCount, __ATOMIC_RELAXED);
+			snapshot.negativeHitCount += __atomic_load_n(&stripe->negativeHitCount, __ATOMIC_RELAXED);
+			snapshot.insertCount += __atomic_load_n(&stripe->insertCount, __ATOMIC_RELAXED);
+			snapshot.evictionCount += __atomic_load_n(&stripe->evictionCount, __ATOMIC_RELAXED);
+			snapshot.removalCount += __atomic_load_n(&stripe->removalCount, __ATOMIC_RELAXED);
+			
+			for (NSUInteger bucket = 0; bucket < JFLatencyHistogramBucketCount; bucket++) {
+				snapshot.getLatencyBuckets[bucket] += __atomic_load_n(&stripe->getLatencyBuckets[bucket], __ATOMIC_RELAXED);
+				snapshot.putLatencyBuckets[bucket] += __atomic_load_n(&stripe->putLatencyBuckets[bucket], __ATOMIC_RELAXED);
+			}
+		}
+	}
+	
+	return snapshot;
+}
+
+/*
+ * Zeroes all statistics counters.
+ */
+- (void) resetStatistics {
+	
+	@synchronized (self) {
+		if (_statisticsStripes == NULL) {
+			return;
+		}
+		
+		for (NSUInteger stripeIndex = 0; stripeIndex < JFPopularityCacheStatisticsStripeCount; stripeIndex++) {
+			JFPopularityCacheStatistics *stripe = &_statisticsStripes[stripeIndex];
+			
+			__atomic_store_n(&stripe->hitCount, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&stripe->missCount, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&stripe->negativeHitCount, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&stripe->insertCount, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&stripe->evictionCount, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&stripe->removalCount, 0, __ATOMIC_RELAXED);
+			
+			for (NSUInteger bucket = 0; bucket < JFLatencyHistogramBucketCount; bucket++) {
+				__atomic_store_n(&stripe->getLatencyBuckets[bucket], 0, __ATOMIC_RELAXED);
+				__atomic_store_n(&stripe->putLatencyBuckets[bucket], 0, __ATOMIC_RELAXED);
+			}
+		}
+	}
+}
+
+@end
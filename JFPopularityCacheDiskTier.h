@@ -0,0 +1,106 @@
+//
+//  JFPopularityCacheDiskTier.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFBoxEncodable.h"
+
+
+// The default byte size at which the active segment file is sealed and a new one started.
+#define JFPopularityCacheDiskTierDefaultSegmentByteLimit		(4 * 1024 * 1024)
+
+// The default fraction of dead bytes at which a sealed segment is compacted.
+#define JFPopularityCacheDiskTierDefaultCompactionThreshold		0.5
+
+
+/*
+ * The disk tier of a popularity cache.
+ * Objects evicted from the rear of a JFPopularityCache are BOX encoded and appended to
+ * memory mapped segment files, and found again through an in-memory key index.
+ *
+ * Segments are only ever appended to.  Removed and promoted objects leave dead bytes behind,
+ * which a background compaction reclaims by moving the live records of mostly dead segments
+ * into the active one.  When the tier exceeds its byte budget the oldest segments are dropped.
+ *
+ * Usage Example:
+ * JFPopularityCacheDiskTier *diskTier = [[JFPopularityCacheDiskTier alloc] initWithDirectoryPath: path
+ *                                                                                   byteBudget: 256 * 1024 * 1024];
+ * [popularityCache setDiskTier: diskTier];
+ */
+@interface JFPopularityCacheDiskTier : NSObject {
+	
+@private
+	// The directory holding the segment files.
+	NSString *_directoryPath;
+	
+	// The maximum number of bytes all segment files may occupy.
+	UInt64 _byteBudget;
+	
+	// The byte size at which the active segment is sealed (clamped to the byte budget).
+	UInt64 _segmentByteLimit;
+	
+	// The dead byte fraction at which a sealed segment is compacted.
+	double _compactionThreshold;
+	
+	// The segments, oldest first.  The last one is the active segment.
+	NSMutableArray *_segments;
+	
+	// The live records keyed by each of their keys.
+	NSMutableDictionary *_index;
+	
+	// The number of bytes all segment files occupy.
+	UInt64 _byteCount;
+	
+	// The number used to name the next segment file.
+	NSUInteger _nextSegmentNumber;
+	
+	// The serial queue on which compaction runs.
+	dispatch_queue_t _compactionQueue;
+	
+	// The flag denoting whether a compaction is already queued.
+	BOOL _compactionScheduled;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) NSString *directoryPath;
+@property (nonatomic, readonly) UInt64 byteBudget;
+@property (nonatomic, assign) UInt64 segmentByteLimit;
+@property (nonatomic, assign) double compactionThreshold;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithDirectoryPath: (NSString *) directoryPath byteBudget: (UInt64) byteBudget;
+
+
+#pragma mark - Methods
+
+- (NSUInteger) objectCount;
+- (UInt64) byteCount;
+- (BOOL) containsObjectWithKey: (NSString *) key;
+- (BOOL) storeObject: (id <JFBoxEncodable>) object withKeys: (NSArray *) keys timestamp: (NSTimeInterval) timestamp;
+- (id <JFBoxEncodable>) takeObjectWithKey: (NSString *) key keys: (NSArray **) keys timestamp: (NSTimeInterval *) timestamp;
+- (void) removeObjectWithKey: (NSString *) key;
+- (void) removeObjectsWithKeys: (NSArray *) keys;
+- (void) clear;
+- (void) compact;
+
+@end
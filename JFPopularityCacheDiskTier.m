@@ -0,0 +1,710 @@
+//
+//  JFPopularityCacheDiskTier.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFPopularityCacheDiskTier.h"
+
+#import <fcntl.h>
+#import <sys/mman.h>
+#import <unistd.h>
+
+#import "JFBoxEncoder.h"
+#import "JFBoxDecoder.h"
+#import "JFMacros.h"
+
+
+// The file extension of segment files.
+#define JFPopularityCacheDiskTierSegmentExtension		@"segment"
+
+
+@class JFPopularityCacheDiskSegment;
+
+
+/*
+ * A record in a segment file.
+ * Each record is a UInt64 byte length followed by a BOX stream holding the array of keys and the object.
+ */
+@interface JFPopularityCacheDiskRecord : NSObject {
+
+@public
+	// The segment holding the record (not retained, the segment owns its records).
+	JFPopularityCacheDiskSegment *_segment;
+
+	// The offset of the record within the segment file.
+	UInt64 _offset;
+
+	// The byte length of the record including its length prefix.
+	UInt64 _length;
+
+	// The keys the object is stored under.
+	NSArray *_keys;
+
+	// The caller's timestamp for the object, kept in memory only.
+	NSTimeInterval _timestamp;
+}
+
+@end
+
+
+@implementation JFPopularityCacheDiskRecord
+
+#if  __has_feature(objc_arc)
+
+#else
+
+- (void) dealloc {
+
+	[_keys release];
+	[super dealloc];
+}
+
+#endif
+
+@end
+
+
+/*
+ * An append-only segment file, read through a memory mapping.
+ */
+@interface JFPopularityCacheDiskSegment : NSObject {
+
+@public
+	// The path of the segment file.
+	NSString *_path;
+
+	// The descriptor of the open segment file.
+	int _fileDescriptor;
+
+	// The number of bytes written to the segment file.
+	UInt64 _length;
+
+	// The number of bytes belonging to live records.
+	UInt64 _liveByteCount;
+
+	// The live records of the segment.
+	NSMutableSet *_records;
+
+	// The read-only mapping of the segment file.
+	void *_mappedBytes;
+
+	// The length of the mapping, which may trail the file length until the next read.
+	size_t _mappedLength;
+}
+
+- (id) initWithPath: (NSString *) path;
+- (BOOL) appendBytes: (const void *) bytes length: (UInt64) length atOffset: (UInt64 *) offset;
+- (const void *) bytesAtOffset: (UInt64) offset length: (UInt64) length;
+- (void) destroy;
+
+@end
+
+
+@implementation JFPopularityCacheDiskSegment
+
+- (id) initWithPath: (NSString *) path {
+
+	self = [super init];
+	if (self != nil) {
+		_fileDescriptor = open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (_fileDescriptor < 0) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+
+		_path = [path copy];
+		_records = [[NSMutableSet alloc] init];
+		_mappedBytes = MAP_FAILED;
+	}
+
+	return self;
+}
+
+- (void) dealloc {
+
+	if (_mappedBytes != MAP_FAILED) {
+		munmap(_mappedBytes, _mappedLength);
+	}
+
+	if (_fileDescriptor >= 0) {
+		close(_fileDescriptor);
+	}
+
+#if !__has_feature(objc_arc) // NON ARC
+	[_path release];
+	[_records release];
+	[super dealloc];
+#endif
+}
+
+/*
+ * Appends the bytes to the end of the segment file.
+ *
+ * Return
+ *		YES if all bytes were written, NO otherwise.
+ */
+- (BOOL) appendBytes: (const void *) bytes length: (UInt64) length atOffset: (UInt64 *) offset {
+
+	UInt64 written = 0;
+	while (written < length) {
+		ssize_t result = pwrite(_fileDescriptor, (const char *) bytes + written, (size_t) (length - written), (off_t) (_length + written));
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return NO;
+		}
+
+		written += result;
+	}
+
+	*offset = _length;
+	_length += length;
+
+	return YES;
+}
+
+/*
+ * Returns the bytes of the segment file at the offset, extending the mapping if the file has grown past it.
+ * The bytes are only valid until the next call.
+ */
+- (const void *) bytesAtOffset: (UInt64) offset length: (UInt64) length {
+
+	if (offset + length > _length) {
+		return NULL;
+	}
+
+	if (_mappedBytes == MAP_FAILED || offset + length > _mappedLength) {
+		if (_mappedBytes != MAP_FAILED) {
+			munmap(_mappedBytes, _mappedLength);
+		}
+
+		_mappedLength = (size_t) _length;
+		_mappedBytes = mmap(NULL, _mappedLength, PROT_READ, MAP_SHARED, _fileDescriptor, 0);
+		if (_mappedBytes == MAP_FAILED) {
+			return NULL;
+		}
+	}
+
+	return (const char *) _mappedBytes + offset;
+}
+
+/*
+ * Closes and deletes the segment file.
+ */
+- (void) destroy {
+
+	if (_mappedBytes != MAP_FAILED) {
+		munmap(_mappedBytes, _mappedLength);
+		_mappedBytes = MAP_FAILED;
+	}
+
+	if (_fileDescriptor >= 0) {
+		close(_fileDescriptor);
+		_fileDescriptor = -1;
+	}
+
+	unlink([_path fileSystemRepresentation]);
+	[_records removeAllObjects];
+}
+
+@end
+
+
+@implementation JFPopularityCacheDiskTier
+
+
+#pragma mark - Properties
+
+@synthesize directoryPath = _directoryPath;
+@synthesize byteBudget = _byteBudget;
+@synthesize segmentByteLimit = _segmentByteLimit;
+@synthesize compactionThreshold = _compactionThreshold;
+
+
+#pragma mark - Object lifecycle methods
+
+/*
+ * Initializes the disk tier.
+ * Segment files left in the directory by a previous tier are deleted since their index is gone.
+ *
+ * Params
+ *		directoryPath	The directory in which to keep the segment files.
+ *						It is created if it does not exist.
+ *		byteBudget		The maximum number of bytes the segment files may occupy.
+ *						Must be greater than 0.
+ *
+ * Return
+ *		The instance, or nil if the directory could not be used.
+ */
+- (id) initWithDirectoryPath: (NSString *) directoryPath byteBudget: (UInt64) byteBudget {
+
+	if ([directoryPath length] == 0 || byteBudget == 0) {
+#if !__has_feature(objc_arc) // NON ARC
+		[self release];
+#endif
+		return nil;
+	}
+
+	self = [super init];
+	if (self != nil) {
+		NSFileManager *fileManager = [NSFileManager defaultManager];
+		if (![fileManager createDirectoryAtPath: directoryPath
+					withIntermediateDirectories: YES
+									 attributes: nil
+										  error: nil]) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+
+		for (NSString *fileName in [fileManager contentsOfDirectoryAtPath: directoryPath error: nil]) {
+			JFSkipIfNo([[fileName pathExtension] isEqualToString: JFPopularityCacheDiskTierSegmentExtension]);
+
+			[fileManager removeItemAtPath: [directoryPath stringByAppendingPathComponent: fileName]
+									error: nil];
+		}
+
+		_directoryPath = [directoryPath copy];
+		_byteBudget = byteBudget;
+		_segmentByteLimit = JFPopularityCacheDiskTierDefaultSegmentByteLimit;
+		_compactionThreshold = JFPopularityCacheDiskTierDefaultCompactionThreshold;
+		_segments = [[NSMutableArray alloc] init];
+		_index = [[NSMutableDictionary alloc] init];
+		_compactionQueue = dispatch_queue_create("JFPopularityCacheDiskTier.compaction", DISPATCH_QUEUE_SERIAL);
+	}
+
+	return self;
+}
+
+- (void) dealloc {
+
+	for (JFPopularityCacheDiskSegment *segment in _segments) {
+		[segment destroy];
+	}
+
+#if !__has_feature(objc_arc) // NON ARC
+	[_directoryPath release];
+	[_segments release];
+	[_index release];
+	dispatch_release(_compactionQueue);
+	[super dealloc];
+#endif
+}
+
+
+#pragma mark - Methods
+
+- (NSUInteger) objectCount {
+
+	NSUInteger count = 0;
+	@synchronized (self) {
+		for (JFPopularityCacheDiskSegment *segment in _segments) {
+			count += [segment->_records count];
+		}
+	}
+
+	return count;
+}
+
+- (UInt64) byteCount {
+
+	UInt64 byteCount;
+	@synchronized (self) {
+		byteCount = _byteCount;
+	}
+
+	return byteCount;
+}
+
+- (BOOL) containsObjectWithKey: (NSString *) key {
+
+	if ([key length] == 0) {
+		return NO;
+	}
+
+	BOOL contained;
+	@synchronized (self) {
+		contained = ([_index objectForKey: key] != nil);
+	}
+
+	return contained;
+}
+
+/*
+ * Encodes the object and appends it to the active segment, replacing any object already stored under its keys.
+ * The oldest segments are dropped if the tier goes over its byte budget.
+ *
+ * Params
+ *		object		The object to store.
+ *					Must not be nil.
+ *		keys		The keys the object is stored under.
+ *					Must not be empty.
+ *		timestamp	A timestamp handed back when the object is taken (such as the time it was loaded).
+ *
+ * Return
+ *		YES if the object was stored, NO otherwise.
+ */
+- (BOOL) storeObject: (id <JFBoxEncodable>) object withKeys: (NSArray *) keys timestamp: (NSTimeInterval) timestamp {
+
+	JFReturnNoIfNil(object);
+	if ([keys count] == 0) {
+		return NO;
+	}
+
+	// Encode outside of the lock, leaving room for the length prefix.
+	UInt64 length = 0;
+	NSMutableData *data = [NSMutableData dataWithBytes: &length
+												length: sizeof(UInt64)];
+	JFBoxEncoder *encoder = [JFBoxEncoder boxEncoderWithData: data];
+	[encoder encodeArray: keys];
+	[encoder encodeBoxEncodable: object];
+
+	length = [data length];
+	[data replaceBytesInRange: NSMakeRange(0, sizeof(UInt64))
+					withBytes: &length];
+
+	if (length > _byteBudget) {
+		return NO;
+	}
+
+	@synchronized (self) {
+		for (NSString *key in keys) {
+			[self killRecord: [_index objectForKey: key]];
+		}
+
+		if (![self appendRecordBytes: [data bytes]
+							  length: length
+							withKeys: keys
+						   timestamp: timestamp]) {
+			return NO;
+		}
+
+		[self enforceByteBudget];
+	}
+
+	return YES;
+}
+
+/*
+ * Removes the object stored under the key from the tier and returns it, typically to promote it back into memory.
+ *
+ * Params
+ *		key			The key of the object.
+ *		keys		Receives every key the object was stored under.
+ *					May be NULL.
+ *		timestamp	Receives the timestamp the object was stored with.
+ *					May be NULL.
+ *
+ * Return
+ *		The decoded object, or nil if none is stored under the key.
+ */
+- (id <JFBoxEncodable>) takeObjectWithKey: (NSString *) key keys: (NSArray **) keys timestamp: (NSTimeInterval *) timestamp {
+
+	if ([key length] == 0) {
+		return nil;
+	}
+
+	id <JFBoxEncodable> object = nil;
+	NSArray *recordKeys = nil;
+	NSTimeInterval recordTimestamp = 0.0;
+
+	@synchronized (self) {
+		JFPopularityCacheDiskRecord *record = [_index objectForKey: key];
+		JFReturnNilIfNil(record);
+
+		const void *bytes = [record->_segment bytesAtOffset: record->_offset
+													 length: record->_length];
+		if (bytes != NULL) {
+			/*
+			 * The decoder reads straight from the mapping and copies everything it returns,
+			 * so nothing refers to the mapping once the lock is released.
+			 */
+			NSData *data = [NSData dataWithBytesNoCopy: (void *) ((const char *) bytes + sizeof(UInt64))
+												length: (NSUInteger) (record->_length - sizeof(UInt64))
+										  freeWhenDone: NO];
+			JFBoxDecoder *decoder = [JFBoxDecoder boxDecoderWithData: data];
+			[decoder decodeArrayWithError: nil];
+			object = [decoder decodeBoxEncodableWithError: nil];
+			if ([decoder encounteredError]) {
+				object = nil;
+			}
+		}
+
+		recordKeys = record->_keys;
+		recordTimestamp = record->_timestamp;
+#if !__has_feature(objc_arc) // NON ARC
+		[[recordKeys retain] autorelease];
+#endif
+		[self killRecord: record];
+	}
+
+	if (keys != NULL) {
+		*keys = (object != nil) ? recordKeys : nil;
+	}
+
+	if (timestamp != NULL) {
+		*timestamp = recordTimestamp;
+	}
+
+	return object;
+}
+
+/*
+ * Forgets the object stored under the key, if any.
+ */
+- (void) removeObjectWithKey: (NSString *) key {
+
+	if ([key length] == 0) {
+		return;
+	}
+
+	@synchronized (self) {
+		[self killRecord: [_index objectForKey: key]];
+	}
+}
+
+/*
+ * Forgets the objects stored under the keys, taking the lock once.
+ */
+- (void) removeObjectsWithKeys: (NSArray *) keys {
+
+	JFReturnIfEmptyArray(keys);
+
+	@synchronized (self) {
+		for (NSString *key in keys) {
+			[self killRecord: [_index objectForKey: key]];
+		}
+	}
+}
+
+/*
+ * Forgets every object and deletes every segment file.
+ */
+- (void) clear {
+
+	@synchronized (self) {
+		for (JFPopularityCacheDiskSegment *segment in _segments) {
+			[segment destroy];
+		}
+
+		[_segments removeAllObjects];
+		[_index removeAllObjects];
+		_byteCount = 0;
+	}
+}
+
+/*
+ * Moves the live records of every sealed segment whose dead byte fraction reached the compaction threshold
+ * into the active segment and deletes the emptied segment files.
+ * Normally run on the background compaction queue, one segment per lock acquisition.
+ */
+- (void) compact {
+
+	while (YES) {
+		@synchronized (self) {
+			_compactionScheduled = NO;
+
+			JFPopularityCacheDiskSegment *victim = nil;
+			NSUInteger sealedCount = ([_segments count] > 0) ? [_segments count] - 1 : 0;
+			for (NSUInteger segmentIndex = 0; segmentIndex < sealedCount; segmentIndex++) {
+				JFPopularityCacheDiskSegment *segment = [_segments objectAtIndex: segmentIndex];
+				if ([self segmentNeedsCompaction: segment]) {
+					victim = segment;
+					break;
+				}
+			}
+
+			if (victim == nil) {
+				return;
+			}
+
+			for (JFPopularityCacheDiskRecord *record in [victim->_records allObjects]) {
+				const void *bytes = [victim bytesAtOffset: record->_offset
+												   length: record->_length];
+
+				// Copy the record since appending may remap the victim's file.
+				NSData *data = (bytes != NULL) ? [NSData dataWithBytes: bytes length: (NSUInteger) record->_length] : nil;
+				NSArray *keys = record->_keys;
+				NSTimeInterval timestamp = record->_timestamp;
+#if !__has_feature(objc_arc) // NON ARC
+				[[keys retain] autorelease];
+#endif
+				[self killRecord: record];
+
+				if (data != nil) {
+					[self appendRecordBytes: [data bytes]
+									 length: [data length]
+								   withKeys: keys
+								  timestamp: timestamp];
+				}
+			}
+
+			[self dropSegment: victim];
+			
+			// The moved records may have taken the tier over its budget.
+			[self enforceByteBudget];
+		}
+	}
+}
+
+
+#pragma mark - Private methods
+
+/*
+ * Appends an encoded record to the active segment, starting a new segment if the active one is full,
+ * and indexes the record under its keys.
+ * The segment byte limit is clamped to the byte budget so the active segment alone never exceeds it.
+ * Must be called while holding the lock.
+ */
+- (BOOL) appendRecordBytes: (const void *) bytes length: (UInt64) length withKeys: (NSArray *) keys timestamp: (NSTimeInterval) timestamp {
+
+	if (length > _byteBudget) {
+		return NO;
+	}
+
+	UInt64 segmentByteLimit = MIN(_segmentByteLimit, _byteBudget);
+	JFPopularityCacheDiskSegment *segment = [_segments lastObject];
+	if (segment == nil || (segment->_length > 0 && segment->_length + length > segmentByteLimit)) {
+		NSString *fileName = [NSString stringWithFormat: @"%08lu.%@", (unsigned long) _nextSegmentNumber++, JFPopularityCacheDiskTierSegmentExtension];
+		segment = [[JFPopularityCacheDiskSegment alloc] initWithPath: [_directoryPath stringByAppendingPathComponent: fileName]];
+		JFReturnNoIfNil(segment);
+
+		[_segments addObject: segment];
+#if !__has_feature(objc_arc) // NON ARC
+		[segment release];
+#endif
+	}
+
+	UInt64 offset;
+	if (![segment appendBytes: bytes
+					   length: length
+					 atOffset: &offset]) {
+		return NO;
+	}
+
+	JFPopularityCacheDiskRecord *record = [[JFPopularityCacheDiskRecord alloc] init];
+	record->_segment = segment;
+	record->_offset = offset;
+	record->_length = length;
+	record->_keys = [keys copy];
+	record->_timestamp = timestamp;
+
+	[segment->_records addObject: record];
+	segment->_liveByteCount += length;
+	_byteCount += length;
+
+	for (NSString *key in keys) {
+		[_index setObject: record
+				   forKey: key];
+	}
+
+#if !__has_feature(objc_arc) // NON ARC
+	[record release];
+#endif
+
+	return YES;
+}
+
+/*
+ * Unindexes the record, leaving its bytes dead in its segment, and schedules a compaction if warranted.
+ * Must be called while holding the lock.
+ */
+- (void) killRecord: (JFPopularityCacheDiskRecord *) record {
+
+	JFReturnIfNil(record);
+
+	for (NSString *key in record->_keys) {
+		if ([_index objectForKey: key] == record) {
+			[_index removeObjectForKey: key];
+		}
+	}
+
+	JFPopularityCacheDiskSegment *segment = record->_segment;
+	segment->_liveByteCount -= record->_length;
+	[segment->_records removeObject: record];
+
+	if (segment != [_segments lastObject] && [self segmentNeedsCompaction: segment]) {
+		[self scheduleCompaction];
+	}
+}
+
+/*
+ * Returns YES if enough of the segment is dead to be worth compacting.
+ */
+- (BOOL) segmentNeedsCompaction: (JFPopularityCacheDiskSegment *) segment {
+
+	if (segment->_length == 0) {
+		return NO;
+	}
+
+	double deadFraction = (double) (segment->_length - segment->_liveByteCount) / (double) segment->_length;
+
+	return deadFraction >= _compactionThreshold;
+}
+
+/*
+ * Queues a compaction on the background queue unless one is already queued.
+ * Must be called while holding the lock.
+ */
+- (void) scheduleCompaction {
+
+	JFReturnIfYes(_compactionScheduled);
+	_compactionScheduled = YES;
+
+	dispatch_async(_compactionQueue, ^{
+		[self compact];
+	});
+}
+
+/*
+ * Drops the oldest segments, and the objects in them, until the tier is within its byte budget.
+ * The active segment is dropped as well if it alone exceeds the budget;
+ * the next record then starts a new one.
+ * Must be called while holding the lock.
+ */
+- (void) enforceByteBudget {
+
+	while (_byteCount > _byteBudget && [_segments count] > 0) {
+		[self dropSegment: [_segments objectAtIndex: 0]];
+	}
+}
+
+/*
+ * Unindexes the remaining records of the segment and deletes its file.
+ * Must be called while holding the lock.
+ */
+- (void) dropSegment: (JFPopularityCacheDiskSegment *) segment {
+
+	for (JFPopularityCacheDiskRecord *record in [segment->_records allObjects]) {
+		for (NSString *key in record->_keys) {
+			if ([_index objectForKey: key] == record) {
+				[_index removeObjectForKey: key];
+			}
+		}
+	}
+
+	_byteCount -= segment->_length;
+	[segment destroy];
+	[_segments removeObjectIdenticalTo: segment];
+}
+
+@end
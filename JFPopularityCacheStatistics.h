@@ -0,0 +1,63 @@
+//
+//  JFPopularityCacheStatistics.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFLatencyHistogram.h"
+
+
+/*
+ * The number of independently updated counter stripes a popularity cache keeps.
+ * Each thread updates a single stripe so concurrent threads rarely contend on a cache line.
+ */
+#define JFPopularityCacheStatisticsStripeCount		16
+
+
+/*
+ * The statistics of a popularity cache.
+ * The same structure is used for the per-stripe counters and for the snapshot summing them.
+ * Latency buckets are described in JFLatencyHistogram.h.
+ */
+typedef struct {
+	
+	// Lookups answered by the cache.
+	UInt64 hitCount;
+	
+	// Lookups not answered by the cache.
+	UInt64 missCount;
+	
+	// Read-through lookups answered by a remembered nil loader result (counted as neither hits nor misses).
+	UInt64 negativeHitCount;
+	
+	// Objects newly added to the cache.
+	UInt64 insertCount;
+	
+	// Objects which fell out of the rear of the cache.
+	UInt64 evictionCount;
+	
+	// Objects removed by key.
+	UInt64 removalCount;
+	
+	// The lookup latencies.
+	UInt64 getLatencyBuckets[JFLatencyHistogramBucketCount];
+	
+	// The addition latencies, including any resulting eviction.
+	UInt64 putLatencyBuckets[JFLatencyHistogramBucketCount];
+	
+} __attribute__((aligned(64))) JFPopularityCacheStatistics;
@@ -26,12 +26,19 @@
 
 /*
  * Utility class for generating random data.
+ * All of it is cryptographically secure and ranges are sampled without modulo bias.
+ * Small draws are served from a per-thread buffer of operating system randomness, which a fork discards.
  */
 @interface JFRandom : NSObject
 
 + (BOOL) generateNumberBetweenLow: (NSInteger) low andHigh: (NSInteger) high intoReceiver: (NSInteger *) receiver;
++ (BOOL) generateNumbers: (NSInteger[]) numbers count: (NSUInteger) count betweenLow: (NSInteger) low andHigh: (NSInteger) high;
++ (BOOL) generateRandomBytes: (void *) bytes length: (NSUInteger) length;
 + (BOOL) generateNumberSequenceOfLength: (NSUInteger) length into: (NSInteger[]) sequence betweenLow: (NSInteger) low andHigh: (NSInteger) high withOnlyUniqueValues: (BOOL) onlyUniqueValues;
 + (BOOL) chooseNumberFromSequence: (NSInteger[]) sequence ofLength: (NSUInteger) length intoReceiver: (NSInteger *) receiver;
++ (BOOL) shuffleNumbers: (NSInteger[]) numbers count: (NSUInteger) count;
++ (BOOL) shuffleElements: (void *) elements count: (NSUInteger) count size: (size_t) elementSize;
++ (BOOL) shuffleArray: (NSMutableArray *) array;
 + (BOOL) isNumber: (NSInteger) number inSequence: (NSInteger[]) sequence ofLength: (NSUInteger) length;
 + (NSData *) generateRandomSignedDataOfLength: (NSUInteger) length;
 + (NSData *) generateRandomDataOfLength: (NSUInteger) length;
@@ -40,4 +47,6 @@
 
 + (NSDate *) generateRandomDateBetweenDaysAgo: (NSInteger)daysAgo andDaysFromNow: (NSInteger)daysFromNow;
 
++ (NSDictionary *) benchmarkUniqueSequencesOfLength: (NSUInteger) length;
+
 @end
\ No newline at end of file
@@ -22,6 +22,367 @@
 
 #import "JFRandom.h"
 
+#import "JFLatencyHistogram.h"
+#import "JFMacros.h"
+
+#import <errno.h>
+#import <pthread.h>
+#import <stdlib.h>
+#import <string.h>
+#if defined(__linux__)
+#import <sys/random.h>
+#endif
+
+
+// The size of the buffer each thread draws small amounts of random bytes from.
+// Requests at least this large bypass it.
+#define JFRandomThreadBufferLength		1024
+
+// The number of random words drawn at once by shuffles and unique sequences.
+#define JFRandomWordBatchLength			256
+
+// Unique sequences from a range at most this many times their length are drawn by shuffling the whole range,
+// wider ranges by Floyd's algorithm.
+#define JFRandomShuffledRangeFactor		2
+
+// The marker of an empty slot in the set of values Floyd's algorithm has drawn.
+#define JFRandomEmptySlot				NSUIntegerMax
+
+// The time each length/range ratio is benchmarked for, in seconds.
+#define JFRandomBenchmarkDuration		0.25
+
+#if __LP64__
+typedef unsigned __int128 JFRandomWideWord;
+#define JFRandomHashMultiplier			0x9e3779b97f4a7c15UL
+#else
+typedef UInt64 JFRandomWideWord;
+#define JFRandomHashMultiplier			0x9e3779b9U
+#endif
+
+
+/*
+ * Random words drawn in bulk and handed out one at a time.
+ * Initialize it with JFRandomWordBatchInit.
+ */
+typedef struct {
+	
+	NSUInteger words[JFRandomWordBatchLength];
+	NSUInteger position;
+	
+} JFRandomWordBatch;
+
+
+// The random bytes not yet handed out by the current thread, starting at the position.
+static __thread UInt8 JFRandomThreadBuffer[JFRandomThreadBufferLength];
+static __thread NSUInteger JFRandomThreadBufferPosition = JFRandomThreadBufferLength;
+
+// The fork generation the current thread's buffer was filled in, 0 until first filled.
+static __thread NSUInteger JFRandomThreadBufferGeneration = 0;
+
+// Incremented in the child of every fork, so neither process hands out bytes the other already has.
+static NSUInteger JFRandomForkGeneration = 1;
+static pthread_once_t JFRandomForkHandlerOnce = PTHREAD_ONCE_INIT;
+
+
+static void JFRandomForkChildHandler(void) {
+	
+	__atomic_fetch_add(&JFRandomForkGeneration, 1, __ATOMIC_RELAXED);
+}
+
+static void JFRandomRegisterForkHandler(void) {
+	
+	pthread_atfork(NULL, NULL, JFRandomForkChildHandler);
+}
+
+/*
+ * Fills the bytes from the operating system's CSPRNG:
+ * getrandom(2) on Linux and arc4random_buf(3) (a kernel-seeded ChaCha20 DRBG) elsewhere.
+ */
+static void JFRandomFill(void *bytes, size_t length) {
+	
+#if defined(__linux__)
+	UInt8 *position = bytes;
+	
+	while (length > 0) {
+		ssize_t filledLength = getrandom(position, length, 0);
+		
+		if (filledLength < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			
+			// Carrying on with predictable bytes is never an option.
+			abort();
+		}
+		
+		position += filledLength;
+		length -= (size_t) filledLength;
+	}
+#else
+	arc4random_buf(bytes, length);
+#endif
+}
+
+/*
+ * Fills the bytes with cryptographically secure random bytes.
+ * Small requests are served from a per-thread buffer, so they cost a copy rather than a system call or a lock.
+ * Bytes are wiped from the buffer as they are handed out and the buffer is discarded after a fork.
+ */
+static void JFRandomBytes(void *bytes, size_t length) {
+	
+	NSUInteger forkGeneration = __atomic_load_n(&JFRandomForkGeneration, __ATOMIC_RELAXED);
+	
+	if (JFRandomThreadBufferGeneration != forkGeneration) {
+		if (JFRandomThreadBufferGeneration == 0) {
+			pthread_once(&JFRandomForkHandlerOnce, JFRandomRegisterForkHandler);
+			forkGeneration = __atomic_load_n(&JFRandomForkGeneration, __ATOMIC_RELAXED);
+		}
+		
+		memset(JFRandomThreadBuffer, 0, sizeof(JFRandomThreadBuffer));
+		JFRandomThreadBufferPosition = JFRandomThreadBufferLength;
+		JFRandomThreadBufferGeneration = forkGeneration;
+	}
+	
+	if (length >= JFRandomThreadBufferLength) {
+		JFRandomFill(bytes, length);
+		return;
+	}
+	
+	UInt8 *output = bytes;
+	
+	while (length > 0) {
+		if (JFRandomThreadBufferPosition == JFRandomThreadBufferLength) {
+			JFRandomFill(JFRandomThreadBuffer, JFRandomThreadBufferLength);
+			JFRandomThreadBufferPosition = 0;
+		}
+		
+		size_t copyLength = MIN(length, JFRandomThreadBufferLength - JFRandomThreadBufferPosition);
+		memcpy(output, JFRandomThreadBuffer + JFRandomThreadBufferPosition, copyLength);
+		memset(JFRandomThreadBuffer + JFRandomThreadBufferPosition, 0, copyLength);
+		
+		JFRandomThreadBufferPosition += copyLength;
+		output += copyLength;
+		length -= copyLength;
+	}
+}
+
+static inline NSUInteger JFRandomWord(void) {
+	
+	NSUInteger word;
+	JFRandomBytes(&word, sizeof(word));
+	
+	return word;
+}
+
+/*
+ * Maps the random word onto [0, range) without bias (Lemire's nearly divisionless method),
+ * drawing another word only in the rare case the first one falls in the biased remainder.
+ * A range of 0 stands for the full width of NSUInteger.
+ */
+static inline NSUInteger JFRandomUniformFromWord(NSUInteger word, NSUInteger range) {
+	
+	if (range == 0) {
+		return word;
+	}
+	
+	JFRandomWideWord product = (JFRandomWideWord) word * range;
+	NSUInteger low = (NSUInteger) product;
+	
+	if (low < range) {
+		NSUInteger threshold = (0 - range) % range;
+		
+		while (low < threshold) {
+			product = (JFRandomWideWord) JFRandomWord() * range;
+			low = (NSUInteger) product;
+		}
+	}
+	
+	return (NSUInteger) (product >> (sizeof(NSUInteger) * 8));
+}
+
+/*
+ * Returns a random number in [0, range), or any number if range is 0.
+ */
+static inline NSUInteger JFRandomUniform(NSUInteger range) {
+	
+	return JFRandomUniformFromWord(JFRandomWord(), range);
+}
+
+/*
+ * Fills the numbers with random values between low and high (inclusive), which must be ordered.
+ * The random words are drawn in bulk straight into the numbers, then each is reduced in place.
+ */
+static void JFRandomFillNumbers(NSInteger *numbers, NSUInteger count, NSInteger low, NSInteger high) {
+	
+	NSUInteger range = (NSUInteger) high - (NSUInteger) low + 1;
+	
+	JFRandomBytes(numbers, sizeof(NSInteger) * count);
+	
+	for (NSUInteger index = 0; index < count; index++) {
+		numbers[index] = (NSInteger) ((NSUInteger) low + JFRandomUniformFromWord((NSUInteger) numbers[index], range));
+	}
+}
+
+
+static inline void JFRandomWordBatchInit(JFRandomWordBatch *batch) {
+	
+	batch->position = JFRandomWordBatchLength;
+}
+
+/*
+ * Returns a random number in [0, range), or any number if range is 0, from the batch.
+ */
+static inline NSUInteger JFRandomWordBatchUniform(JFRandomWordBatch *batch, NSUInteger range) {
+	
+	if (batch->position == JFRandomWordBatchLength) {
+		JFRandomBytes(batch->words, sizeof(batch->words));
+		batch->position = 0;
+	}
+	
+	return JFRandomUniformFromWord(batch->words[batch->position++], range);
+}
+
+/*
+ * Shuffles the numbers in place (Fisher-Yates), every order being equally likely.
+ */
+static void JFRandomShuffleNumbers(NSInteger *numbers, NSUInteger count) {
+	
+	JFRandomWordBatch batch;
+	JFRandomWordBatchInit(&batch);
+	
+	for (NSUInteger index = count; index > 1; index--) {
+		NSUInteger otherIndex = JFRandomWordBatchUniform(&batch, index);
+		NSInteger number = numbers[index - 1];
+		numbers[index - 1] = numbers[otherIndex];
+		numbers[otherIndex] = number;
+	}
+}
+
+/*
+ * Fills the sequence with distinct values between low and low + range - 1 by shuffling only the first
+ * 'length' positions of the whole range (a partial Fisher-Yates shuffle).
+ * Takes O(range) time and memory, so it suits ranges not much wider than the sequence.
+ *
+ * Return
+ *		YES if successful, NO if memory ran out.
+ */
+static BOOL JFRandomFillUniqueNumbersByShuffling(NSInteger *sequence, NSUInteger length, NSInteger low, NSUInteger range) {
+	
+	NSUInteger *values = malloc(sizeof(NSUInteger) * range);
+	if (values == NULL) {
+		return NO;
+	}
+	
+	for (NSUInteger index = 0; index < range; index++) {
+		values[index] = index;
+	}
+	
+	JFRandomWordBatch batch;
+	JFRandomWordBatchInit(&batch);
+	
+	for (NSUInteger index = 0; index < length; index++) {
+		NSUInteger otherIndex = index + JFRandomWordBatchUniform(&batch, range - index);
+		NSUInteger value = values[otherIndex];
+		values[otherIndex] = values[index];
+		sequence[index] = (NSInteger) ((NSUInteger) low + value);
+	}
+	
+	free(values);
+	
+	return YES;
+}
+
+/*
+ * Adds the value to the open addressing set, returning NO if it was already there.
+ * The empty slot marker itself is tracked by a flag.
+ */
+static inline BOOL JFRandomSetAdd(NSUInteger *slots, NSUInteger mask, NSUInteger shift, BOOL *containsEmptySlotMarker, NSUInteger value) {
+	
+	if (value == JFRandomEmptySlot) {
+		BOOL added = !*containsEmptySlotMarker;
+		*containsEmptySlotMarker = YES;
+		return added;
+	}
+	
+	NSUInteger slot = (value * JFRandomHashMultiplier) >> shift;
+	
+	while (slots[slot] != JFRandomEmptySlot) {
+		if (slots[slot] == value) {
+			return NO;
+		}
+		
+		slot = (slot + 1) & mask;
+	}
+	
+	slots[slot] = value;
+	return YES;
+}
+
+/*
+ * Fills the sequence with distinct values between low and low + range - 1 (range 0 being the full width)
+ * using Floyd's algorithm, which draws exactly one random number per value,
+ * then shuffles them, as Floyd's algorithm leaves them in a biased order.
+ * Takes O(length) time and memory whatever the range.
+ *
+ * Return
+ *		YES if successful, NO if memory ran out.
+ */
+static BOOL JFRandomFillUniqueNumbersBySampling(NSInteger *sequence, NSUInteger length, NSInteger low, NSUInteger range) {
+	
+	// A power of two of at least twice the length keeps the set at most half full.
+	NSUInteger bitCount = 4;
+	while (((NSUInteger) 1 << bitCount) < length * 2) {
+		bitCount++;
+	}
+	
+	NSUInteger slotCount = (NSUInteger) 1 << bitCount;
+	NSUInteger *slots = malloc(sizeof(NSUInteger) * slotCount);
+	if (slots == NULL) {
+		return NO;
+	}
+	
+	memset(slots, 0xff, sizeof(NSUInteger) * slotCount);
+	BOOL containsEmptySlotMarker = NO;
+	
+	JFRandomWordBatch batch;
+	JFRandomWordBatchInit(&batch);
+	
+	// Each value j of the last 'length' of the range adds a random value up to j, or j itself if that one is taken.
+	NSUInteger value = range - length;
+	
+	for (NSUInteger index = 0; index < length; index++, value++) {
+		NSUInteger candidate = JFRandomWordBatchUniform(&batch, value + 1);
+		
+		if (!JFRandomSetAdd(slots, slotCount - 1, sizeof(NSUInteger) * 8 - bitCount, &containsEmptySlotMarker, candidate)) {
+			candidate = value;
+			JFRandomSetAdd(slots, slotCount - 1, sizeof(NSUInteger) * 8 - bitCount, &containsEmptySlotMarker, candidate);
+		}
+		
+		sequence[index] = (NSInteger) ((NSUInteger) low + candidate);
+	}
+	
+	free(slots);
+	
+	JFRandomShuffleNumbers(sequence, length);
+	
+	return YES;
+}
+
+/*
+ * Fills the sequence with distinct values between low and high (inclusive), in random order,
+ * in time linear in the length (or in the range where it is not much wider).
+ */
+static BOOL JFRandomFillUniqueNumbers(NSInteger *sequence, NSUInteger length, NSInteger low, NSInteger high) {
+	
+	NSUInteger range = (NSUInteger) high - (NSUInteger) low + 1;
+	
+	if (range != 0 && range / JFRandomShuffledRangeFactor <= length) {
+		return JFRandomFillUniqueNumbersByShuffling(sequence, length, low, range);
+	}
+	
+	return JFRandomFillUniqueNumbersBySampling(sequence, length, low, range);
+}
+
 
 @implementation JFRandom
 
@@ -49,7 +410,58 @@
 		return NO;
 	}
 	
-	*receiver = (arc4random() % ((high + 1) - low)) + low;
+	JFRandomFillNumbers(receiver, 1, low, high);
+	return YES;
+}
+
+/*
+ * Fills the numbers with random values between low and high, drawing the randomness for all of them at once.
+ * Every value in the range is equally likely, whatever its size.
+ *
+ * Params
+ *		numbers		The receiving numbers.
+ *					Must not be nil and must accomodate at least 'count' numbers.
+ *		count		The count of numbers to generate.
+ *		low			The low number.
+ *					Must be lower or equal to high.
+ *		high		The high number.
+ *					Must be equal or higher than low.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
++ (BOOL) generateNumbers: (NSInteger[]) numbers count: (NSUInteger) count betweenLow: (NSInteger) low andHigh: (NSInteger) high {
+	
+	if (low > high) {
+		return NO;
+	}
+	
+	if (numbers == nil) {
+		return NO;
+	}
+	
+	JFRandomFillNumbers(numbers, count, low, high);
+	return YES;
+}
+
+/*
+ * Fills the bytes with cryptographically secure random bytes.
+ *
+ * Params
+ *		bytes		The receiving bytes.
+ *					Must not be nil and must accomodate at least 'length' bytes.
+ *		length		The number of bytes to fill.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
++ (BOOL) generateRandomBytes: (void *) bytes length: (NSUInteger) length {
+	
+	if (bytes == nil) {
+		return NO;
+	}
+	
+	JFRandomBytes(bytes, length);
 	return YES;
 }
 
@@ -84,44 +496,21 @@
 		return NO;
 	}
 	
-	if (onlyUniqueValues && length > (high - low) + 1) {
+	// The width of the range, 0 standing for the full width of NSInteger.
+	NSUInteger range = (NSUInteger) high - (NSUInteger) low + 1;
+	
+	if (onlyUniqueValues && range != 0 && length > range) {
 		return NO;
 	}
 	
-	NSInteger number;
-	
 	if (onlyUniqueValues) {
-		for (NSUInteger loop = 0; loop < length; loop++) {
-			// Only unique values are allowed.
-			if (![JFRandom generateNumberBetweenLow: low
-											andHigh: high
-									   intoReceiver: &number]) {
-				return NO;
-			}
-			
-			if ([JFRandom isNumber: number
-						inSequence: sequence
-						  ofLength: loop]) {
-				// This is not a unique number so skip adding it to the sequence.
-				loop--;
-				continue;
-			} else {
-				// This is a unique number so add it to the sequence.
-				sequence[loop] = number;
-			}
+		// Only unique values are allowed.
+		if (!JFRandomFillUniqueNumbers(sequence, length, low, high)) {
+			return NO;
 		}
 	} else {
 		// Repetitive values are allowed.
-		for (NSUInteger loop = 0; loop < length; loop++) {
-			// Only unique values are allowed.
-			if (![JFRandom generateNumberBetweenLow: low
-											andHigh: high
-									   intoReceiver: &number]) {
-				return NO;
-			}
-			
-			sequence[loop] = number;
-		}
+		JFRandomFillNumbers(sequence, length, low, high);
 	}
 	
 	return YES;
@@ -168,6 +557,146 @@
 	return YES;
 }
 
+/*
+ * Shuffles the numbers in place, every order being equally likely.
+ *
+ * Params
+ *		numbers		The numbers to shuffle.
+ *					Must not be nil and must be of at least 'count' numbers.
+ *		count		The count of numbers.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
++ (BOOL) shuffleNumbers: (NSInteger[]) numbers count: (NSUInteger) count {
+	
+	if (numbers == nil) {
+		return NO;
+	}
+	
+	JFRandomShuffleNumbers(numbers, count);
+	return YES;
+}
+
+/*
+ * Shuffles the elements of a C array in place, every order being equally likely.
+ *
+ * Params
+ *		elements	The elements to shuffle.
+ *					Must not be nil and must be of at least 'count' elements.
+ *		count		The count of elements.
+ *		elementSize	The size of each element in bytes.
+ *					Must be at least 1.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
++ (BOOL) shuffleElements: (void *) elements count: (NSUInteger) count size: (size_t) elementSize {
+	
+	if (elements == nil) {
+		return NO;
+	}
+	
+	if (elementSize == 0) {
+		return NO;
+	}
+	
+	UInt8 *bytes = elements;
+	JFRandomWordBatch batch;
+	JFRandomWordBatchInit(&batch);
+	
+	for (NSUInteger index = count; index > 1; index--) {
+		UInt8 *element = bytes + (index - 1) * elementSize;
+		UInt8 *otherElement = bytes + JFRandomWordBatchUniform(&batch, index) * elementSize;
+		
+		for (size_t offset = 0; offset < elementSize; offset++) {
+			UInt8 byte = element[offset];
+			element[offset] = otherElement[offset];
+			otherElement[offset] = byte;
+		}
+	}
+	
+	return YES;
+}
+
+/*
+ * Shuffles the objects of the array in place, every order being equally likely.
+ *
+ * Params
+ *		array		The array to shuffle.
+ *					Must not be nil.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
++ (BOOL) shuffleArray: (NSMutableArray *) array {
+	
+	if (array == nil) {
+		return NO;
+	}
+	
+	JFRandomWordBatch batch;
+	JFRandomWordBatchInit(&batch);
+	
+	for (NSUInteger index = [array count]; index > 1; index--) {
+		[array exchangeObjectAtIndex: index - 1
+				   withObjectAtIndex: JFRandomWordBatchUniform(&batch, index)];
+	}
+	
+	return YES;
+}
+
+/*
+ * Measures how fast unique sequences of the given length are generated as the range narrows,
+ * from a range 1000 times the length down to a range exactly the length.
+ *
+ * Params
+ *		length		The length of the sequences.
+ *					Must be at least 1.
+ *
+ * Returns
+ *		The values generated per second (NSNumber double) keyed by the ratio of the length to the range (NSNumber double),
+ *		or nil if the length is 0 or memory ran out.
+ */
++ (NSDictionary *) benchmarkUniqueSequencesOfLength: (NSUInteger) length {
+	
+	static const double ratios[] = { 0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 1.0 };
+	NSUInteger ratioCount = sizeof(ratios) / sizeof(ratios[0]);
+	
+	if (length == 0) {
+		return nil;
+	}
+	
+	NSInteger *sequence = malloc(sizeof(NSInteger) * length);
+	JFReturnNilIfNil(sequence);
+	
+	NSMutableDictionary *results = [NSMutableDictionary dictionaryWithCapacity: ratioCount];
+	
+	for (NSUInteger ratioIndex = 0; ratioIndex < ratioCount; ratioIndex++) {
+		NSUInteger range = (NSUInteger) (length / ratios[ratioIndex]);
+		NSUInteger valueCount = 0;
+		UInt64 start = JFLatencyHistogramNow();
+		UInt64 elapsed = 0;
+		
+		while (elapsed < JFRandomBenchmarkDuration * 1000000000.0) {
+			if (!JFRandomFillUniqueNumbers(sequence, length, 0, (NSInteger) range - 1)) {
+				free(sequence);
+				return nil;
+			}
+			
+			valueCount += length;
+			elapsed = JFLatencyHistogramNow() - start;
+		}
+		
+		[results setObject: [NSNumber numberWithDouble: valueCount / (elapsed / 1000000000.0)]
+					forKey: [NSNumber numberWithDouble: ratios[ratioIndex]]];
+	}
+	
+	free(sequence);
+	
+	return results;
+}
+
 /*
  * Returns YES if the provided number appears within the sequence.
  *
@@ -219,22 +748,8 @@
 		return nil;
 	}
 	
-	NSInteger *sequence = malloc(sizeof(NSInteger) * length);
-	[JFRandom generateNumberSequenceOfLength: length
-										into: sequence
-								  betweenLow: 0
-									 andHigh: 255
-						withOnlyUniqueValues: NO];
-	
-	char *randData = malloc(length);
-	for (NSUInteger loop = 0; loop < length; loop++) {
-		randData[loop] = (char) sequence[loop];
-	}
-	
-	free(sequence);
-	NSData *data = [NSData dataWithBytes: randData
-								  length: length];
-	free(randData);
+	NSMutableData *data = [NSMutableData dataWithLength: length];
+	JFRandomBytes(data.mutableBytes, length);
 	
 	return data;
 }
@@ -255,22 +770,9 @@
 		return nil;
 	}
 	
-	NSInteger *sequence = malloc(sizeof(NSInteger) * length);
-	[JFRandom generateNumberSequenceOfLength: length
-										into: sequence
-								  betweenLow: -128
-									 andHigh: 127
-						withOnlyUniqueValues: NO];
-	
-	signed char *randData = malloc(length);
-	for (NSUInteger loop = 0; loop < length; loop++) {
-		randData[loop] = (signed char) sequence[loop];
-	}
-	
-	free(sequence);
-	NSData *data = [NSData dataWithBytes: randData
-								  length: length];
-	free(randData);
+	// Uniformly random bytes are uniformly random signed bytes too.
+	NSMutableData *data = [NSMutableData dataWithLength: length];
+	JFRandomBytes(data.mutableBytes, length);
 	
 	return data;
 }
@@ -292,19 +794,10 @@
 		return nil;
 	}
 	
-	NSInteger *sequence = malloc(sizeof(NSInteger) * length);
-	[JFRandom generateNumberSequenceOfLength: length
-										into: sequence
-								  betweenLow: 0
-									 andHigh: 255
-						withOnlyUniqueValues: NO];
-	
-	char *randData = malloc(length);
-	for (NSUInteger loop = 0; loop < length; loop++) {
-		randData[loop] = (char) sequence[loop];
-	}
+	char *randData = malloc(length + 1);
+	JFRandomBytes(randData, length);
+	randData[length] = 0;
 	
-	free(sequence);
 	NSString *string = [NSString stringWithCString: randData
 										  encoding: NSASCIIStringEncoding];
 	free(randData);
@@ -385,7 +878,7 @@
                                     options: 0];
     
     NSDateComponents *offsetDays = [[[NSDateComponents alloc] init] autorelease];
-    offsetDays.day = arc4random() % range;
+    offsetDays.day = (range > 0) ? JFRandomUniform(range) : 0;
     
     date = [calendar dateByAddingComponents: offsetDays
                                      toDate: date
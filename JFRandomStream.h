@@ -0,0 +1,77 @@
+//
+//  JFRandomStream.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+
+#import <Foundation/Foundation.h>
+
+
+/*
+ * A fast, seedable, non-cryptographic random number generator (xoshiro256**, seeded through splitmix64)
+ * for reproducible test data and simulations. The same seed always yields the same values.
+ * Never use it for keys, salts, tokens or anything else an attacker must not predict; use JFRandom for those.
+ *
+ * A stream is not thread safe. Give each worker its own stream from the same seed and a distinct
+ * stream index, which jumps it 2^128 values ahead per index so no two workers' values overlap.
+ *
+ * Usage Example:
+ * JFRandomStream *stream = [[JFRandomStream alloc] initWithSeed: 42 streamIndex: workerIndex];
+ * [stream generateNumbers: ages count: userCount betweenLow: 18 andHigh: 99];
+ * NSString *name = [stream generateRandomStringOfLength: 8 withOnlyCharacters: @"abcdefghijklmnopqrstuvwxyz"];
+ */
+@interface JFRandomStream : NSObject {
+	
+@private
+	UInt64 _state[4];
+	
+	// The seed the stream was initialized with.
+	UInt64 _seed;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) UInt64 seed;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) init;
+- (id) initWithSeed: (UInt64) seed;
+- (id) initWithSeed: (UInt64) seed streamIndex: (NSUInteger) streamIndex;
+
+
+#pragma mark - Methods
+
+- (void) jump;
+- (void) longJump;
+
+- (UInt64) nextWord;
+- (double) nextDouble;
+- (NSInteger) nextNumberBetweenLow: (NSInteger) low andHigh: (NSInteger) high;
+
+- (BOOL) generateRandomBytes: (void *) bytes length: (NSUInteger) length;
+- (BOOL) generateNumbers: (NSInteger[]) numbers count: (NSUInteger) count betweenLow: (NSInteger) low andHigh: (NSInteger) high;
+- (BOOL) generateDoubles: (double[]) doubles count: (NSUInteger) count;
+- (NSData *) generateRandomDataOfLength: (NSUInteger) length;
+- (NSString *) generateRandomStringOfLength: (NSUInteger) length withOnlyCharacters: (NSString *) characters;
+- (NSDate *) generateRandomDateBetweenDate: (NSDate *) startDate andDate: (NSDate *) endDate;
+- (NSArray *) generateRandomDatesOfCount: (NSUInteger) count betweenDate: (NSDate *) startDate andDate: (NSDate *) endDate;
+- (NSDate *) generateRandomDateBetweenDaysAgo: (NSInteger) daysAgo andDaysFromNow: (NSInteger) daysFromNow;
+
+@end
@@ -0,0 +1,484 @@
+//
+//  JFRandomStream.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFRandomStream.h"
+
+#import "JFRandom.h"
+#import "JFMacros.h"
+
+
+// The number of values per stream index, 2^128 for jump and 2^192 for longJump.
+static const UInt64 JFRandomStreamJump[4] = {
+	0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+};
+
+static const UInt64 JFRandomStreamLongJump[4] = {
+	0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+};
+
+#if __LP64__
+typedef unsigned __int128 JFRandomStreamWideWord;
+#else
+typedef UInt64 JFRandomStreamWideWord;
+#endif
+
+
+static inline UInt64 JFRandomStreamRotate(UInt64 word, int count) {
+	
+	return (word << count) | (word >> (64 - count));
+}
+
+/*
+ * Returns the next output of splitmix64, which spreads a seed over the state.
+ */
+static inline UInt64 JFRandomStreamSplitMix(UInt64 *seed) {
+	
+	UInt64 word = (*seed += 0x9e3779b97f4a7c15ULL);
+	word = (word ^ (word >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	word = (word ^ (word >> 27)) * 0x94d049bb133111ebULL;
+	
+	return word ^ (word >> 31);
+}
+
+/*
+ * Returns the next output of xoshiro256** and advances the state.
+ */
+static inline UInt64 JFRandomStreamNext(UInt64 *state) {
+	
+	UInt64 result = JFRandomStreamRotate(state[1] * 5, 7) * 9;
+	UInt64 shifted = state[1] << 17;
+	
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= shifted;
+	state[3] = JFRandomStreamRotate(state[3], 45);
+	
+	return result;
+}
+
+/*
+ * Returns the next word the size of NSUInteger (the high half of the output on 32 bit platforms).
+ */
+static inline NSUInteger JFRandomStreamNextWord(UInt64 *state) {
+	
+#if __LP64__
+	return JFRandomStreamNext(state);
+#else
+	return (NSUInteger) (JFRandomStreamNext(state) >> 32);
+#endif
+}
+
+/*
+ * Returns a number in [0, range) without bias (Lemire's nearly divisionless method), or any number if range is 0.
+ */
+static inline NSUInteger JFRandomStreamUniform(UInt64 *state, NSUInteger range) {
+	
+	NSUInteger word = JFRandomStreamNextWord(state);
+	
+	if (range == 0) {
+		return word;
+	}
+	
+	JFRandomStreamWideWord product = (JFRandomStreamWideWord) word * range;
+	NSUInteger low = (NSUInteger) product;
+	
+	if (low < range) {
+		NSUInteger threshold = (0 - range) % range;
+		
+		while (low < threshold) {
+			product = (JFRandomStreamWideWord) JFRandomStreamNextWord(state) * range;
+			low = (NSUInteger) product;
+		}
+	}
+	
+	return (NSUInteger) (product >> (sizeof(NSUInteger) * 8));
+}
+
+/*
+ * Returns a double in [0, 1) from the top 53 bits of the next output.
+ */
+static inline double JFRandomStreamDouble(UInt64 *state) {
+	
+	return (double) (JFRandomStreamNext(state) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * Advances the state by the number of values the jump polynomial stands for.
+ */
+static void JFRandomStreamJumpBy(UInt64 *state, const UInt64 *jump) {
+	
+	UInt64 jumped[4] = { 0, 0, 0, 0 };
+	
+	for (NSUInteger word = 0; word < 4; word++) {
+		for (NSUInteger bit = 0; bit < 64; bit++) {
+			if (jump[word] & ((UInt64) 1 << bit)) {
+				jumped[0] ^= state[0];
+				jumped[1] ^= state[1];
+				jumped[2] ^= state[2];
+				jumped[3] ^= state[3];
+			}
+			
+			JFRandomStreamNext(state);
+		}
+	}
+	
+	memcpy(state, jumped, sizeof(jumped));
+}
+
+/*
+ * Fills the bytes with output words, keeping the state in registers for the whole run.
+ */
+static void JFRandomStreamFill(UInt64 *state, UInt8 *bytes, size_t length) {
+	
+	UInt64 localState[4] = { state[0], state[1], state[2], state[3] };
+	
+	while (length >= sizeof(UInt64)) {
+		UInt64 word = JFRandomStreamNext(localState);
+		memcpy(bytes, &word, sizeof(word));
+		bytes += sizeof(word);
+		length -= sizeof(word);
+	}
+	
+	if (length > 0) {
+		UInt64 word = JFRandomStreamNext(localState);
+		memcpy(bytes, &word, length);
+	}
+	
+	memcpy(state, localState, sizeof(localState));
+}
+
+
+@implementation JFRandomStream
+
+
+#pragma mark - Properties
+
+@synthesize seed = _seed;
+
+
+#pragma mark - Object lifecycle methods
+
+/*
+ * Initializes a stream from an unpredictable seed, which the seed property then reveals
+ * so a run can be reproduced.
+ */
+- (id) init {
+	
+	UInt64 seed;
+	[JFRandom generateRandomBytes: &seed
+						   length: sizeof(seed)];
+	
+	return [self initWithSeed: seed];
+}
+
+/*
+ * Initializes a stream from the seed.
+ */
+- (id) initWithSeed: (UInt64) seed {
+	
+	return [self initWithSeed: seed
+				  streamIndex: 0];
+}
+
+/*
+ * Initializes one of a family of non-overlapping streams from the seed.
+ *
+ * Params
+ *		seed			The seed shared by the family of streams.
+ *		streamIndex		The index of the stream within the family, typically the worker number.
+ *						Each index costs one jump (256 steps of the generator) at initialization.
+ */
+- (id) initWithSeed: (UInt64) seed streamIndex: (NSUInteger) streamIndex {
+	
+	self = [super init];
+	
+	if (self) {
+		_seed = seed;
+		
+		UInt64 splitMixState = seed;
+		for (NSUInteger word = 0; word < 4; word++) {
+			_state[word] = JFRandomStreamSplitMix(&splitMixState);
+		}
+		
+		for (NSUInteger index = 0; index < streamIndex; index++) {
+			JFRandomStreamJumpBy(_state, JFRandomStreamJump);
+		}
+	}
+	
+	return self;
+}
+
+
+#pragma mark - Methods
+
+/*
+ * Advances the stream by 2^128 values, as if that many had been generated.
+ */
+- (void) jump {
+	
+	JFRandomStreamJumpBy(_state, JFRandomStreamJump);
+}
+
+/*
+ * Advances the stream by 2^192 values, splitting off room for 2^64 families of jumped streams.
+ */
+- (void) longJump {
+	
+	JFRandomStreamJumpBy(_state, JFRandomStreamLongJump);
+}
+
+- (UInt64) nextWord {
+	
+	return JFRandomStreamNext(_state);
+}
+
+/*
+ * Returns a double in [0, 1), with 53 random bits.
+ */
+- (double) nextDouble {
+	
+	return JFRandomStreamDouble(_state);
+}
+
+/*
+ * Returns a number between low and high (inclusive), every value being equally likely.
+ * Returns low if high is lower than low.
+ */
+- (NSInteger) nextNumberBetweenLow: (NSInteger) low andHigh: (NSInteger) high {
+	
+	if (low > high) {
+		return low;
+	}
+	
+	NSUInteger range = (NSUInteger) high - (NSUInteger) low + 1;
+	
+	return (NSInteger) ((NSUInteger) low + JFRandomStreamUniform(_state, range));
+}
+
+/*
+ * Fills the bytes with the next output of the stream.
+ *
+ * Params
+ *		bytes		The receiving bytes.
+ *					Must not be nil and must accomodate at least 'length' bytes.
+ *		length		The number of bytes to fill.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
+- (BOOL) generateRandomBytes: (void *) bytes length: (NSUInteger) length {
+	
+	if (bytes == nil) {
+		return NO;
+	}
+	
+	JFRandomStreamFill(_state, bytes, length);
+	return YES;
+}
+
+/*
+ * Fills the numbers with values between low and high, every value being equally likely.
+ *
+ * Params
+ *		numbers		The receiving numbers.
+ *					Must not be nil and must accomodate at least 'count' numbers.
+ *		count		The count of numbers to generate.
+ *		low			The low number.
+ *					Must be lower or equal to high.
+ *		high		The high number.
+ *					Must be equal or higher than low.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
+- (BOOL) generateNumbers: (NSInteger[]) numbers count: (NSUInteger) count betweenLow: (NSInteger) low andHigh: (NSInteger) high {
+	
+	if (low > high) {
+		return NO;
+	}
+	
+	if (numbers == nil) {
+		return NO;
+	}
+	
+	NSUInteger range = (NSUInteger) high - (NSUInteger) low + 1;
+	UInt64 state[4] = { _state[0], _state[1], _state[2], _state[3] };
+	
+	for (NSUInteger index = 0; index < count; index++) {
+		numbers[index] = (NSInteger) ((NSUInteger) low + JFRandomStreamUniform(state, range));
+	}
+	
+	memcpy(_state, state, sizeof(state));
+	return YES;
+}
+
+/*
+ * Fills the doubles with values in [0, 1).
+ *
+ * Params
+ *		doubles		The receiving doubles.
+ *					Must not be nil and must accomodate at least 'count' doubles.
+ *		count		The count of doubles to generate.
+ *
+ * Return
+ *		YES if successful, NO otherwise.
+ */
+- (BOOL) generateDoubles: (double[]) doubles count: (NSUInteger) count {
+	
+	if (doubles == nil) {
+		return NO;
+	}
+	
+	UInt64 state[4] = { _state[0], _state[1], _state[2], _state[3] };
+	
+	for (NSUInteger index = 0; index < count; index++) {
+		doubles[index] = JFRandomStreamDouble(state);
+	}
+	
+	memcpy(_state, state, sizeof(state));
+	return YES;
+}
+
+/*
+ * Returns an NSData of the next output of the stream.
+ *
+ * Params
+ *		length		The length of the resulting NSData.
+ *					Must be 1 or greater or nil will be returned.
+ */
+- (NSData *) generateRandomDataOfLength: (NSUInteger) length {
+	
+	if (length == 0) {
+		return nil;
+	}
+	
+	NSMutableData *data = [NSMutableData dataWithLength: length];
+	JFRandomStreamFill(_state, data.mutableBytes, length);
+	
+	return data;
+}
+
+/*
+ * Returns a string of characters drawn from the given ones, each equally likely.
+ *
+ * Params
+ *		length		The length of the resulting string.
+ *					Must be 1 or greater or nil will be returned.
+ *		characters	The ASCII characters to draw from.
+ *					Must not be empty or nil will be returned.
+ *
+ * Returns
+ *		An ASCII encoded NSString instance.
+ */
+- (NSString *) generateRandomStringOfLength: (NSUInteger) length withOnlyCharacters: (NSString *) characters {
+	
+	if (length == 0) {
+		return nil;
+	}
+	
+	const char *characterBytes = [characters cStringUsingEncoding: NSASCIIStringEncoding];
+	JFReturnNilIfNil(characterBytes);
+	
+	NSUInteger characterCount = strlen(characterBytes);
+	if (characterCount == 0) {
+		return nil;
+	}
+	
+	char *output = malloc(length);
+	JFReturnNilIfNil(output);
+	
+	UInt64 state[4] = { _state[0], _state[1], _state[2], _state[3] };
+	
+	for (NSUInteger index = 0; index < length; index++) {
+		output[index] = characterBytes[JFRandomStreamUniform(state, characterCount)];
+	}
+	
+	memcpy(_state, state, sizeof(state));
+	
+	NSString *string = [[NSString alloc] initWithBytesNoCopy: output
+													  length: length
+													encoding: NSASCIIStringEncoding
+												freeWhenDone: YES];
+	
+#if __has_feature(objc_arc)
+	return string;
+#else
+	return [string autorelease];
+#endif
+}
+
+/*
+ * Returns a date between the two dates, every instant being equally likely.
+ * Unlike generateRandomDateBetweenDaysAgo:andDaysFromNow: it does not depend on when it is called.
+ */
+- (NSDate *) generateRandomDateBetweenDate: (NSDate *) startDate andDate: (NSDate *) endDate {
+	
+	JFReturnNilIfNil(startDate);
+	JFReturnNilIfNil(endDate);
+	
+	NSTimeInterval start = [startDate timeIntervalSinceReferenceDate];
+	NSTimeInterval duration = [endDate timeIntervalSinceReferenceDate] - start;
+	
+	return [NSDate dateWithTimeIntervalSinceReferenceDate: start + JFRandomStreamDouble(_state) * duration];
+}
+
+/*
+ * Returns the given number of dates between the two dates, every instant being equally likely.
+ */
+- (NSArray *) generateRandomDatesOfCount: (NSUInteger) count betweenDate: (NSDate *) startDate andDate: (NSDate *) endDate {
+	
+	JFReturnNilIfNil(startDate);
+	JFReturnNilIfNil(endDate);
+	
+	NSTimeInterval start = [startDate timeIntervalSinceReferenceDate];
+	NSTimeInterval duration = [endDate timeIntervalSinceReferenceDate] - start;
+	NSMutableArray *dates = [NSMutableArray arrayWithCapacity: count];
+	
+	for (NSUInteger index = 0; index < count; index++) {
+		[dates addObject: [NSDate dateWithTimeIntervalSinceReferenceDate: start + JFRandomStreamDouble(_state) * duration]];
+	}
+	
+	return dates;
+}
+
+/*
+ * Returns a random date (at the current time of day) between daysAgo and daysFromNow relative to today.
+ * As with JFRandom the day offset depends only on the stream, but the date itself on when it is called.
+ */
+- (NSDate *) generateRandomDateBetweenDaysAgo: (NSInteger) daysAgo andDaysFromNow: (NSInteger) daysFromNow {
+	
+	NSInteger range = daysFromNow + daysAgo;
+	
+	NSDateComponents *offsetDays = [[NSDateComponents alloc] init];
+	offsetDays.day = -daysAgo + ((range > 0) ? (NSInteger) JFRandomStreamUniform(_state, range) : 0);
+	
+	NSDate *date = [[NSCalendar currentCalendar] dateByAddingComponents: offsetDays
+																 toDate: [NSDate date]
+																options: 0];
+	
+#if !__has_feature(objc_arc) // NON ARC
+	[offsetDays release];
+#endif
+	
+	return date;
+}
+
+@end
@@ -0,0 +1,173 @@
+//
+//  JFSocketEventLoop.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFSocketReader.h"
+#import "JFSocketWriter.h"
+#import "JFSocketStatistics.h"
+
+
+#if defined(__linux__)
+
+
+// The mechanisms an event loop can be driven by.
+#define JFSocketEventLoopBackendEpoll		0
+#define JFSocketEventLoopBackendIOUring		1
+
+// The maximum number of events handled per wait.
+#define JFSocketEventLoopMaxEventCount		256
+
+// The backlog of the listening sockets the event loop creates.
+#define JFSocketEventLoopListenBacklog		1024
+
+// The keys of the results of benchmarkEchoOnPort:connectionCount:requestLength:backend:.
+#define JFSocketEventLoopBenchmarkConnectionCountKey		@"connectionCount"
+#define JFSocketEventLoopBenchmarkRequestsPerSecondKey		@"requestsPerSecond"
+#define JFSocketEventLoopBenchmarkP99LatencyKey				@"p99Latency"
+#define JFSocketEventLoopBenchmarkSyscallsPerRequestKey		@"syscallsPerRequest"
+#define JFSocketEventLoopBenchmarkBackendKey				@"backend"
+
+// The keys of the results of benchmarkBackendsOnPort:connectionCount:requestLength:.
+#define JFSocketEventLoopBenchmarkEpollKey					@"epoll"
+#define JFSocketEventLoopBenchmarkIOUringKey				@"io_uring"
+
+
+@class JFSocketEventLoop;
+struct JFSocketEventLoopRing;
+
+
+typedef void (^JFSocketEventLoopReadHandler) (JFSocketReader * /* reader */, JFSocketWriter * /* writer */);
+typedef void (^JFSocketEventLoopWriteHandler) (JFSocketWriter * /* writer */);
+typedef void (^JFSocketEventLoopCloseHandler) (NSInteger /* socket */);
+typedef void (^JFSocketEventLoopAcceptHandler) (JFSocketEventLoop * /* eventLoop */, NSInteger /* socket */);
+
+
+/*
+ * An edge-triggered epoll event loop driving many non-blocking sockets from a single thread.
+ *
+ * Each added socket gets a JFSocketReader and a JFSocketWriter.  When the socket becomes readable
+ * the loop reads until it would block and passes the reader (to parse and consume) and the writer
+ * (to queue the response on) to the read handler, then flushes the writer.  When the socket becomes
+ * writable the loop resumes flushing and, once the writer has drained, calls the write handler.
+ * A reader stops reading at its maximum capacity; the loop reads the rest once the handler has consumed
+ * some, and closes the connection if the handler consumes nothing of a full reader.
+ *
+ * Handlers are called on the thread running the loop.
+ *
+ * On kernels supporting it the loop can be driven by io_uring instead (JFSocketEventLoopBackendIOUring).
+ * Sockets then sit in a fixed file table, receives are multishot (single-shot before kernel 6.0) and complete into a ring of buffers provided
+ * up front, and every receive and write queued while handling a batch of completions goes to the kernel in
+ * the same io_uring_enter call that waits for the next batch.  Where io_uring or any operation the loop uses
+ * is unavailable the loop falls back to epoll, so check the backend property to learn which one is in use.
+ *
+ * With statisticsEnabled set, sockets added from then on count their bytes, calls, short and would-block
+ * reads and writes, and read-to-handler and handler-to-flush latencies, both per socket and in the loop's totals.
+ *
+ * Usage Example:
+ * JFSocketEventLoop *eventLoop = [[JFSocketEventLoop alloc] init];
+ * [eventLoop addListeningSocket: [JFSocketEventLoop listeningSocketOnPort: 8080 reusePort: NO]
+ *                 acceptHandler: ^(JFSocketEventLoop *loop, NSInteger socket) {
+ *     [loop addSocket: socket
+ *         readHandler: ^(JFSocketReader *reader, JFSocketWriter *writer) {
+ *             // Echo everything back.
+ *             NSUInteger byteCount = [reader byteCount];
+ *             [writer enqueueData: [NSData dataWithBytes: [reader contiguousBytesOfLength: byteCount] length: byteCount]];
+ *             [reader consumeByteCount: byteCount];
+ *         }
+ *        writeHandler: nil
+ *        closeHandler: nil];
+ * }];
+ * [eventLoop run];
+ */
+@interface JFSocketEventLoop : NSObject {
+
+@private
+	// The mechanism driving the loop.
+	NSUInteger _backend;
+
+	// The epoll instance (epoll backend).
+	int _epoll;
+
+	// The submission and completion rings (io_uring backend).
+	struct JFSocketEventLoopRing *_ring;
+
+	// The generation given to the next connection, telling its completions from those of an earlier connection on the same socket.
+	UInt32 _nextGeneration;
+
+	// The closed connections kept alive until their in-flight writes complete, keyed by the writes' user data (io_uring backend).
+	NSMutableDictionary *_closingConnections;
+
+	// The eventfd used to wake the loop up when it is stopped from another thread.
+	int _wakeDescriptor;
+
+	// The connections keyed by their sockets.
+	NSMutableDictionary *_connections;
+
+	// The accept handlers keyed by their listening sockets.
+	NSMutableDictionary *_listeners;
+
+	// The flag denoting whether the loop has been asked to stop.
+	BOOL _stopped;
+
+	// The flag denoting whether sockets added from now on keep statistics.
+	BOOL _statisticsEnabled;
+
+	// The statistics of every socket the loop has handled.
+	JFSocketStatistics *_totalStatistics;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) NSUInteger backend;
+@property (nonatomic, readonly) NSUInteger socketCount;
+@property (nonatomic, assign) BOOL statisticsEnabled;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) init;
+- (id) initWithBackend: (NSUInteger) backend;
+
+
+#pragma mark - Methods
+
++ (NSInteger) listeningSocketOnPort: (UInt16) port reusePort: (BOOL) reusePort;
++ (NSArray *) startEventLoopsPerCoreOnPort: (UInt16) port acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler;
++ (NSArray *) startEventLoopsPerCoreOnPort: (UInt16) port backend: (NSUInteger) backend acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler;
++ (NSDictionary *) benchmarkEchoOnPort: (UInt16) port connectionCount: (NSUInteger) connectionCount requestLength: (NSUInteger) requestLength backend: (NSUInteger) backend;
++ (NSDictionary *) benchmarkBackendsOnPort: (UInt16) port connectionCount: (NSUInteger) connectionCount requestLength: (NSUInteger) requestLength;
+
+- (BOOL) addSocket: (NSInteger) socket readHandler: (JFSocketEventLoopReadHandler) readHandler writeHandler: (JFSocketEventLoopWriteHandler) writeHandler closeHandler: (JFSocketEventLoopCloseHandler) closeHandler;
+- (BOOL) addListeningSocket: (NSInteger) socket acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler;
+- (void) removeSocket: (NSInteger) socket;
+- (void) run;
+- (void) stop;
+
+
+#pragma mark - Statistics methods
+
+- (JFSocketStatistics) statistics;
+- (BOOL) getStatistics: (JFSocketStatistics *) statistics forSocket: (NSInteger) socket;
+
+@end
+
+
+#endif
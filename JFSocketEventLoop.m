@@ -0,0 +1,1805 @@
+//
+//  JFSocketEventLoop.m
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import "JFSocketEventLoop.h"
+
+
+#if defined(__linux__)
+
+
+#import "JFGC.h"
+#import "JFMacros.h"
+#import "JFLatencyHistogram.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <poll.h>
+#import <unistd.h>
+#import <sys/epoll.h>
+#import <sys/eventfd.h>
+#import <sys/mman.h>
+#import <sys/syscall.h>
+#import <linux/io_uring.h>
+#import <netinet/tcp.h>
+
+
+// The number of seconds the echo benchmark drives its connections for.
+#define JFSocketEventLoopBenchmarkDuration		1.0
+
+// The number of submission queue entries of the io_uring backend.
+#define JFSocketEventLoopRingEntryCount			256
+
+// The number of slots in the fixed file table.  Sockets numbered beyond it are used without a slot.
+#define JFSocketEventLoopFixedFileCount			4096
+
+// The number and byte size of the buffers multishot receives complete into.  The count must be a power of 2.
+#define JFSocketEventLoopRingBufferCount		1024
+#define JFSocketEventLoopRingBufferSize			4096
+#define JFSocketEventLoopRingBufferGroup		0
+
+// The maximum number of writer segments sent per io_uring write.
+#define JFSocketEventLoopRingVectorCount		64
+
+// The operations tagged onto io_uring requests.
+#define JFSocketEventLoopOperationWake			1
+#define JFSocketEventLoopOperationAccept		2
+#define JFSocketEventLoopOperationReceive		3
+#define JFSocketEventLoopOperationWrite			4
+#define JFSocketEventLoopOperationCancel		5
+#define JFSocketEventLoopOperationAcceptRetry	6
+
+// The nanoseconds a failed multishot accept waits before being rearmed, so a persistent error (such as EMFILE) does not spin.
+#define JFSocketEventLoopAcceptRetryDelay		10000000
+
+// Packs the operation, connection generation and socket into the user data of an io_uring request.
+#define JFSocketEventLoopUserData(operation, generation, socket)	((((UInt64) (operation)) << 56) | (((UInt64) (generation) & 0xFFFFFF) << 32) | (UInt32) (socket))
+#define JFSocketEventLoopUserDataOperation(userData)				((UInt32) ((userData) >> 56))
+#define JFSocketEventLoopUserDataGeneration(userData)				((UInt32) (((userData) >> 32) & 0xFFFFFF))
+#define JFSocketEventLoopUserDataSocket(userData)					((int) (UInt32) (userData))
+
+
+/*
+ * The submission and completion rings shared with the kernel, plus the provided buffer ring receives complete into.
+ */
+typedef struct JFSocketEventLoopRing {
+	int descriptor;
+
+	unsigned *submissionHead;
+	unsigned *submissionTail;
+	unsigned submissionMask;
+	unsigned *submissionArray;
+	struct io_uring_sqe *submissionEntries;
+	unsigned submissionEntryCount;
+	unsigned pendingSubmissionCount;
+
+	unsigned *completionHead;
+	unsigned *completionTail;
+	unsigned completionMask;
+	struct io_uring_cqe *completionEntries;
+
+	void *submissionRing;
+	size_t submissionRingSize;
+	void *completionRing;
+	size_t completionRingSize;
+	size_t submissionEntriesSize;
+
+	struct io_uring_buf_ring *bufferRing;
+	size_t bufferRingSize;
+	UInt8 *buffers;
+
+	// The flag denoting whether the kernel rejected a multishot receive (before 6.0), so receives are armed one at a time.
+	BOOL singleShotReceives;
+
+	// The counter of io_uring_enter calls made only to submit (NULL unless statistics are enabled).
+	UInt64 *controlCallCount;
+
+	// The entries held back while the submission ring is full and the kernel will not take more until completions are reaped.
+	struct io_uring_sqe *deferredEntries;
+	unsigned deferredCount;
+	unsigned deferredCapacity;
+} JFSocketEventLoopRing;
+
+
+static inline int JFSocketEventLoopRingEnter(int descriptor, unsigned submitCount, unsigned waitCount, unsigned flags) {
+
+	return (int) syscall(__NR_io_uring_enter, descriptor, submitCount, waitCount, flags, NULL, 0);
+}
+
+static inline int JFSocketEventLoopRingRegister(int descriptor, unsigned opcode, void *argument, unsigned argumentCount) {
+
+	return (int) syscall(__NR_io_uring_register, descriptor, opcode, argument, argumentCount);
+}
+
+/*
+ * Returns YES if the kernel supports every operation the loop submits.
+ */
+static BOOL JFSocketEventLoopRingSupportsOperations(int descriptor) {
+
+	size_t probeSize = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, probeSize);
+	if (probe == NULL) {
+		return NO;
+	}
+
+	BOOL supported = NO;
+	if (JFSocketEventLoopRingRegister(descriptor, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+		UInt8 operations[] = { IORING_OP_POLL_ADD, IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT };
+
+		supported = YES;
+		for (NSUInteger index = 0; index < sizeof(operations); index++) {
+			if (operations[index] > probe->last_op || (probe->ops[operations[index]].flags & IO_URING_OP_SUPPORTED) == 0) {
+				supported = NO;
+				break;
+			}
+		}
+	}
+
+	free(probe);
+	return supported;
+}
+
+static void JFSocketEventLoopRingTearDown(JFSocketEventLoopRing *ring) {
+
+	free(ring->deferredEntries);
+
+	if (ring->bufferRing != NULL) {
+		munmap(ring->bufferRing, ring->bufferRingSize);
+	}
+	free(ring->buffers);
+	if (ring->submissionEntries != NULL) {
+		munmap(ring->submissionEntries, ring->submissionEntriesSize);
+	}
+	if (ring->completionRing != NULL && ring->completionRing != ring->submissionRing) {
+		munmap(ring->completionRing, ring->completionRingSize);
+	}
+	if (ring->submissionRing != NULL) {
+		munmap(ring->submissionRing, ring->submissionRingSize);
+	}
+	if (ring->descriptor >= 0) {
+		close(ring->descriptor);
+	}
+
+	memset(ring, 0, sizeof(*ring));
+	ring->descriptor = -1;
+}
+
+/*
+ * Creates the ring, registers a sparse fixed file table and a provided buffer ring.
+ * Returns NO (leaving the ring torn down) if the kernel lacks any of the features or operations used.
+ * Multishot receives cannot be probed for, so they are given up on when the first one is rejected.
+ */
+static BOOL JFSocketEventLoopRingSetUp(JFSocketEventLoopRing *ring) {
+
+	memset(ring, 0, sizeof(*ring));
+
+	struct io_uring_params parameters;
+	memset(&parameters, 0, sizeof(parameters));
+	ring->descriptor = (int) syscall(__NR_io_uring_setup, JFSocketEventLoopRingEntryCount, &parameters);
+	if (ring->descriptor < 0) {
+		ring->descriptor = -1;
+		return NO;
+	}
+
+	if ((parameters.features & IORING_FEAT_SINGLE_MMAP) == 0 || (parameters.features & IORING_FEAT_NODROP) == 0
+		|| !JFSocketEventLoopRingSupportsOperations(ring->descriptor)) {
+		JFSocketEventLoopRingTearDown(ring);
+		return NO;
+	}
+
+	// With a single mmap the completion ring shares the submission ring's mapping.
+	ring->submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+	ring->completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+	if (ring->completionRingSize > ring->submissionRingSize) {
+		ring->submissionRingSize = ring->completionRingSize;
+	}
+	ring->completionRingSize = ring->submissionRingSize;
+
+	ring->submissionRing = mmap(NULL, ring->submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_SQ_RING);
+	if (ring->submissionRing == MAP_FAILED) {
+		ring->submissionRing = NULL;
+		JFSocketEventLoopRingTearDown(ring);
+		return NO;
+	}
+	ring->completionRing = ring->submissionRing;
+
+	ring->submissionEntriesSize = parameters.sq_entries * sizeof(struct io_uring_sqe);
+	ring->submissionEntries = mmap(NULL, ring->submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_SQES);
+	if (ring->submissionEntries == MAP_FAILED) {
+		ring->submissionEntries = NULL;
+		JFSocketEventLoopRingTearDown(ring);
+		return NO;
+	}
+
+	UInt8 *submissionRing = ring->submissionRing;
+	ring->submissionHead = (unsigned *) (submissionRing + parameters.sq_off.head);
+	ring->submissionTail = (unsigned *) (submissionRing + parameters.sq_off.tail);
+	ring->submissionMask = *(unsigned *) (submissionRing + parameters.sq_off.ring_mask);
+	ring->submissionArray = (unsigned *) (submissionRing + parameters.sq_off.array);
+	ring->submissionEntryCount = parameters.sq_entries;
+
+	UInt8 *completionRing = ring->completionRing;
+	ring->completionHead = (unsigned *) (completionRing + parameters.cq_off.head);
+	ring->completionTail = (unsigned *) (completionRing + parameters.cq_off.tail);
+	ring->completionMask = *(unsigned *) (completionRing + parameters.cq_off.ring_mask);
+	ring->completionEntries = (struct io_uring_cqe *) (completionRing + parameters.cq_off.cqes);
+
+	// An empty table sockets are slotted into as they are added, so operations skip the per-call file lookup.
+	struct io_uring_rsrc_register files;
+	memset(&files, 0, sizeof(files));
+	files.nr = JFSocketEventLoopFixedFileCount;
+	files.flags = IORING_RSRC_REGISTER_SPARSE;
+	if (JFSocketEventLoopRingRegister(ring->descriptor, IORING_REGISTER_FILES2, &files, sizeof(files)) != 0) {
+		JFSocketEventLoopRingTearDown(ring);
+		return NO;
+	}
+
+	// The buffers the kernel picks from when a multishot receive completes.
+	ring->bufferRingSize = JFSocketEventLoopRingBufferCount * sizeof(struct io_uring_buf);
+	ring->bufferRing = mmap(NULL, ring->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ring->buffers = malloc(JFSocketEventLoopRingBufferCount * JFSocketEventLoopRingBufferSize);
+	if (ring->bufferRing == MAP_FAILED || ring->buffers == NULL) {
+		if (ring->bufferRing == MAP_FAILED) {
+			ring->bufferRing = NULL;
+		}
+		JFSocketEventLoopRingTearDown(ring);
+		return NO;
+	}
+
+	struct io_uring_buf_reg bufferRegistration;
+	memset(&bufferRegistration, 0, sizeof(bufferRegistration));
+	bufferRegistration.ring_addr = (UInt64) (uintptr_t) ring->bufferRing;
+	bufferRegistration.ring_entries = JFSocketEventLoopRingBufferCount;
+	bufferRegistration.bgid = JFSocketEventLoopRingBufferGroup;
+	if (JFSocketEventLoopRingRegister(ring->descriptor, IORING_REGISTER_PBUF_RING, &bufferRegistration, 1) != 0) {
+		JFSocketEventLoopRingTearDown(ring);
+		return NO;
+	}
+
+	for (UInt16 bufferId = 0; bufferId < JFSocketEventLoopRingBufferCount; bufferId++) {
+		struct io_uring_buf *buffer = &ring->bufferRing->bufs[bufferId];
+		buffer->addr = (UInt64) (uintptr_t) (ring->buffers + bufferId * JFSocketEventLoopRingBufferSize);
+		buffer->len = JFSocketEventLoopRingBufferSize;
+		buffer->bid = bufferId;
+	}
+	__atomic_store_n(&ring->bufferRing->tail, (UInt16) JFSocketEventLoopRingBufferCount, __ATOMIC_RELEASE);
+
+	return YES;
+}
+
+/*
+ * Hands a buffer a receive completed into back to the kernel.
+ */
+static inline void JFSocketEventLoopRingRecycleBuffer(JFSocketEventLoopRing *ring, UInt16 bufferId) {
+
+	UInt16 tail = ring->bufferRing->tail;
+	struct io_uring_buf *buffer = &ring->bufferRing->bufs[tail & (JFSocketEventLoopRingBufferCount - 1)];
+	buffer->addr = (UInt64) (uintptr_t) (ring->buffers + bufferId * JFSocketEventLoopRingBufferSize);
+	buffer->len = JFSocketEventLoopRingBufferSize;
+	buffer->bid = bufferId;
+	__atomic_store_n(&ring->bufferRing->tail, (UInt16) (tail + 1), __ATOMIC_RELEASE);
+}
+
+/*
+ * Submits the queued entries and, if asked, waits for completions, all in one io_uring_enter call.
+ */
+static inline int JFSocketEventLoopRingSubmit(JFSocketEventLoopRing *ring, unsigned waitCount) {
+
+	unsigned submitCount = ring->pendingSubmissionCount;
+	if (submitCount == 0 && waitCount == 0) {
+		return 0;
+	}
+
+	int result = JFSocketEventLoopRingEnter(ring->descriptor, submitCount, waitCount, (waitCount > 0) ? IORING_ENTER_GETEVENTS : 0);
+	if (waitCount == 0 && ring->controlCallCount != NULL) {
+		JFSocketStatisticsAdd(ring->controlCallCount, 1);
+	}
+	if (result >= 0) {
+		ring->pendingSubmissionCount -= MIN((unsigned) result, submitCount);
+	}
+
+	return result;
+}
+
+/*
+ * Returns a zeroed submission entry to fill in, submitting the queued ones first if the ring is full.
+ * The entry is published to the kernel with the next submit.
+ *
+ * If the kernel will not take the queued entries either (EBUSY or EAGAIN, while completions it could not post
+ * wait to be reaped), the entry is held back rather than spinning inside a completion handler, and the loop
+ * queues it once it has reaped completions (see JFSocketEventLoopRingQueueDeferred).
+ */
+static inline struct io_uring_sqe *JFSocketEventLoopRingNextSubmission(JFSocketEventLoopRing *ring) {
+
+	unsigned tail = *ring->submissionTail;
+	BOOL full = (tail - __atomic_load_n(ring->submissionHead, __ATOMIC_ACQUIRE) >= ring->submissionEntryCount);
+
+	if (full && ring->deferredCount == 0) {
+		int result;
+		do {
+			result = JFSocketEventLoopRingSubmit(ring, 0);
+		} while (result < 0 && errno == EINTR);
+
+		if (result < 0 && errno != EAGAIN && errno != EBUSY) {
+			return NULL;
+		}
+
+		full = (tail - __atomic_load_n(ring->submissionHead, __ATOMIC_ACQUIRE) >= ring->submissionEntryCount);
+	}
+
+	// Once entries are held back, later ones are too so they reach the kernel in order.
+	if (full || ring->deferredCount > 0) {
+		if (ring->deferredCount == ring->deferredCapacity) {
+			unsigned capacity = MAX(ring->deferredCapacity * 2, ring->submissionEntryCount);
+			struct io_uring_sqe *entries = realloc(ring->deferredEntries, capacity * sizeof(struct io_uring_sqe));
+			if (entries == NULL) {
+				return NULL;
+			}
+
+			ring->deferredEntries = entries;
+			ring->deferredCapacity = capacity;
+		}
+
+		struct io_uring_sqe *entry = &ring->deferredEntries[ring->deferredCount++];
+		memset(entry, 0, sizeof(*entry));
+		return entry;
+	}
+
+	unsigned index = tail & ring->submissionMask;
+	struct io_uring_sqe *entry = &ring->submissionEntries[index];
+	memset(entry, 0, sizeof(*entry));
+	ring->submissionArray[index] = index;
+
+	__atomic_store_n(ring->submissionTail, tail + 1, __ATOMIC_RELEASE);
+	ring->pendingSubmissionCount++;
+
+	return entry;
+}
+
+/*
+ * Moves as many held back entries into the submission ring as it has room for.
+ */
+static void JFSocketEventLoopRingQueueDeferred(JFSocketEventLoopRing *ring) {
+
+	unsigned queuedCount = 0;
+
+	while (queuedCount < ring->deferredCount) {
+		unsigned tail = *ring->submissionTail;
+		if (tail - __atomic_load_n(ring->submissionHead, __ATOMIC_ACQUIRE) >= ring->submissionEntryCount) {
+			break;
+		}
+
+		unsigned index = tail & ring->submissionMask;
+		ring->submissionEntries[index] = ring->deferredEntries[queuedCount++];
+		ring->submissionArray[index] = index;
+
+		__atomic_store_n(ring->submissionTail, tail + 1, __ATOMIC_RELEASE);
+		ring->pendingSubmissionCount++;
+	}
+
+	ring->deferredCount -= queuedCount;
+	memmove(ring->deferredEntries, ring->deferredEntries + queuedCount, ring->deferredCount * sizeof(struct io_uring_sqe));
+}
+
+
+/*
+ * A socket registered with an event loop along with its reader, writer and handlers.
+ */
+@interface JFSocketEventLoopConnection : NSObject {
+
+@public
+	NSInteger _socket;
+	JFSocketReader *_reader;
+	JFSocketWriter *_writer;
+	JFSocketEventLoopReadHandler _readHandler;
+	JFSocketEventLoopWriteHandler _writeHandler;
+	JFSocketEventLoopCloseHandler _closeHandler;
+
+	// The io_uring backend state.
+	UInt32 _generation;
+	BOOL _fixed;
+	BOOL _writeInFlight;
+	BOOL _closeWhenFlushed;
+	BOOL _multishotReceive;
+	struct msghdr _message;
+	struct iovec _vectors[JFSocketEventLoopRingVectorCount];
+	NSUInteger _requestedWriteByteCount;
+
+	// The statistics of the socket (NULL unless enabled) and when the read handler last returned with output queued (0 if none is pending).
+	JFSocketStatistics *_statistics;
+	UInt64 _handlerReturnTime;
+}
+
+@end
+
+
+@implementation JFSocketEventLoopConnection
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+
+	JFFree(_statistics);
+}
+
+#else
+
+- (void) dealloc {
+
+	JFFree(_statistics);
+	[_reader release];
+	[_writer release];
+	[_readHandler release];
+	[_writeHandler release];
+	[_closeHandler release];
+	[super dealloc];
+}
+
+#endif
+
+@end
+
+
+@interface JFSocketEventLoop (PrivateMethods)
+
+- (void) handleEvents: (uint32_t) events onSocket: (NSInteger) socket;
+- (void) acceptConnectionsOnSocket: (NSInteger) socket;
+- (void) closeConnection: (JFSocketEventLoopConnection *) connection;
+- (BOOL) flushConnection: (JFSocketEventLoopConnection *) connection;
+
+- (void) runRing;
+- (void) handleCompletionWithUserData: (UInt64) userData result: (int) result flags: (UInt32) flags;
+- (JFSocketEventLoopConnection *) connectionForUserData: (UInt64) userData;
+- (void) submitWake;
+- (void) submitAcceptOnSocket: (NSInteger) socket;
+- (void) submitAcceptRetryOnSocket: (NSInteger) socket;
+- (void) submitReceiveForConnection: (JFSocketEventLoopConnection *) connection;
+- (void) submitWriteForConnection: (JFSocketEventLoopConnection *) connection;
+- (BOOL) flushRingConnection: (JFSocketEventLoopConnection *) connection;
+- (BOOL) updateFixedFileSlot: (NSInteger) slot withSocket: (int) socket;
+
+- (void) recordHandlerReturnForConnection: (JFSocketEventLoopConnection *) connection readTime: (UInt64) readTime;
+- (void) recordFlushForConnection: (JFSocketEventLoopConnection *) connection;
+
+- (void) countControlCalls: (NSUInteger) count;
+
++ (NSArray *) eventLoopsPerCoreOnPort: (UInt16) port backend: (NSUInteger) backend acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler;
++ (void) runEventLoops: (NSArray *) eventLoops;
++ (void) abandonEventLoops: (NSArray *) eventLoops;
+
+@end
+
+
+/*
+ * Connects a blocking client socket with Nagle's algorithm disabled to the port on the loopback interface.
+ *
+ * Return
+ *		The socket or -1 on error.
+ */
+static int JFSocketEventLoopBenchmarkConnect(UInt16 port) {
+
+	int clientSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (clientSocket < 0) {
+		return -1;
+	}
+
+	int enabled = 1;
+	setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+
+	if (connect(clientSocket, (struct sockaddr *) &address, sizeof(address)) != 0) {
+		close(clientSocket);
+		return -1;
+	}
+
+	return clientSocket;
+}
+
+/*
+ * Sends (when sending) or receives the whole length on a blocking socket.
+ *
+ * Return
+ *		NO if the socket failed or the peer closed it.
+ */
+static BOOL JFSocketEventLoopBenchmarkTransfer(int socket, UInt8 *bytes, NSUInteger length, BOOL sending) {
+
+	while (length > 0) {
+		ssize_t result = sending ? send(socket, bytes, length, MSG_NOSIGNAL) : recv(socket, bytes, length, 0);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			return NO;
+		}
+
+		bytes += result;
+		length -= result;
+	}
+
+	return YES;
+}
+
+/*
+ * Drives the connections until the deadline, each sending a request and waiting for its echo in turn.
+ * Every connection has a request in flight at once, so the connections load the loops concurrently.
+ */
+static void JFSocketEventLoopBenchmarkDrive(int *sockets, NSUInteger socketCount, NSUInteger requestLength, UInt64 deadline, UInt64 *requestCount, UInt64 *latencyBuckets) {
+
+	UInt8 *request = malloc(requestLength);
+	UInt8 *response = malloc(requestLength);
+	UInt64 *starts = malloc(socketCount * sizeof(UInt64));
+
+	if (request != NULL && response != NULL && starts != NULL) {
+		memset(request, 'x', requestLength);
+
+		while (JFLatencyHistogramNow() < deadline) {
+			for (NSUInteger index = 0; index < socketCount; index++) {
+				starts[index] = JFLatencyHistogramNow();
+				if (sockets[index] >= 0 && !JFSocketEventLoopBenchmarkTransfer(sockets[index], request, requestLength, YES)) {
+					close(sockets[index]);
+					sockets[index] = -1;
+				}
+			}
+
+			for (NSUInteger index = 0; index < socketCount; index++) {
+				if (sockets[index] < 0) {
+					continue;
+				}
+				if (!JFSocketEventLoopBenchmarkTransfer(sockets[index], response, requestLength, NO)) {
+					close(sockets[index]);
+					sockets[index] = -1;
+					continue;
+				}
+
+				JFLatencyHistogramRecordSince(latencyBuckets, starts[index]);
+				__atomic_fetch_add(requestCount, 1, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	JFFree(request);
+	JFFree(response);
+	JFFree(starts);
+}
+
+
+@implementation JFSocketEventLoop
+
+
+#pragma mark - Properties
+
+@synthesize backend = _backend;
+@synthesize statisticsEnabled = _statisticsEnabled;
+
+/*
+ * Enables or disables statistics for the sockets added from now on, and the loop's own call counts.
+ * Set it before running the loop, or from the thread running it.
+ */
+- (void) setStatisticsEnabled: (BOOL) statisticsEnabled {
+
+	_statisticsEnabled = statisticsEnabled;
+
+	if (_ring != NULL) {
+		_ring->controlCallCount = (statisticsEnabled && _totalStatistics != NULL) ? &_totalStatistics->controlCallCount : NULL;
+	}
+}
+
+- (NSUInteger) socketCount {
+
+	return [_connections count];
+}
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) init {
+
+	return [self initWithBackend: JFSocketEventLoopBackendEpoll];
+}
+
+/*
+ * Initializes a loop driven by the backend, falling back to epoll if io_uring is requested but unavailable.
+ */
+- (id) initWithBackend: (NSUInteger) backend {
+
+	self = [super init];
+
+	if (self) {
+		_epoll = -1;
+		_wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_wakeDescriptor < 0) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+
+		_backend = JFSocketEventLoopBackendEpoll;
+
+		if (backend == JFSocketEventLoopBackendIOUring) {
+			_ring = malloc(sizeof(JFSocketEventLoopRing));
+			if (_ring != NULL && JFSocketEventLoopRingSetUp(_ring)) {
+				_backend = JFSocketEventLoopBackendIOUring;
+			} else {
+				JFFree(_ring);
+			}
+		}
+
+		if (_backend == JFSocketEventLoopBackendEpoll) {
+			_epoll = epoll_create1(EPOLL_CLOEXEC);
+
+			struct epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			event.data.fd = _wakeDescriptor;
+
+			if (_epoll < 0 || epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeDescriptor, &event) != 0) {
+#if !__has_feature(objc_arc) // NON ARC
+				[self release];
+#endif
+				return nil;
+			}
+		}
+
+		_connections = [[NSMutableDictionary alloc] init];
+		_listeners = [[NSMutableDictionary alloc] init];
+		_closingConnections = [[NSMutableDictionary alloc] init];
+
+		if (posix_memalign((void **) &_totalStatistics, 64, sizeof(JFSocketStatistics)) != 0) {
+			_totalStatistics = NULL;
+		} else {
+			memset(_totalStatistics, 0, sizeof(JFSocketStatistics));
+		}
+	}
+
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+
+	for (NSNumber *socket in [_connections allKeys]) {
+		close([socket intValue]);
+	}
+	for (NSNumber *socket in [_listeners allKeys]) {
+		close([socket intValue]);
+	}
+	if (_ring != NULL) {
+		// Tearing the ring down also drops its in-flight requests.
+		JFSocketEventLoopRingTearDown(_ring);
+		JFFree(_ring);
+	}
+	if (_wakeDescriptor >= 0) {
+		close(_wakeDescriptor);
+	}
+	if (_epoll >= 0) {
+		close(_epoll);
+	}
+	JFFree(_totalStatistics);
+}
+
+#else
+
+- (void) dealloc {
+
+	for (NSNumber *socket in [_connections allKeys]) {
+		close([socket intValue]);
+	}
+	for (NSNumber *socket in [_listeners allKeys]) {
+		close([socket intValue]);
+	}
+	if (_ring != NULL) {
+		// Tearing the ring down also drops its in-flight requests.
+		JFSocketEventLoopRingTearDown(_ring);
+		JFFree(_ring);
+	}
+	if (_wakeDescriptor >= 0) {
+		close(_wakeDescriptor);
+	}
+	if (_epoll >= 0) {
+		close(_epoll);
+	}
+	JFRelease(_connections);
+	JFRelease(_listeners);
+	JFRelease(_closingConnections);
+	JFFree(_totalStatistics);
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Methods
+
+/*
+ * Creates a non-blocking IPv4 socket listening on all interfaces on the port.
+ *
+ * Params
+ *		port		The port to listen on.
+ *		reusePort	Whether other sockets may listen on the same port, in which case the kernel
+ *					distributes incoming connections across them (SO_REUSEPORT).
+ *
+ * Return
+ *		The listening socket or -1 on error.
+ */
++ (NSInteger) listeningSocketOnPort: (UInt16) port reusePort: (BOOL) reusePort {
+
+	int listeningSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listeningSocket < 0) {
+		return -1;
+	}
+
+	int enabled = 1;
+	setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+	if (reusePort && setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled)) != 0) {
+		close(listeningSocket);
+		return -1;
+	}
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (bind(listeningSocket, (struct sockaddr *) &address, sizeof(address)) != 0
+		|| listen(listeningSocket, JFSocketEventLoopListenBacklog) != 0) {
+		close(listeningSocket);
+		return -1;
+	}
+
+	return listeningSocket;
+}
+
+/*
+ * Starts one event loop per active processor, each on its own thread with its own SO_REUSEPORT
+ * listening socket, so the kernel spreads incoming connections across the cores without a shared accept lock.
+ *
+ * Return
+ *		The running event loops (stop them to shut down) or nil if the listening sockets could not be created.
+ */
++ (NSArray *) startEventLoopsPerCoreOnPort: (UInt16) port acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler {
+
+	return [self startEventLoopsPerCoreOnPort: port
+									  backend: JFSocketEventLoopBackendEpoll
+								acceptHandler: acceptHandler];
+}
+
++ (NSArray *) startEventLoopsPerCoreOnPort: (UInt16) port backend: (NSUInteger) backend acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler {
+
+	NSArray *eventLoops = [self eventLoopsPerCoreOnPort: port
+												backend: backend
+										  acceptHandler: acceptHandler];
+	JFReturnNilIfNil(eventLoops);
+
+	[self runEventLoops: eventLoops];
+
+	return eventLoops;
+}
+
+/*
+ * Measures a loopback echo server of one event loop per core (see startEventLoopsPerCoreOnPort:backend:acceptHandler:)
+ * driven by blocking clients for JFSocketEventLoopBenchmarkDuration seconds, every connection keeping one request in flight.
+ *
+ * Params
+ *		port				A free port to listen on.
+ *		connectionCount		The number of client connections.
+ *		requestLength		The number of bytes of each request (and its echo).
+ *		backend				The backend driving the loops.
+ *
+ * Return
+ *		The connections made, the requests per second, the 99th percentile request latency in nanoseconds,
+ *		the server's system calls per request and the backend actually used (NSNumbers keyed by
+ *		JFSocketEventLoopBenchmarkConnectionCountKey, JFSocketEventLoopBenchmarkRequestsPerSecondKey,
+ *		JFSocketEventLoopBenchmarkP99LatencyKey, JFSocketEventLoopBenchmarkSyscallsPerRequestKey
+ *		and JFSocketEventLoopBenchmarkBackendKey) or nil if the loops could not be started.
+ */
++ (NSDictionary *) benchmarkEchoOnPort: (UInt16) port connectionCount: (NSUInteger) connectionCount requestLength: (NSUInteger) requestLength backend: (NSUInteger) backend {
+
+	if (connectionCount == 0 || requestLength == 0) {
+		return nil;
+	}
+
+	NSArray *eventLoops = [self eventLoopsPerCoreOnPort: port
+												backend: backend
+										  acceptHandler: ^(JFSocketEventLoop *eventLoop, NSInteger socket) {
+		[eventLoop addSocket: socket
+				 readHandler: ^(JFSocketReader *reader, JFSocketWriter *writer) {
+			NSUInteger byteCount = [reader byteCount];
+			[writer enqueueData: [NSData dataWithBytes: [reader contiguousBytesOfLength: byteCount] length: byteCount]];
+			[reader consumeByteCount: byteCount];
+		}
+				writeHandler: nil
+				closeHandler: nil];
+	}];
+	JFReturnNilIfNil(eventLoops);
+
+	// Count every call the loops make, from their first wait on.
+	for (JFSocketEventLoop *eventLoop in eventLoops) {
+		[eventLoop setStatisticsEnabled: YES];
+	}
+	[self runEventLoops: eventLoops];
+
+	int *sockets = malloc(connectionCount * sizeof(int));
+	UInt64 *latencyBuckets = calloc(JFLatencyHistogramBucketCount, sizeof(UInt64));
+	if (sockets == NULL || latencyBuckets == NULL) {
+		JFFree(sockets);
+		JFFree(latencyBuckets);
+		for (JFSocketEventLoop *eventLoop in eventLoops) {
+			[eventLoop stop];
+		}
+		return nil;
+	}
+
+	NSUInteger connectedCount = 0;
+	for (NSUInteger index = 0; index < connectionCount; index++) {
+		sockets[index] = JFSocketEventLoopBenchmarkConnect(port);
+		if (sockets[index] >= 0) {
+			connectedCount++;
+		}
+	}
+
+	// Each client thread drives a contiguous share of the connections.
+	NSUInteger threadCount = MIN(connectionCount, [[NSProcessInfo processInfo] activeProcessorCount]);
+	__block UInt64 requestCount = 0;
+	UInt64 start = JFLatencyHistogramNow();
+	UInt64 deadline = start + (UInt64) (JFSocketEventLoopBenchmarkDuration * 1000000000.0);
+
+	dispatch_apply(threadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+		NSUInteger first = connectionCount * thread / threadCount;
+		NSUInteger last = connectionCount * (thread + 1) / threadCount;
+		JFSocketEventLoopBenchmarkDrive(sockets + first, last - first, requestLength, deadline, &requestCount, latencyBuckets);
+	});
+
+	UInt64 elapsed = JFLatencyHistogramNow() - start;
+
+	for (NSUInteger index = 0; index < connectionCount; index++) {
+		if (sockets[index] >= 0) {
+			close(sockets[index]);
+		}
+	}
+	JFSocketStatistics statistics;
+	memset(&statistics, 0, sizeof(statistics));
+	for (JFSocketEventLoop *eventLoop in eventLoops) {
+		[eventLoop stop];
+
+		JFSocketStatistics loopStatistics = [eventLoop statistics];
+		JFSocketStatisticsAccumulate(&statistics, &loopStatistics);
+	}
+
+	// With epoll every read and write is a system call, whereas with io_uring they are counted as they complete
+	// and only the io_uring_enter calls (the waits and the control calls) enter the kernel.
+	NSUInteger usedBackend = [(JFSocketEventLoop *) [eventLoops objectAtIndex: 0] backend];
+	UInt64 syscallCount = statistics.waitCallCount + statistics.controlCallCount;
+	if (usedBackend == JFSocketEventLoopBackendEpoll) {
+		syscallCount += statistics.readCallCount + statistics.writeCallCount;
+	}
+
+	NSDictionary *results = [NSDictionary dictionaryWithObjectsAndKeys:
+							 [NSNumber numberWithUnsignedInteger: connectedCount], JFSocketEventLoopBenchmarkConnectionCountKey,
+							 [NSNumber numberWithDouble: requestCount / (elapsed / 1000000000.0)], JFSocketEventLoopBenchmarkRequestsPerSecondKey,
+							 [NSNumber numberWithUnsignedLongLong: JFLatencyHistogramPercentile(latencyBuckets, 0.99)], JFSocketEventLoopBenchmarkP99LatencyKey,
+							 [NSNumber numberWithDouble: (requestCount > 0) ? (double) syscallCount / requestCount : 0.0], JFSocketEventLoopBenchmarkSyscallsPerRequestKey,
+							 [NSNumber numberWithUnsignedInteger: usedBackend], JFSocketEventLoopBenchmarkBackendKey,
+							 nil];
+
+	JFFree(sockets);
+	JFFree(latencyBuckets);
+
+	return results;
+}
+
+/*
+ * Runs the echo benchmark (see benchmarkEchoOnPort:connectionCount:requestLength:backend:) on the epoll backend
+ * and then on the io_uring backend, to compare their requests per second and system calls per request.
+ *
+ * Params
+ *		port				A free port for the epoll run; the io_uring run listens on the next one,
+ *							as the epoll run's listening sockets may linger until its loops wind down.
+ *		connectionCount		The number of client connections.
+ *		requestLength		The number of bytes of each request (and its echo).
+ *
+ * Return
+ *		The results of each run keyed by JFSocketEventLoopBenchmarkEpollKey and JFSocketEventLoopBenchmarkIOUringKey,
+ *		the latter missing if io_uring is unavailable, or nil if the epoll run failed.
+ */
++ (NSDictionary *) benchmarkBackendsOnPort: (UInt16) port connectionCount: (NSUInteger) connectionCount requestLength: (NSUInteger) requestLength {
+
+	NSDictionary *epollResults = [self benchmarkEchoOnPort: port
+										   connectionCount: connectionCount
+											 requestLength: requestLength
+												   backend: JFSocketEventLoopBackendEpoll];
+	JFReturnNilIfNil(epollResults);
+
+	NSMutableDictionary *results = [NSMutableDictionary dictionaryWithObject: epollResults
+																	  forKey: JFSocketEventLoopBenchmarkEpollKey];
+
+	NSDictionary *ringResults = [self benchmarkEchoOnPort: port + 1
+										  connectionCount: connectionCount
+											requestLength: requestLength
+												  backend: JFSocketEventLoopBackendIOUring];
+	if ([[ringResults objectForKey: JFSocketEventLoopBenchmarkBackendKey] unsignedIntegerValue] == JFSocketEventLoopBackendIOUring) {
+		[results setObject: ringResults
+					forKey: JFSocketEventLoopBenchmarkIOUringKey];
+	}
+
+	return results;
+}
+
+/*
+ * Makes the socket non-blocking and watches it for edge-triggered readability and writability.
+ * The loop owns the socket from then on and closes it when the peer disconnects or it is removed.
+ * Must be called on the thread running the loop once the loop is running.
+ *
+ * Params
+ *		socket			The connected socket.
+ *		readHandler		Called after new bytes are read, to parse them from the reader and queue responses on the writer.
+ *		writeHandler	Called when the writer has drained, to queue more output (may be nil).
+ *		closeHandler	Called once the socket has been closed (may be nil).
+ *
+ * Return
+ *		YES if the socket was added.
+ */
+- (BOOL) addSocket: (NSInteger) socket readHandler: (JFSocketEventLoopReadHandler) readHandler writeHandler: (JFSocketEventLoopWriteHandler) writeHandler closeHandler: (JFSocketEventLoopCloseHandler) closeHandler {
+
+	JFReturnNoIfNil(readHandler);
+
+	int flags = fcntl((int) socket, F_GETFL, 0);
+	[self countControlCalls: (flags < 0) ? 1 : 2];
+	if (flags < 0 || fcntl((int) socket, F_SETFL, flags | O_NONBLOCK) != 0) {
+		return NO;
+	}
+
+	JFSocketEventLoopConnection *connection = [[JFSocketEventLoopConnection alloc] init];
+	connection->_socket = socket;
+	connection->_reader = [[JFSocketReader alloc] initWithSocket: socket];
+	connection->_writer = [[JFSocketWriter alloc] initWithSocket: socket];
+	connection->_readHandler = [readHandler copy];
+	connection->_writeHandler = [writeHandler copy];
+	connection->_closeHandler = [closeHandler copy];
+
+	if (_statisticsEnabled && _totalStatistics != NULL && posix_memalign((void **) &connection->_statistics, 64, sizeof(JFSocketStatistics)) == 0) {
+		memset(connection->_statistics, 0, sizeof(JFSocketStatistics));
+		[connection->_reader setStatistics: connection->_statistics];
+		[connection->_reader setTotalStatistics: _totalStatistics];
+		[connection->_writer setStatistics: connection->_statistics];
+		[connection->_writer setTotalStatistics: _totalStatistics];
+	}
+
+	BOOL added = NO;
+	if (_backend == JFSocketEventLoopBackendIOUring) {
+		if (connection->_reader != nil) {
+			connection->_generation = _nextGeneration++;
+			connection->_fixed = [self updateFixedFileSlot: socket
+												withSocket: (int) socket];
+			[self countControlCalls: (socket < JFSocketEventLoopFixedFileCount) ? 1 : 0];
+			[_connections setObject: connection
+							 forKey: [NSNumber numberWithInteger: socket]];
+			[self submitReceiveForConnection: connection];
+			added = YES;
+		}
+	} else {
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.fd = (int) socket;
+
+		[self countControlCalls: (connection->_reader != nil) ? 1 : 0];
+		if (connection->_reader != nil && epoll_ctl(_epoll, EPOLL_CTL_ADD, (int) socket, &event) == 0) {
+			[_connections setObject: connection
+							 forKey: [NSNumber numberWithInteger: socket]];
+			added = YES;
+		}
+	}
+
+#if !__has_feature(objc_arc) // NON ARC
+	[connection release];
+#endif
+
+	return added;
+}
+
+/*
+ * Watches the listening socket and accepts its incoming connections, passing each to the accept handler
+ * (which normally adds it to the loop with addSocket:readHandler:writeHandler:closeHandler:).
+ *
+ * Return
+ *		YES if the socket was added.
+ */
+- (BOOL) addListeningSocket: (NSInteger) socket acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler {
+
+	JFReturnNoIfNil(acceptHandler);
+
+	if (socket < 0) {
+		return NO;
+	}
+
+	int flags = fcntl((int) socket, F_GETFL, 0);
+	if (flags < 0 || fcntl((int) socket, F_SETFL, flags | O_NONBLOCK) != 0) {
+		return NO;
+	}
+
+	if (_backend == JFSocketEventLoopBackendEpoll) {
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | EPOLLET;
+		event.data.fd = (int) socket;
+
+		if (epoll_ctl(_epoll, EPOLL_CTL_ADD, (int) socket, &event) != 0) {
+			return NO;
+		}
+	}
+
+	id handler = [acceptHandler copy];
+	[_listeners setObject: handler
+				   forKey: [NSNumber numberWithInteger: socket]];
+#if !__has_feature(objc_arc) // NON ARC
+	[handler release];
+#endif
+
+	if (_backend == JFSocketEventLoopBackendIOUring) {
+		[self submitAcceptOnSocket: socket];
+	}
+
+	return YES;
+}
+
+/*
+ * Stops watching the socket and closes it.
+ * Must be called on the thread running the loop.
+ */
+- (void) removeSocket: (NSInteger) socket {
+
+	NSNumber *key = [NSNumber numberWithInteger: socket];
+
+	JFSocketEventLoopConnection *connection = [_connections objectForKey: key];
+	if (connection != nil) {
+		[self closeConnection: connection];
+		return;
+	}
+
+	if ([_listeners objectForKey: key] != nil) {
+		if (_backend == JFSocketEventLoopBackendIOUring) {
+			// The multishot accept holds its own reference to the socket, so cancel it explicitly.
+			struct io_uring_sqe *entry = JFSocketEventLoopRingNextSubmission(_ring);
+			if (entry != NULL) {
+				entry->opcode = IORING_OP_ASYNC_CANCEL;
+				entry->addr = JFSocketEventLoopUserData(JFSocketEventLoopOperationAccept, 0, socket);
+				entry->user_data = JFSocketEventLoopUserData(JFSocketEventLoopOperationCancel, 0, socket);
+			}
+		}
+
+		close((int) socket);
+		[_listeners removeObjectForKey: key];
+	}
+}
+
+/*
+ * Waits for and handles socket events on the calling thread until the loop is stopped.
+ */
+- (void) run {
+
+	if (_backend == JFSocketEventLoopBackendIOUring) {
+		[self runRing];
+		return;
+	}
+
+	struct epoll_event events[JFSocketEventLoopMaxEventCount];
+
+	while (!__atomic_load_n(&_stopped, __ATOMIC_ACQUIRE)) {
+		int eventCount = epoll_wait(_epoll, events, JFSocketEventLoopMaxEventCount, -1);
+		if (_statisticsEnabled && _totalStatistics != NULL) {
+			JFSocketStatisticsAdd(&_totalStatistics->waitCallCount, 1);
+		}
+		if (eventCount < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			break;
+		}
+
+		@autoreleasepool {
+			for (int index = 0; index < eventCount; index++) {
+				if (events[index].data.fd == _wakeDescriptor) {
+					eventfd_t value;
+					eventfd_read(_wakeDescriptor, &value);
+					[self countControlCalls: 1];
+					continue;
+				}
+
+				[self handleEvents: events[index].events
+						  onSocket: events[index].data.fd];
+			}
+		}
+	}
+}
+
+/*
+ * Asks the loop to return from run.  May be called from any thread.
+ */
+- (void) stop {
+
+	__atomic_store_n(&_stopped, YES, __ATOMIC_RELEASE);
+	eventfd_write(_wakeDescriptor, 1);
+}
+
+
+
+#pragma mark - Statistics methods
+
+/*
+ * Returns a snapshot of the totals of every socket the loop has handled while statistics were enabled.
+ * May be called from any thread.
+ */
+- (JFSocketStatistics) statistics {
+
+	JFSocketStatistics statistics;
+	memset(&statistics, 0, sizeof(statistics));
+
+	if (_totalStatistics != NULL) {
+		JFSocketStatisticsSnapshot(&statistics, _totalStatistics);
+	}
+
+	return statistics;
+}
+
+/*
+ * Copies the statistics of the socket.
+ * Must be called on the thread running the loop, typically from a handler.
+ *
+ * Return
+ *		NO if the socket is not in the loop or was added while statistics were disabled.
+ */
+- (BOOL) getStatistics: (JFSocketStatistics *) statistics forSocket: (NSInteger) socket {
+
+	JFSocketEventLoopConnection *connection = [_connections objectForKey: [NSNumber numberWithInteger: socket]];
+	if (statistics == NULL || connection == nil || connection->_statistics == NULL) {
+		return NO;
+	}
+
+	JFSocketStatisticsSnapshot(statistics, connection->_statistics);
+
+	return YES;
+}
+
+
+#pragma mark - Private methods
+
+- (void) handleEvents: (uint32_t) events onSocket: (NSInteger) socket {
+
+	NSNumber *key = [NSNumber numberWithInteger: socket];
+
+	if ([_listeners objectForKey: key] != nil) {
+		[self acceptConnectionsOnSocket: socket];
+		return;
+	}
+
+	JFSocketEventLoopConnection *connection = [_connections objectForKey: key];
+	if (connection == nil) {
+		// The connection was closed by an earlier event of the same batch.
+		return;
+	}
+
+	// Keep the connection alive even if a handler removes it.
+#if !__has_feature(objc_arc) // NON ARC
+	[[connection retain] autorelease];
+#endif
+
+	if (events & EPOLLERR) {
+		[self closeConnection: connection];
+		return;
+	}
+
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+		JFSocketReader *reader = connection->_reader;
+		NSInteger bytesRead;
+		BOOL full;
+
+		// A reader full at its maximum capacity leaves bytes in the kernel that edge triggering will not report again,
+		// so read again for as long as the handler makes room.
+		do {
+			UInt64 readTime = (connection->_statistics != NULL) ? JFLatencyHistogramNow() : 0;
+			bytesRead = [reader readUntilWouldBlock];
+			full = [reader isFull];
+
+			if (bytesRead > 0) {
+				connection->_readHandler(reader, connection->_writer);
+				[self recordHandlerReturnForConnection: connection
+											  readTime: readTime];
+				if ([_connections objectForKey: key] != connection) {
+					// The handler removed the connection.
+					return;
+				}
+			}
+
+			if (full && [reader isFull]) {
+				// The handler consumed nothing of a full buffer, so the connection can make no progress.
+				[self closeConnection: connection];
+				return;
+			}
+		} while (full && bytesRead > 0);
+
+		if (bytesRead < 0 || [reader endOfStream]) {
+			// Flush whatever the handler queued before closing.
+			[connection->_writer flush];
+			[self closeConnection: connection];
+			return;
+		}
+
+		if (![self flushConnection: connection]) {
+			return;
+		}
+	}
+
+	if (events & EPOLLOUT) {
+		[self flushConnection: connection];
+	}
+}
+
+/*
+ * Flushes the writer and, once it has drained, lets the write handler queue more.
+ *
+ * Return
+ *		NO if the connection was closed.
+ */
+- (BOOL) flushConnection: (JFSocketEventLoopConnection *) connection {
+
+	JFSocketWriter *writer = connection->_writer;
+	NSNumber *key = [NSNumber numberWithInteger: [writer socket]];
+
+	while (YES) {
+		if ([writer remainingByteCount] > 0 && [writer flush] < 0) {
+			[self closeConnection: connection];
+			return NO;
+		}
+
+		if ([writer remainingByteCount] == 0) {
+			[self recordFlushForConnection: connection];
+		}
+
+		if ([writer remainingByteCount] > 0 || connection->_writeHandler == nil) {
+			// Either the socket is full (the next EPOLLOUT edge resumes) or nobody wants to write more.
+			return YES;
+		}
+
+		connection->_writeHandler(writer);
+		if ([_connections objectForKey: key] != connection) {
+			return NO;
+		}
+
+		if ([writer remainingByteCount] == 0) {
+			return YES;
+		}
+	}
+}
+
+- (void) acceptConnectionsOnSocket: (NSInteger) socket {
+
+	JFSocketEventLoopAcceptHandler acceptHandler = [_listeners objectForKey: [NSNumber numberWithInteger: socket]];
+
+	// Edge-triggered, so accept until the backlog is empty.
+	while (YES) {
+		int connectedSocket = accept4((int) socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		[self countControlCalls: 1];
+		if (connectedSocket < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+
+			break;
+		}
+
+		acceptHandler(self, connectedSocket);
+	}
+}
+
+- (void) closeConnection: (JFSocketEventLoopConnection *) connection {
+
+	NSInteger socket = connection->_socket;
+
+#if !__has_feature(objc_arc) // NON ARC
+	[[connection retain] autorelease];
+#endif
+
+	if (_backend == JFSocketEventLoopBackendIOUring) {
+		if (connection->_writeInFlight) {
+			// The kernel may still be reading the writer's segments.
+			[_closingConnections setObject: connection
+									forKey: [NSNumber numberWithUnsignedLongLong: JFSocketEventLoopUserData(JFSocketEventLoopOperationWrite, connection->_generation, socket)]];
+		}
+
+		// Shutting down ends the multishot receive, whose reference to the socket outlives the fixed slot and descriptor.
+		shutdown((int) socket, SHUT_RDWR);
+		if (connection->_fixed) {
+			[self updateFixedFileSlot: socket
+						   withSocket: -1];
+		}
+		[self countControlCalls: connection->_fixed ? 2 : 1];
+	}
+
+	// Closing the descriptor also removes it from the epoll set.
+	close((int) socket);
+	[self countControlCalls: 1];
+
+	[_connections removeObjectForKey: [NSNumber numberWithInteger: socket]];
+
+	if (connection->_closeHandler != nil) {
+		connection->_closeHandler(socket);
+	}
+}
+
+/*
+ * Creates one event loop per active processor, each with its own SO_REUSEPORT listening socket, without running them.
+ *
+ * Return
+ *		The event loops or nil (having closed every listening socket) if any could not be created.
+ */
++ (NSArray *) eventLoopsPerCoreOnPort: (UInt16) port backend: (NSUInteger) backend acceptHandler: (JFSocketEventLoopAcceptHandler) acceptHandler {
+
+	JFReturnNilIfNil(acceptHandler);
+
+	NSUInteger coreCount = [[NSProcessInfo processInfo] activeProcessorCount];
+	NSMutableArray *eventLoops = [NSMutableArray arrayWithCapacity: coreCount];
+
+	for (NSUInteger core = 0; core < coreCount; core++) {
+		NSInteger listeningSocket = [self listeningSocketOnPort: port
+													  reusePort: YES];
+		if (listeningSocket < 0) {
+			[self abandonEventLoops: eventLoops];
+			return nil;
+		}
+
+		JFSocketEventLoop *eventLoop = [[JFSocketEventLoop alloc] initWithBackend: backend];
+		if (eventLoop == nil) {
+			close((int) listeningSocket);
+			[self abandonEventLoops: eventLoops];
+			return nil;
+		}
+
+		BOOL added = [eventLoop addListeningSocket: listeningSocket
+									 acceptHandler: acceptHandler];
+		if (added) {
+			[eventLoops addObject: eventLoop];
+		}
+#if !__has_feature(objc_arc) // NON ARC
+		[eventLoop release];
+#endif
+
+		if (!added) {
+			close((int) listeningSocket);
+			[self abandonEventLoops: eventLoops];
+			return nil;
+		}
+	}
+
+	return eventLoops;
+}
+
+/*
+ * Runs each event loop on a thread of its own.
+ */
++ (void) runEventLoops: (NSArray *) eventLoops {
+
+	for (JFSocketEventLoop *eventLoop in eventLoops) {
+		[NSThread detachNewThreadSelector: @selector(run)
+								 toTarget: eventLoop
+							   withObject: nil];
+	}
+}
+
+/*
+ * Closes the listening sockets of loops that never ran and stops them.
+ * Must be called before the loops run, as removing sockets is only safe on the thread running a loop.
+ */
++ (void) abandonEventLoops: (NSArray *) eventLoops {
+
+	for (JFSocketEventLoop *eventLoop in eventLoops) {
+		for (NSNumber *socket in [eventLoop->_listeners allKeys]) {
+			[eventLoop removeSocket: [socket integerValue]];
+		}
+		[eventLoop stop];
+	}
+}
+
+/*
+ * Counts system calls made by the loop itself rather than by a connection's reader or writer.
+ */
+- (void) countControlCalls: (NSUInteger) count {
+
+	if (_statisticsEnabled && _totalStatistics != NULL) {
+		JFSocketStatisticsAdd(&_totalStatistics->controlCallCount, count);
+	}
+}
+
+/*
+ * Counts how long reading the bytes and the read handler dealing with them took and, if it queued output,
+ * starts timing how long that output takes to be written.
+ */
+- (void) recordHandlerReturnForConnection: (JFSocketEventLoopConnection *) connection readTime: (UInt64) readTime {
+
+	JFReturnIfYes(connection->_statistics == NULL);
+
+	JFSocketStatisticsRecordLatency(connection->_statistics, _totalStatistics, offsetof(JFSocketStatistics, readToHandlerLatencyBuckets), readTime);
+
+	if ([connection->_writer remainingByteCount] > 0 && connection->_handlerReturnTime == 0) {
+		connection->_handlerReturnTime = JFLatencyHistogramNow();
+	}
+}
+
+/*
+ * Counts how long the output queued by the read handler took to be written, once the writer has drained.
+ */
+- (void) recordFlushForConnection: (JFSocketEventLoopConnection *) connection {
+
+	JFReturnIfYes(connection->_statistics == NULL || connection->_handlerReturnTime == 0);
+
+	JFSocketStatisticsRecordLatency(connection->_statistics, _totalStatistics, offsetof(JFSocketStatistics, handlerToFlushLatencyBuckets), connection->_handlerReturnTime);
+	connection->_handlerReturnTime = 0;
+}
+
+#pragma mark - io_uring methods
+
+/*
+ * Submits the queued requests and waits for completions in a single io_uring_enter call per batch,
+ * handling every completion of the batch before the next call.
+ */
+- (void) runRing {
+
+	[self submitWake];
+
+	while (!__atomic_load_n(&_stopped, __ATOMIC_ACQUIRE)) {
+		if (_ring->deferredCount > 0) {
+			JFSocketEventLoopRingQueueDeferred(_ring);
+		}
+
+		// Entries still held back must not wait behind a completion that may never come, so only submit then.
+		unsigned waitCount = (_ring->deferredCount > 0) ? 0 : 1;
+		if (JFSocketEventLoopRingSubmit(_ring, waitCount) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+			break;
+		}
+
+		if (waitCount > 0 && _statisticsEnabled && _totalStatistics != NULL) {
+			JFSocketStatisticsAdd(&_totalStatistics->waitCallCount, 1);
+		}
+
+		@autoreleasepool {
+			unsigned head = *_ring->completionHead;
+			unsigned tail = __atomic_load_n(_ring->completionTail, __ATOMIC_ACQUIRE);
+
+			for (; head != tail; head++) {
+				struct io_uring_cqe *completion = &_ring->completionEntries[head & _ring->completionMask];
+				UInt64 userData = completion->user_data;
+				int result = completion->res;
+				UInt32 flags = completion->flags;
+
+				// Release the entry before handling it, as handlers may submit enough to need the space.
+				__atomic_store_n(_ring->completionHead, head + 1, __ATOMIC_RELEASE);
+
+				[self handleCompletionWithUserData: userData
+											result: result
+											 flags: flags];
+			}
+		}
+	}
+}
+
+- (void) handleCompletionWithUserData: (UInt64) userData result: (int) result flags: (UInt32) flags {
+
+	int socket = JFSocketEventLoopUserDataSocket(userData);
+
+	switch (JFSocketEventLoopUserDataOperation(userData)) {
+		case JFSocketEventLoopOperationWake: {
+			eventfd_t value;
+			eventfd_read(_wakeDescriptor, &value);
+			[self countControlCalls: 1];
+			[self submitWake];
+			break;
+		}
+
+		case JFSocketEventLoopOperationAccept: {
+			JFSocketEventLoopAcceptHandler acceptHandler = [_listeners objectForKey: [NSNumber numberWithInt: socket]];
+			if (acceptHandler == nil) {
+				// The listening socket was removed.
+				break;
+			}
+
+			if (result >= 0) {
+				acceptHandler(self, result);
+			}
+
+			if ((flags & IORING_CQE_F_MORE) == 0 && [_listeners objectForKey: [NSNumber numberWithInt: socket]] != nil) {
+				if (result < 0) {
+					// The multishot accept failed, likely out of descriptors, so rearm it only after a pause.
+					[self submitAcceptRetryOnSocket: socket];
+				} else {
+					// The multishot accept ended, so rearm it.
+					[self submitAcceptOnSocket: socket];
+				}
+			}
+			break;
+		}
+
+		case JFSocketEventLoopOperationAcceptRetry: {
+			if ([_listeners objectForKey: [NSNumber numberWithInt: socket]] != nil) {
+				[self submitAcceptOnSocket: socket];
+			}
+			break;
+		}
+
+		case JFSocketEventLoopOperationReceive: {
+			JFSocketEventLoopConnection *connection = [self connectionForUserData: userData];
+			UInt16 bufferId = (UInt16) (flags >> IORING_CQE_BUFFER_SHIFT);
+			UInt64 readTime = (connection != nil && connection->_statistics != NULL) ? JFLatencyHistogramNow() : 0;
+
+			if (result > 0) {
+				// Copy out of the provided buffer so it can go straight back to the kernel.
+				if (connection != nil && ![connection->_reader appendBytes: _ring->buffers + bufferId * JFSocketEventLoopRingBufferSize
+																	length: result]) {
+					// The reader is at its maximum capacity, so the bytes cannot be kept and the stream is broken.
+					JFSocketEventLoopRingRecycleBuffer(_ring, bufferId);
+					[self closeConnection: connection];
+					break;
+				}
+				JFSocketEventLoopRingRecycleBuffer(_ring, bufferId);
+			}
+			if (connection == nil) {
+				break;
+			}
+
+#if !__has_feature(objc_arc) // NON ARC
+			[[connection retain] autorelease];
+#endif
+
+			if (result > 0) {
+				connection->_readHandler(connection->_reader, connection->_writer);
+				[self recordHandlerReturnForConnection: connection
+											  readTime: readTime];
+				if ([self flushRingConnection: connection] && (flags & IORING_CQE_F_MORE) == 0) {
+					[self submitReceiveForConnection: connection];
+				}
+			} else if (result == -ENOBUFS) {
+				// Every provided buffer was in use, so the multishot receive ended.
+				[self submitReceiveForConnection: connection];
+			} else if (result == -EINVAL && connection->_multishotReceive) {
+				// The kernel predates multishot receives (6.0), so arm single receives from now on.
+				_ring->singleShotReceives = YES;
+				[self submitReceiveForConnection: connection];
+			} else if (result == 0 && (connection->_writeInFlight || [connection->_writer remainingByteCount] > 0)) {
+				// Flush whatever the handler queued before closing.
+				connection->_closeWhenFlushed = YES;
+				[self flushRingConnection: connection];
+			} else {
+				[self closeConnection: connection];
+			}
+			break;
+		}
+
+		case JFSocketEventLoopOperationWrite: {
+			JFSocketEventLoopConnection *connection = [self connectionForUserData: userData];
+			if (connection == nil) {
+				[_closingConnections removeObjectForKey: [NSNumber numberWithUnsignedLongLong: userData]];
+				break;
+			}
+
+#if !__has_feature(objc_arc) // NON ARC
+			[[connection retain] autorelease];
+#endif
+
+			connection->_writeInFlight = NO;
+
+			if (connection->_statistics != NULL) {
+				JFSocketStatisticsCount(connection->_statistics, _totalStatistics, writeCallCount, 1);
+				if (result > 0) {
+					JFSocketStatisticsCount(connection->_statistics, _totalStatistics, bytesWritten, result);
+					if ((NSUInteger) result < connection->_requestedWriteByteCount) {
+						JFSocketStatisticsCount(connection->_statistics, _totalStatistics, shortWriteCount, 1);
+					}
+				} else if (result == -EAGAIN) {
+					JFSocketStatisticsCount(connection->_statistics, _totalStatistics, writeWouldBlockCount, 1);
+				}
+			}
+
+			if (result < 0 && result != -EAGAIN && result != -EINTR) {
+				[self closeConnection: connection];
+				break;
+			}
+
+			if (result > 0) {
+				[connection->_writer advanceByByteCount: result];
+			}
+
+			[self flushRingConnection: connection];
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+/*
+ * Returns the connection a completion belongs to, or nil if it belongs to one since closed.
+ */
+- (JFSocketEventLoopConnection *) connectionForUserData: (UInt64) userData {
+
+	JFSocketEventLoopConnection *connection = [_connections objectForKey: [NSNumber numberWithInt: JFSocketEventLoopUserDataSocket(userData)]];
+	if (connection == nil || (connection->_generation & 0xFFFFFF) != JFSocketEventLoopUserDataGeneration(userData)) {
+		return nil;
+	}
+
+	return connection;
+}
+
+- (void) submitWake {
+
+	struct io_uring_sqe *entry = JFSocketEventLoopRingNextSubmission(_ring);
+	JFReturnIfNil(entry);
+
+	entry->opcode = IORING_OP_POLL_ADD;
+	entry->fd = _wakeDescriptor;
+	entry->poll32_events = POLLIN;
+	entry->user_data = JFSocketEventLoopUserData(JFSocketEventLoopOperationWake, 0, _wakeDescriptor);
+}
+
+- (void) submitAcceptOnSocket: (NSInteger) socket {
+
+	struct io_uring_sqe *entry = JFSocketEventLoopRingNextSubmission(_ring);
+	JFReturnIfNil(entry);
+
+	entry->opcode = IORING_OP_ACCEPT;
+	entry->fd = (int) socket;
+	entry->ioprio = IORING_ACCEPT_MULTISHOT;
+	entry->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	entry->user_data = JFSocketEventLoopUserData(JFSocketEventLoopOperationAccept, 0, socket);
+}
+
+/*
+ * Queues a timeout after which the failed accept on the listening socket is rearmed.
+ */
+- (void) submitAcceptRetryOnSocket: (NSInteger) socket {
+
+	static const struct __kernel_timespec delay = { 0, JFSocketEventLoopAcceptRetryDelay };
+
+	struct io_uring_sqe *entry = JFSocketEventLoopRingNextSubmission(_ring);
+	JFReturnIfNil(entry);
+
+	entry->opcode = IORING_OP_TIMEOUT;
+	entry->addr = (UInt64) (uintptr_t) &delay;
+	entry->len = 1;
+	entry->user_data = JFSocketEventLoopUserData(JFSocketEventLoopOperationAcceptRetry, 0, socket);
+}
+
+/*
+ * Arms a multishot receive, which keeps completing into provided buffers until the peer closes or the buffers run out,
+ * or a single receive where the kernel rejected multishot ones.
+ */
+- (void) submitReceiveForConnection: (JFSocketEventLoopConnection *) connection {
+
+	struct io_uring_sqe *entry = JFSocketEventLoopRingNextSubmission(_ring);
+	JFReturnIfNil(entry);
+
+	entry->opcode = IORING_OP_RECV;
+	entry->fd = (int) connection->_socket;
+	entry->flags = IOSQE_BUFFER_SELECT | (connection->_fixed ? IOSQE_FIXED_FILE : 0);
+	entry->buf_group = JFSocketEventLoopRingBufferGroup;
+	connection->_multishotReceive = !_ring->singleShotReceives;
+	entry->ioprio = _ring->singleShotReceives ? 0 : IORING_RECV_MULTISHOT;
+	entry->user_data = JFSocketEventLoopUserData(JFSocketEventLoopOperationReceive, connection->_generation, connection->_socket);
+}
+
+/*
+ * Queues a sendmsg of the writer's first segments.  Only one write per connection is in flight at a time,
+ * so the segments stay queued (and valid) until its completion advances the writer.
+ */
+- (void) submitWriteForConnection: (JFSocketEventLoopConnection *) connection {
+
+	struct io_uring_sqe *entry = JFSocketEventLoopRingNextSubmission(_ring);
+	JFReturnIfNil(entry);
+
+	memset(&connection->_message, 0, sizeof(connection->_message));
+	connection->_message.msg_iov = connection->_vectors;
+	connection->_message.msg_iovlen = [connection->_writer fillVectors: connection->_vectors
+															  maxCount: JFSocketEventLoopRingVectorCount];
+
+	entry->opcode = IORING_OP_SENDMSG;
+	entry->fd = (int) connection->_socket;
+	entry->flags = connection->_fixed ? IOSQE_FIXED_FILE : 0;
+	entry->addr = (UInt64) (uintptr_t) &connection->_message;
+	entry->len = 1;
+	entry->msg_flags = MSG_NOSIGNAL;
+	entry->user_data = JFSocketEventLoopUserData(JFSocketEventLoopOperationWrite, connection->_generation, connection->_socket);
+
+	connection->_requestedWriteByteCount = 0;
+	for (size_t index = 0; index < connection->_message.msg_iovlen; index++) {
+		connection->_requestedWriteByteCount += connection->_vectors[index].iov_len;
+	}
+
+	connection->_writeInFlight = YES;
+}
+
+/*
+ * Queues a write of whatever the writer holds or, once it has drained, lets the write handler queue more.
+ *
+ * Return
+ *		NO if the connection was closed.
+ */
+- (BOOL) flushRingConnection: (JFSocketEventLoopConnection *) connection {
+
+	if (connection->_writeInFlight) {
+		return YES;
+	}
+
+	JFSocketWriter *writer = connection->_writer;
+
+	if ([writer remainingByteCount] == 0) {
+		[self recordFlushForConnection: connection];
+	}
+
+	if ([writer remainingByteCount] == 0 && connection->_writeHandler != nil && !connection->_closeWhenFlushed) {
+		connection->_writeHandler(writer);
+		if ([_connections objectForKey: [NSNumber numberWithInteger: connection->_socket]] != connection) {
+			return NO;
+		}
+	}
+
+	if ([writer remainingByteCount] > 0) {
+		[self submitWriteForConnection: connection];
+		return YES;
+	}
+
+	if (connection->_closeWhenFlushed) {
+		[self closeConnection: connection];
+		return NO;
+	}
+
+	return YES;
+}
+
+/*
+ * Points the fixed file slot numbered after the socket at it, or empties the slot when passed -1.
+ *
+ * Return
+ *		NO if the socket is numbered beyond the table and must be used without a slot.
+ */
+- (BOOL) updateFixedFileSlot: (NSInteger) slot withSocket: (int) socket {
+
+	if (slot < 0 || slot >= JFSocketEventLoopFixedFileCount) {
+		return NO;
+	}
+
+	int descriptors[1] = { socket };
+	struct io_uring_files_update update;
+	memset(&update, 0, sizeof(update));
+	update.offset = (UInt32) slot;
+	update.fds = (UInt64) (uintptr_t) descriptors;
+
+	return JFSocketEventLoopRingRegister(_ring->descriptor, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+}
+
+
+@end
+
+
+#endif
@@ -24,10 +24,73 @@
 #import <netinet/in.h>
 #import <sys/types.h>
 #import <arpa/inet.h>
+#import <sys/uio.h>
 
+#import "JFSocketStatistics.h"
 
-@interface JFSocketReader : NSObject
+
+#define JFSocketReaderDefaultCapacity	(NSUInteger) 65536
+
+// The size the ring buffer may grow to by default before the reader stops reading and leaves bytes in the kernel.
+#define JFSocketReaderDefaultMaximumCapacity	(NSUInteger) (16 * 1024 * 1024)
+
+// The most bytes readByteCount:fromSocket:intoData: reads per call.
+#define JFSocketReaderMaximumDirectReadLength	(NSUInteger) 200000
+
+// The keys of the results of benchmarkLoopbackThroughputWithByteCount:.
+#define JFSocketReaderBenchmarkOriginalKey		@"original"
+#define JFSocketReaderBenchmarkClassMethodKey	@"classMethod"
+#define JFSocketReaderBenchmarkRingBufferKey	@"ringBuffer"
+
+
+@interface JFSocketReader : NSObject {
+	
+	NSInteger		_socket;
+	
+	// The ring buffer holding the bytes read but not yet consumed.
+	UInt8			*_buffer;
+	NSUInteger		_capacity;
+	NSUInteger		_maximumCapacity;
+	NSUInteger		_head;
+	NSUInteger		_byteCount;
+	
+	// Whether the peer has closed its end of the connection.
+	BOOL			_endOfStream;
+	
+	// The statistics of this socket and the totals of all sockets (either may be NULL).
+	JFSocketStatistics	*_statistics;
+	JFSocketStatistics	*_totalStatistics;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) NSInteger socket;
+@property (nonatomic, readonly) NSUInteger capacity;
+@property (nonatomic, assign) NSUInteger maximumCapacity;
+@property (nonatomic, readonly, getter=isFull) BOOL full;
+@property (nonatomic, readonly) NSUInteger byteCount;
+@property (nonatomic, readonly) BOOL endOfStream;
+@property (nonatomic, assign) JFSocketStatistics *statistics;
+@property (nonatomic, assign) JFSocketStatistics *totalStatistics;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithSocket: (NSInteger) socket;
+- (id) initWithSocket: (NSInteger) socket capacity: (NSUInteger) capacity;
+
+
+#pragma mark - Methods
 
 + (NSInteger) readByteCount: (NSUInteger) byteCount fromSocket: (NSInteger) socket intoData: (NSMutableData *) data;
++ (NSDictionary *) benchmarkLoopbackThroughputWithByteCount: (NSUInteger) byteCount;
+
+- (NSInteger) readFromSocket;
+- (NSInteger) readUntilWouldBlock;
+- (BOOL) appendBytes: (const void *) bytes length: (NSUInteger) length;
+- (const void *) contiguousBytesOfLength: (NSUInteger) length;
+- (void) consumeByteCount: (NSUInteger) byteCount;
+- (BOOL) ensureFreeByteCount: (NSUInteger) byteCount;
 
 @end
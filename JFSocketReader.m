@@ -20,28 +20,586 @@
 
 
 #import "JFSocketReader.h"
+#import "JFGC.h"
+#import "JFLatencyHistogram.h"
+#import <errno.h>
+#import <pthread.h>
+#import <string.h>
+#import <unistd.h>
+
+
+// The size of each write and read of the loopback benchmark.
+#define JFSocketReaderBenchmarkChunkLength	(NSUInteger) 65536
+
+// The benchmark's writes must not raise SIGPIPE if the reading side closes first.
+#ifdef MSG_NOSIGNAL
+#define JFSocketReaderBenchmarkSendFlags	MSG_NOSIGNAL
+#else
+#define JFSocketReaderBenchmarkSendFlags	0
+#endif
+
+
+@interface JFSocketReader (PrivateMethods)
+
+- (BOOL) resizeToCapacity: (NSUInteger) capacity;
+
+@end
+
+
+/*
+ * Connects a pair of blocking TCP sockets over the loopback interface.
+ *
+ * Return
+ *		NO if any step failed, in which case no socket is left open.
+ */
+static BOOL JFSocketReaderConnectLoopbackPair(int sockets[2]) {
+	
+	int listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (listeningSocket < 0) {
+		return NO;
+	}
+	
+	struct sockaddr_in address;
+	socklen_t addressLength = sizeof(address);
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	
+	if (bind(listeningSocket, (struct sockaddr *) &address, sizeof(address)) != 0
+		|| listen(listeningSocket, 1) != 0
+		|| getsockname(listeningSocket, (struct sockaddr *) &address, &addressLength) != 0) {
+		close(listeningSocket);
+		return NO;
+	}
+	
+	sockets[0] = socket(AF_INET, SOCK_STREAM, 0);
+	if (sockets[0] < 0 || connect(sockets[0], (struct sockaddr *) &address, sizeof(address)) != 0) {
+		if (sockets[0] >= 0) {
+			close(sockets[0]);
+		}
+		close(listeningSocket);
+		return NO;
+	}
+	
+	sockets[1] = accept(listeningSocket, NULL, NULL);
+	close(listeningSocket);
+	
+	if (sockets[1] < 0) {
+		close(sockets[0]);
+		return NO;
+	}
+	
+	return YES;
+}
+
+/*
+ * Returns the calling thread's scratch buffer of JFSocketReaderMaximumDirectReadLength bytes,
+ * allocated (but never zero filled) on first use and freed when the thread exits.
+ */
+static UInt8 *JFSocketReaderThreadScratchBuffer(void) {
+	
+	static pthread_key_t key;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		pthread_key_create(&key, free);
+	});
+	
+	UInt8 *buffer = pthread_getspecific(key);
+	if (buffer == NULL) {
+		buffer = malloc(JFSocketReaderMaximumDirectReadLength);
+		if (buffer != NULL && pthread_setspecific(key, buffer) != 0) {
+			JFFree(buffer);
+		}
+	}
+	
+	return buffer;
+}
+
+/*
+ * Reads as readByteCount:fromSocket:intoData: originally did, into a 200000 byte stack buffer
+ * appended to the data, for the benchmark to compare against.
+ */
+static ssize_t JFSocketReaderBenchmarkOriginalRead(NSUInteger byteCount, int socket, NSMutableData *data) {
+	
+	NSUInteger limit = 200000;
+	char buffer[limit];
+	if (byteCount > limit) {
+		byteCount = limit;
+	}
+	ssize_t bytesRead = read(socket, buffer, byteCount);
+	
+	if (bytesRead > 0) {
+		[data appendBytes: buffer length: bytesRead];
+	}
+	
+	return bytesRead;
+}
+
+/*
+ * Writes the byte count to the socket in chunks on a background queue.
+ */
+static void JFSocketReaderBenchmarkWrite(int socket, NSUInteger byteCount, dispatch_group_t group) {
+	
+	dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		UInt8 *chunk = calloc(1, JFSocketReaderBenchmarkChunkLength);
+		NSUInteger remaining = (chunk != NULL) ? byteCount : 0;
+		
+		while (remaining > 0) {
+			ssize_t written = send(socket, chunk, MIN(remaining, JFSocketReaderBenchmarkChunkLength), JFSocketReaderBenchmarkSendFlags);
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+			if (written <= 0) {
+				break;
+			}
+			remaining -= written;
+		}
+		
+		JFFree(chunk);
+		
+		// Closing ends the reading side's loop even if the writes failed.
+		shutdown(socket, SHUT_WR);
+	});
+}
 
 
 @implementation JFSocketReader
 
+
+#pragma mark - Properties
+
+@synthesize socket = _socket;
+@synthesize capacity = _capacity;
+@synthesize maximumCapacity = _maximumCapacity;
+@synthesize byteCount = _byteCount;
+@synthesize endOfStream = _endOfStream;
+@synthesize statistics = _statistics;
+@synthesize totalStatistics = _totalStatistics;
+
+/*
+ * Sets the size the ring buffer may grow to, which is never less than its current capacity.
+ */
+- (void) setMaximumCapacity: (NSUInteger) maximumCapacity {
+	
+	_maximumCapacity = MAX(maximumCapacity, _capacity);
+}
+
+/*
+ * Returns YES if the buffer is full at its maximum capacity, so reads stop until bytes are consumed.
+ */
+- (BOOL) isFull {
+	
+	return _capacity >= _maximumCapacity && _byteCount == _capacity;
+}
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithSocket: (NSInteger) socket {
+	
+	return [self initWithSocket: socket
+					   capacity: JFSocketReaderDefaultCapacity];
+}
+
 /*
- * Reads as many as 200,000 bytes from the provided socket into the passed data.
+ * Initializes a reader owning a ring buffer of the given initial capacity.
+ * The buffer grows as needed up to the maximum capacity (JFSocketReaderDefaultMaximumCapacity unless set),
+ * beyond which unconsumed bytes are left in the kernel, so a peer sending faster than they are consumed
+ * is held back by TCP flow control rather than growing the buffer without limit.
+ */
+- (id) initWithSocket: (NSInteger) socket capacity: (NSUInteger) capacity {
+	
+	self = [super init];
+	
+	if (self) {
+		if (capacity == 0) {
+			capacity = JFSocketReaderDefaultCapacity;
+		}
+		
+		_buffer = malloc(capacity);
+		if (_buffer == NULL) {
+#if !__has_feature(objc_arc) // NON ARC
+			[self release];
+#endif
+			return nil;
+		}
+		
+		_socket = socket;
+		_capacity = capacity;
+		_maximumCapacity = MAX(capacity, JFSocketReaderDefaultMaximumCapacity);
+		_head = 0;
+		_byteCount = 0;
+	}
+	
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+- (void) dealloc {
+	
+	JFFree(_buffer);
+}
+
+#else
+
+- (void) dealloc {
+	
+	JFFree(_buffer);
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Methods
+
+/*
+ * Reads up to byteCount bytes (at most JFSocketReaderMaximumDirectReadLength) from the provided socket,
+ * appending them to the passed data.
  * Returns the actual numbers of bytes read.
  */
 + (NSInteger) readByteCount: (NSUInteger) byteCount fromSocket: (NSInteger) socket intoData: (NSMutableData *) data {
     
-	NSUInteger limit = 200000;
-    char buffer[limit];
-	if (byteCount > 200000) {
-		byteCount = limit;
+	if (byteCount == 0 || data == nil) {
+		return 0;
+	}
+	
+	byteCount = MIN(byteCount, JFSocketReaderMaximumDirectReadLength);
+	
+	/*
+	 * Setting the length of the data ahead of the read would zero fill the whole byte count on every call,
+	 * so read into a reused scratch buffer instead and append only what arrived,
+	 * letting the data grow by its capacity.
+	 */
+	UInt8 *buffer = JFSocketReaderThreadScratchBuffer();
+	if (buffer == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	
+	ssize_t bytesRead;
+	do {
+		bytesRead = read((int) socket, buffer, byteCount);
+	} while (bytesRead < 0 && errno == EINTR);
+	
+	if (bytesRead > 0) {
+		[data appendBytes: buffer
+				   length: bytesRead];
 	}
-    ssize_t bytesRead = read((int) socket, buffer, byteCount);
-    
-    if (bytesRead > 0) {
-        [data appendBytes: buffer length: bytesRead];
-    }
     
     return bytesRead;
 }
 
+/*
+ * Measures the throughput of reading the byte count over a loopback TCP connection,
+ * with the original read and append of readByteCount:fromSocket:intoData: (a fresh stack buffer per call),
+ * with its current scratch buffer read (both into a reused data) and with a reader's ring buffer.
+ *
+ * Params
+ *		byteCount	The number of bytes each way of reading receives.
+ *					Must be at least 1.
+ *
+ * Return
+ *		The bytes per second (NSNumber double) keyed by JFSocketReaderBenchmarkOriginalKey,
+ *		JFSocketReaderBenchmarkClassMethodKey and JFSocketReaderBenchmarkRingBufferKey,
+ *		or nil if the connection could not be made.
+ */
++ (NSDictionary *) benchmarkLoopbackThroughputWithByteCount: (NSUInteger) byteCount {
+	
+	if (byteCount == 0) {
+		return nil;
+	}
+	
+	NSMutableDictionary *results = [NSMutableDictionary dictionaryWithCapacity: 3];
+	NSArray *keys = [NSArray arrayWithObjects: JFSocketReaderBenchmarkOriginalKey, JFSocketReaderBenchmarkClassMethodKey, JFSocketReaderBenchmarkRingBufferKey, nil];
+	
+	for (NSString *key in keys) {
+		int sockets[2];
+		if (!JFSocketReaderConnectLoopbackPair(sockets)) {
+			return nil;
+		}
+		
+		dispatch_group_t group = dispatch_group_create();
+		UInt64 start = JFLatencyHistogramNow();
+		JFSocketReaderBenchmarkWrite(sockets[0], byteCount, group);
+		
+		NSUInteger received = 0;
+		
+		if ([key isEqualToString: JFSocketReaderBenchmarkOriginalKey]) {
+			NSMutableData *data = [NSMutableData dataWithCapacity: JFSocketReaderBenchmarkChunkLength];
+			
+			while (received < byteCount) {
+				[data setLength: 0];
+				ssize_t bytesRead = JFSocketReaderBenchmarkOriginalRead(JFSocketReaderBenchmarkChunkLength, sockets[1], data);
+				if (bytesRead <= 0) {
+					break;
+				}
+				received += bytesRead;
+			}
+		} else if ([key isEqualToString: JFSocketReaderBenchmarkClassMethodKey]) {
+			NSMutableData *data = [NSMutableData dataWithCapacity: JFSocketReaderBenchmarkChunkLength];
+			
+			while (received < byteCount) {
+				[data setLength: 0];
+				NSInteger bytesRead = [self readByteCount: JFSocketReaderBenchmarkChunkLength
+											   fromSocket: sockets[1]
+												 intoData: data];
+				if (bytesRead <= 0) {
+					break;
+				}
+				received += bytesRead;
+			}
+		} else {
+			JFSocketReader *reader = [[JFSocketReader alloc] initWithSocket: sockets[1]];
+			
+			while (received < byteCount) {
+				NSInteger bytesRead = [reader readFromSocket];
+				if (bytesRead <= 0) {
+					break;
+				}
+				received += bytesRead;
+				[reader consumeByteCount: [reader byteCount]];
+			}
+			
+#if !__has_feature(objc_arc) // NON ARC
+			[reader release];
+#endif
+		}
+		
+		UInt64 elapsed = JFLatencyHistogramNow() - start;
+		
+		// Closing the reading side unblocks the writer if the reads stopped early.
+		close(sockets[1]);
+		dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+		close(sockets[0]);
+#if !__has_feature(objc_arc) // NON ARC
+		dispatch_release(group);
+#endif
+		
+		[results setObject: [NSNumber numberWithDouble: received / (elapsed / 1000000000.0)]
+					forKey: key];
+	}
+	
+	return results;
+}
+
+/*
+ * Reads as much as fits into the free space of the ring buffer with a single readv call,
+ * growing the buffer first if it is full.
+ *
+ * Return
+ *		The number of bytes read, 0 when the peer closed the connection or -1 on error (with errno set),
+ *		errno being ENOBUFS, without any read, if the buffer is full at its maximum capacity.
+ */
+- (NSInteger) readFromSocket {
+	
+	if (_byteCount == _capacity) {
+		if (_capacity >= _maximumCapacity) {
+			// Leave the rest in the kernel until bytes are consumed.
+			errno = ENOBUFS;
+			return -1;
+		}
+		
+		if (![self ensureFreeByteCount: MIN(_capacity, _maximumCapacity - _capacity)]) {
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	
+	// The free space may wrap around the end of the buffer.
+	NSUInteger tail = (_head + _byteCount) % _capacity;
+	NSUInteger freeByteCount = _capacity - _byteCount;
+	struct iovec vectors[2];
+	int vectorCount = 1;
+	
+	vectors[0].iov_base = _buffer + tail;
+	if (tail + freeByteCount <= _capacity) {
+		vectors[0].iov_len = freeByteCount;
+	} else {
+		vectors[0].iov_len = _capacity - tail;
+		vectors[1].iov_base = _buffer;
+		vectors[1].iov_len = freeByteCount - vectors[0].iov_len;
+		vectorCount = 2;
+	}
+	
+	ssize_t bytesRead;
+	do {
+		bytesRead = readv((int) _socket, vectors, vectorCount);
+	} while (bytesRead < 0 && errno == EINTR);
+	
+	if (bytesRead > 0) {
+		_byteCount += bytesRead;
+	} else if (bytesRead == 0) {
+		_endOfStream = YES;
+	}
+	
+	if (_statistics != NULL || _totalStatistics != NULL) {
+		JFSocketStatisticsCount(_statistics, _totalStatistics, readCallCount, 1);
+		if (bytesRead > 0) {
+			JFSocketStatisticsCount(_statistics, _totalStatistics, bytesRead, bytesRead);
+		} else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			JFSocketStatisticsCount(_statistics, _totalStatistics, readWouldBlockCount, 1);
+		}
+	}
+	
+	return bytesRead;
+}
+
+/*
+ * Reads from a non-blocking socket until it would block or the peer closes the connection,
+ * as required when the socket is watched with an edge-triggered event loop.
+ * Reading also stops once the buffer is full at its maximum capacity (see isFull), in which case
+ * bytes may remain in the kernel and must be read again once some have been consumed.
+ *
+ * Return
+ *		The number of bytes read, 0 with endOfStream set when the peer closed the connection,
+ *		or -1 if an error other than EAGAIN occurred before anything was read.
+ */
+- (NSInteger) readUntilWouldBlock {
+	
+	NSInteger totalBytesRead = 0;
+	BOOL previousReadShort = NO;
+	
+	while (YES) {
+		NSUInteger byteCount = _byteCount;
+		NSInteger bytesRead = [self readFromSocket];
+		if (bytesRead <= 0) {
+			if (bytesRead < 0 && totalBytesRead == 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+				return -1;
+			}
+			
+			break;
+		}
+		
+		// A read filling less than the free space was only short if the socket held more, as this read shows.
+		if (previousReadShort) {
+			JFSocketStatisticsCount(_statistics, _totalStatistics, shortReadCount, 1);
+		}
+		previousReadShort = (NSUInteger) bytesRead < _capacity - byteCount;
+		
+		totalBytesRead += bytesRead;
+	}
+	
+	return totalBytesRead;
+}
+
+/*
+ * Appends bytes received by other means (such as an io_uring completion) as if they had been read from the socket.
+ *
+ * Return
+ *		NO if the buffer could not grow to hold them, including beyond its maximum capacity.
+ */
+- (BOOL) appendBytes: (const void *) bytes length: (NSUInteger) length {
+	
+	if (![self ensureFreeByteCount: length]) {
+		return NO;
+	}
+	
+	NSUInteger tail = (_head + _byteCount) % _capacity;
+	NSUInteger firstLength = MIN(length, _capacity - tail);
+	memcpy(_buffer + tail, bytes, firstLength);
+	memcpy(_buffer, (const UInt8 *) bytes + firstLength, length - firstLength);
+	_byteCount += length;
+	
+	if (_statistics != NULL || _totalStatistics != NULL) {
+		JFSocketStatisticsCount(_statistics, _totalStatistics, readCallCount, 1);
+		JFSocketStatisticsCount(_statistics, _totalStatistics, bytesRead, length);
+	}
+	
+	return YES;
+}
+
+/*
+ * Returns a pointer to the first length unconsumed bytes, laid out contiguously.
+ * The bytes are moved to the front of the buffer only when they wrap around its end.
+ * The pointer stays valid until the next read, consume or resize.
+ *
+ * Return
+ *		The bytes or NULL if fewer than length bytes are buffered.
+ */
+- (const void *) contiguousBytesOfLength: (NSUInteger) length {
+	
+	if (length > _byteCount) {
+		return NULL;
+	}
+	
+	if (_head + length > _capacity) {
+		// The bytes wrap so linearize the buffer.
+		if (![self resizeToCapacity: _capacity]) {
+			return NULL;
+		}
+	}
+	
+	return _buffer + _head;
+}
+
+/*
+ * Discards the first byteCount unconsumed bytes, typically once they have been parsed.
+ */
+- (void) consumeByteCount: (NSUInteger) byteCount {
+	
+	if (byteCount >= _byteCount) {
+		// Rewinding an empty buffer keeps future reads and views contiguous.
+		_head = 0;
+		_byteCount = 0;
+		return;
+	}
+	
+	_head = (_head + byteCount) % _capacity;
+	_byteCount -= byteCount;
+}
+
+/*
+ * Grows the buffer, if needed, so that at least byteCount bytes can be read without consuming.
+ * The buffer doubles as it grows but never beyond the maximum capacity.
+ *
+ * Return
+ *		NO if that would take the buffer beyond its maximum capacity or the memory could not be allocated.
+ */
+- (BOOL) ensureFreeByteCount: (NSUInteger) byteCount {
+	
+	if (_capacity - _byteCount >= byteCount) {
+		return YES;
+	}
+	
+	if (byteCount > _maximumCapacity - _byteCount) {
+		return NO;
+	}
+	
+	NSUInteger capacity = _capacity;
+	while (capacity - _byteCount < byteCount) {
+		capacity *= 2;
+	}
+	
+	return [self resizeToCapacity: MIN(capacity, _maximumCapacity)];
+}
+
+
+#pragma mark - Private methods
+
+/*
+ * Moves the unconsumed bytes to the front of a buffer of the given capacity.
+ */
+- (BOOL) resizeToCapacity: (NSUInteger) capacity {
+	
+	UInt8 *buffer = malloc(capacity);
+	if (buffer == NULL) {
+		return NO;
+	}
+	
+	NSUInteger firstLength = MIN(_byteCount, _capacity - _head);
+	memcpy(buffer, _buffer + _head, firstLength);
+	memcpy(buffer + firstLength, _buffer, _byteCount - firstLength);
+	
+	free(_buffer);
+	_buffer = buffer;
+	_capacity = capacity;
+	_head = 0;
+	
+	return YES;
+}
+
 @end
@@ -0,0 +1,122 @@
+//
+//  JFSocketStatistics.h
+//  JFCommon
+//
+//  Created by Jason Fuerstenberg on 2026/10/19.
+//  Copyright 2026 Jason Fuerstenberg. All rights reserved.
+//
+//	Licensed under the Apache License, Version 2.0 (the "License");
+//	you may not use this file except in compliance with the License.
+//	You may obtain a copy of the License at
+//
+//	http://www.apache.org/licenses/LICENSE-2.0
+//
+//	Unless required by applicable law or agreed to in writing, software
+//	distributed under the License is distributed on an "AS IS" BASIS,
+//	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//	See the License for the specific language governing permissions and
+//	limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+#import "JFLatencyHistogram.h"
+
+
+/*
+ * The I/O statistics of a socket, or of every socket of an event loop.
+ * Latency buckets are described in JFLatencyHistogram.h.
+ *
+ * Each structure has a single writer (the thread reading and writing the socket), so counters are
+ * bumped with plain loads and stores that cannot tear, and can be snapshotted from any thread.
+ */
+typedef struct {
+
+	// The bytes read from and written to the socket.
+	UInt64 bytesRead;
+	UInt64 bytesWritten;
+
+	// The read and write calls made (with io_uring, the read and write completions).
+	UInt64 readCallCount;
+	UInt64 writeCallCount;
+
+	// The reads filling less than the free buffer space although more was available (the next read of the same
+	// drain returned data, which excludes the final read of every drain), and the writes sending less than was queued.
+	UInt64 shortReadCount;
+	UInt64 shortWriteCount;
+
+	// The reads and writes which failed with EAGAIN.
+	UInt64 readWouldBlockCount;
+	UInt64 writeWouldBlockCount;
+
+	// The epoll_wait or io_uring_enter calls made waiting for events (event loop totals only).
+	UInt64 waitCallCount;
+
+	// The other system calls the event loop made itself: accepts, descriptor flag changes, epoll_ctl, io_uring file
+	// table updates and submissions without waiting, shutdowns, closes and wake-up reads (event loop totals only).
+	UInt64 controlCallCount;
+
+	// The durations from starting to read bytes (with io_uring, from reaping their completion) to the read handler having dealt with them.
+	UInt64 readToHandlerLatencyBuckets[JFLatencyHistogramBucketCount];
+
+	// The durations from the read handler returning to everything it queued having been written.
+	UInt64 handlerToFlushLatencyBuckets[JFLatencyHistogramBucketCount];
+
+} __attribute__((aligned(64))) JFSocketStatistics;
+
+
+/*
+ * Adds the amount to a statistics counter.
+ * Must only be called by the single thread updating the statistics.
+ */
+static inline void JFSocketStatisticsAdd(UInt64 *counter, UInt64 amount) {
+
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+}
+
+// Counts into both the per-socket statistics and the totals, either of which may be NULL.
+#define JFSocketStatisticsCount(statistics, totalStatistics, counter, amount) { \
+	if ((statistics) != NULL) { JFSocketStatisticsAdd(&(statistics)->counter, (amount)); } \
+	if ((totalStatistics) != NULL) { JFSocketStatisticsAdd(&(totalStatistics)->counter, (amount)); } \
+}
+
+/*
+ * Counts the duration since the start timestamp into a latency histogram of both statistics, either of which may be NULL.
+ */
+static inline void JFSocketStatisticsRecordLatency(JFSocketStatistics *statistics, JFSocketStatistics *totalStatistics, size_t bucketsOffset, UInt64 start) {
+
+	UInt64 now = JFLatencyHistogramNow();
+	NSUInteger bucket = JFLatencyHistogramBucketForDuration((now > start) ? now - start : 0);
+
+	if (statistics != NULL) {
+		JFSocketStatisticsAdd((UInt64 *) ((UInt8 *) statistics + bucketsOffset) + bucket, 1);
+	}
+	if (totalStatistics != NULL) {
+		JFSocketStatisticsAdd((UInt64 *) ((UInt8 *) totalStatistics + bucketsOffset) + bucket, 1);
+	}
+}
+
+/*
+ * Copies the statistics counter by counter, so it is safe while another thread updates them.
+ */
+static inline void JFSocketStatisticsSnapshot(JFSocketStatistics *snapshot, const JFSocketStatistics *statistics) {
+
+	const UInt64 *source = (const UInt64 *) statistics;
+	UInt64 *destination = (UInt64 *) snapshot;
+
+	for (NSUInteger index = 0; index < sizeof(JFSocketStatistics) / sizeof(UInt64); index++) {
+		destination[index] = __atomic_load_n(&source[index], __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Adds the statistics into the total, counter by counter (for summing the totals of several event loops).
+ */
+static inline void JFSocketStatisticsAccumulate(JFSocketStatistics *total, const JFSocketStatistics *statistics) {
+
+	const UInt64 *source = (const UInt64 *) statistics;
+	UInt64 *destination = (UInt64 *) total;
+
+	for (NSUInteger index = 0; index < sizeof(JFSocketStatistics) / sizeof(UInt64); index++) {
+		destination[index] += __atomic_load_n(&source[index], __ATOMIC_RELAXED);
+	}
+}
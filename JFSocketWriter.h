@@ -24,10 +24,88 @@
 #import <netinet/in.h>
 #import <sys/types.h>
 #import <arpa/inet.h>
+#import <sys/uio.h>
+#import <limits.h>
 
+#import "JFSocketStatistics.h"
 
-@interface JFSocketWriter : NSObject
+
+// The most segments a single write sends, which sizes the writer's vector array.
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define JFSocketWriterMaxVectorCount	IOV_MAX
+#else
+#define JFSocketWriterMaxVectorCount	64
+#endif
+
+// The watermarks denoting an unbounded queue.
+#define JFSocketWriterNoWatermark			0
+
+// The byte size of the heap buffer used when a zero-copy transfer has to fall back to reading and writing.
+#define JFSocketWriterTransferBufferSize	(64 * 1024)
+
+
+@class JFSocketWriter;
+
+
+typedef void (^JFSocketWriterWatermarkHandler) (JFSocketWriter * /* writer */);
+
+
+@interface JFSocketWriter : NSObject {
+	
+	NSInteger		_socket;
+	
+	// The queued segments, the first of which may be partially written.
+	NSMutableArray	*_segments;
+	NSUInteger		_offset;
+	NSUInteger		_remainingByteCount;
+	
+	// The vectors of the segments being written, kept with the writer rather than on the stack.
+	struct iovec	_vectors[JFSocketWriterMaxVectorCount];
+	
+	// The queue is full from reaching the high watermark until it drains to the low watermark.
+	NSUInteger		_highWatermark;
+	NSUInteger		_lowWatermark;
+	BOOL			_full;
+	JFSocketWriterWatermarkHandler	_fullHandler;
+	JFSocketWriterWatermarkHandler	_drainedHandler;
+	
+	// The statistics of this socket and the totals of all sockets (either may be NULL).
+	JFSocketStatistics	*_statistics;
+	JFSocketStatistics	*_totalStatistics;
+}
+
+
+#pragma mark - Properties
+
+@property (nonatomic, readonly) NSInteger socket;
+@property (nonatomic, readonly) NSUInteger remainingByteCount;
+@property (nonatomic, assign) NSUInteger highWatermark;
+@property (nonatomic, assign) NSUInteger lowWatermark;
+@property (nonatomic, readonly, getter=isFull) BOOL full;
+@property (nonatomic, copy) JFSocketWriterWatermarkHandler fullHandler;
+@property (nonatomic, copy) JFSocketWriterWatermarkHandler drainedHandler;
+@property (nonatomic, assign) JFSocketStatistics *statistics;
+@property (nonatomic, assign) JFSocketStatistics *totalStatistics;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithSocket: (NSInteger) socket;
+
+
+#pragma mark - Methods
 
 + (NSInteger) writeData: (NSData *) data fromOffset: (NSUInteger) offset intoSocket: (NSInteger) socket;
++ (NSInteger) sendFile: (NSInteger) fileDescriptor offset: (off_t *) offset length: (NSUInteger) length intoSocket: (NSInteger) socket;
++ (NSInteger) splicePipe: (NSInteger) pipeDescriptor length: (NSUInteger) length intoSocket: (NSInteger) socket;
+
+- (NSInteger) splicePipe: (NSInteger) pipeDescriptor length: (NSUInteger) length;
+- (BOOL) enqueueData: (NSData *) data;
+- (BOOL) enqueueSegments: (NSArray *) segments;
+- (NSUInteger) segmentCount;
+- (NSInteger) writeToSocket;
+- (int) fillVectors: (struct iovec *) vectors maxCount: (int) maxCount;
+- (void) advanceByByteCount: (NSUInteger) byteCount;
+- (NSInteger) flush;
 
 @end
@@ -19,11 +19,80 @@
 //
 
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// Exposes splice.
+#define _GNU_SOURCE
+#endif
+
 #import "JFSocketWriter.h"
+#import "JFGC.h"
+#import "JFMacros.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+#if defined(__linux__)
+#import <sys/sendfile.h>
+#endif
+
+
+#ifdef MSG_NOSIGNAL
+#define JFSocketWriterSendFlags		MSG_NOSIGNAL
+#else
+#define JFSocketWriterSendFlags		0
+#endif
 
 
 @implementation JFSocketWriter
 
+
+#pragma mark - Properties
+
+@synthesize socket = _socket;
+@synthesize remainingByteCount = _remainingByteCount;
+@synthesize highWatermark = _highWatermark;
+@synthesize lowWatermark = _lowWatermark;
+@synthesize full = _full;
+@synthesize fullHandler = _fullHandler;
+@synthesize drainedHandler = _drainedHandler;
+@synthesize statistics = _statistics;
+@synthesize totalStatistics = _totalStatistics;
+
+
+#pragma mark - Object lifecycle methods
+
+- (id) initWithSocket: (NSInteger) socket {
+	
+	self = [super init];
+	
+	if (self) {
+		_socket = socket;
+		_segments = [[NSMutableArray alloc] init];
+		_offset = 0;
+		_remainingByteCount = 0;
+	}
+	
+	return self;
+}
+
+
+#if  __has_feature(objc_arc)
+
+#else
+
+- (void) dealloc {
+	
+	JFRelease(_segments);
+	JFRelease(_fullHandler);
+	JFRelease(_drainedHandler);
+	[super dealloc];
+}
+
+#endif
+
+
+#pragma mark - Methods
+
 /*
  * Writes bytes from the data into the provided socket.
  * Returns the number of bytes successfully written.
@@ -52,4 +121,408 @@
 	return write((int) socket, &buffer[offset], remainingLength);
 }
 
+/*
+ * Sends a range of the file straight from the kernel's page cache into the socket with sendfile,
+ * without copying it through user space.
+ * Stops early when a non-blocking socket is full, so the caller can resume from the advanced offset once it is writable.
+ *
+ * Params
+ *		fileDescriptor	The descriptor of the file (a regular file).
+ *		offset			The file offset to send from, advanced by the number of bytes sent.
+ *		length			The number of bytes to send.
+ *		socket			The socket to send to.
+ *
+ * Return
+ *		The number of bytes sent or -1 (with errno set) if an error (other than EAGAIN) occurred before anything was sent.
+ */
++ (NSInteger) sendFile: (NSInteger) fileDescriptor offset: (off_t *) offset length: (NSUInteger) length intoSocket: (NSInteger) socket {
+	
+	if (fileDescriptor < 0 || socket < 0 || offset == NULL) {
+		errno = (offset == NULL) ? EINVAL : EBADF;
+		return -1;
+	}
+	
+	NSUInteger totalBytesSent = 0;
+#if !defined(__linux__) && !defined(__APPLE__)
+	UInt8 *buffer = NULL;
+#endif
+	
+	while (totalBytesSent < length) {
+		NSUInteger remainingLength = length - totalBytesSent;
+		ssize_t bytesSent;
+		
+#if defined(__linux__)
+		bytesSent = sendfile((int) socket, (int) fileDescriptor, offset, MIN(remainingLength, (NSUInteger) 0x7ffff000));
+#elif defined(__APPLE__)
+		// Darwin reports the bytes sent through the length even when interrupted or out of space.
+		off_t sentLength = (off_t) remainingLength;
+		int result = sendfile((int) fileDescriptor, (int) socket, *offset, &sentLength, NULL, 0);
+		bytesSent = (sentLength > 0) ? (ssize_t) sentLength : result;
+		if (sentLength > 0) {
+			*offset += sentLength;
+		}
+#else
+		// Only what was written advances the offset, so a short write leaves the rest to be read again.
+		if (buffer == NULL && (buffer = malloc(JFSocketWriterTransferBufferSize)) == NULL) {
+			return (totalBytesSent > 0) ? (NSInteger) totalBytesSent : -1;
+		}
+		bytesSent = pread((int) fileDescriptor, buffer, MIN(remainingLength, JFSocketWriterTransferBufferSize), *offset);
+		if (bytesSent > 0) {
+			bytesSent = write((int) socket, buffer, bytesSent);
+			if (bytesSent > 0) {
+				*offset += bytesSent;
+			}
+		}
+#endif
+		
+		if (bytesSent < 0 && errno == EINTR) {
+			continue;
+		}
+		
+		if (bytesSent <= 0) {
+			// The socket is full, the file ended early or something failed.
+			if (bytesSent < 0 && totalBytesSent == 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+#if !defined(__linux__) && !defined(__APPLE__)
+				JFFree(buffer);
+#endif
+				return -1;
+			}
+			
+			break;
+		}
+		
+		totalBytesSent += bytesSent;
+	}
+	
+#if !defined(__linux__) && !defined(__APPLE__)
+	JFFree(buffer);
+#endif
+	
+	return totalBytesSent;
+}
+
+/*
+ * Moves bytes from the pipe into the socket with splice, without copying them through user space.
+ * Stops early when the pipe is empty or a non-blocking socket is full.
+ * Where splice is unavailable this fails with ENOTSUP, as bytes read out of the pipe that the socket does not take
+ * would have nowhere to go; use the instance method instead, which queues them on the writer.
+ *
+ * Return
+ *		The number of bytes moved or -1 (with errno set) if an error (other than EAGAIN) occurred before anything was moved.
+ */
++ (NSInteger) splicePipe: (NSInteger) pipeDescriptor length: (NSUInteger) length intoSocket: (NSInteger) socket {
+	
+	if (pipeDescriptor < 0 || socket < 0) {
+		errno = EBADF;
+		return -1;
+	}
+	
+#if defined(__linux__)
+	NSUInteger totalBytesMoved = 0;
+	
+	while (totalBytesMoved < length) {
+		ssize_t bytesMoved = splice((int) pipeDescriptor, NULL, (int) socket, NULL, length - totalBytesMoved, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		
+		if (bytesMoved < 0 && errno == EINTR) {
+			continue;
+		}
+		
+		if (bytesMoved <= 0) {
+			if (bytesMoved < 0 && totalBytesMoved == 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				return -1;
+			}
+			
+			break;
+		}
+		
+		totalBytesMoved += bytesMoved;
+	}
+	
+	return totalBytesMoved;
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/*
+ * Moves bytes from the pipe into the writer's socket, after any queued segments so the stream stays in order.
+ * With splice they never pass through user space.  Where splice is unavailable they are read through a heap buffer,
+ * and whatever the socket does not take is queued on the writer to be sent by the next flush.
+ * Stops early when the pipe is empty or a non-blocking socket is full, never waiting for either.
+ *
+ * Return
+ *		The number of bytes moved out of the pipe (sent or queued)
+ *		or -1 if an error (other than EAGAIN) occurred before anything was moved.
+ */
+- (NSInteger) splicePipe: (NSInteger) pipeDescriptor length: (NSUInteger) length {
+	
+	if (_remainingByteCount > 0) {
+		if ([self flush] < 0) {
+			return -1;
+		}
+		
+		if (_remainingByteCount > 0) {
+			// The socket is full, so resume once it is writable.
+			return 0;
+		}
+	}
+	
+#if defined(__linux__)
+	return [JFSocketWriter splicePipe: pipeDescriptor
+							   length: length
+						   intoSocket: _socket];
+#else
+	if (pipeDescriptor < 0 || _socket < 0) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	UInt8 *buffer = malloc(MIN(length, (NSUInteger) JFSocketWriterTransferBufferSize));
+	if (buffer == NULL && length > 0) {
+		return -1;
+	}
+	
+	NSInteger totalBytesMoved = 0;
+	
+	while ((NSUInteger) totalBytesMoved < length) {
+		ssize_t bytesRead = read((int) pipeDescriptor, buffer, MIN(length - totalBytesMoved, (NSUInteger) JFSocketWriterTransferBufferSize));
+		
+		if (bytesRead < 0 && errno == EINTR) {
+			continue;
+		}
+		
+		if (bytesRead <= 0) {
+			if (bytesRead < 0 && totalBytesMoved == 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				totalBytesMoved = -1;
+			}
+			
+			break;
+		}
+		
+		ssize_t bytesWritten;
+		do {
+			bytesWritten = write((int) _socket, buffer, bytesRead);
+		} while (bytesWritten < 0 && errno == EINTR);
+		
+		if (bytesWritten < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			// The bytes read cannot be delivered, so the stream is broken.
+			totalBytesMoved = -1;
+			break;
+		}
+		
+		totalBytesMoved += bytesRead;
+		
+		if (bytesWritten < bytesRead) {
+			// The bytes are already out of the pipe, so queue the unsent tail rather than wait for the socket.
+			NSUInteger sentLength = (bytesWritten > 0) ? bytesWritten : 0;
+			[self enqueueData: [NSData dataWithBytes: buffer + sentLength
+											  length: bytesRead - sentLength]];
+			break;
+		}
+	}
+	
+	JFFree(buffer);
+	
+	return totalBytesMoved;
+#endif
+}
+
+/*
+ * Queues the data to be written on the next write or flush.
+ * The data is retained, not copied, so it must not be mutated until written.
+ *
+ * Return
+ *		NO if the queue is full (see enqueueSegments:).
+ */
+- (BOOL) enqueueData: (NSData *) data {
+	
+	if ([data length] == 0) {
+		return YES;
+	}
+	
+	return [self enqueueSegments: [NSArray arrayWithObject: data]];
+}
+
+/*
+ * Queues all the segments or, if the queue is full, none of them.
+ * The queue becomes full once the queued bytes reach the high watermark, at which point the full handler is called,
+ * and stays full until writes drain it to the low watermark, at which point the drained handler is called.
+ * Producers should stop enqueueing in between, which keeps memory bounded while the peer reads slowly.
+ *
+ * Return
+ *		NO if the queue is full and the segments were not queued.
+ */
+- (BOOL) enqueueSegments: (NSArray *) segments {
+	
+	if (_full) {
+		return NO;
+	}
+	
+	for (NSData *segment in segments) {
+		NSUInteger length = [segment length];
+		JFSkipIfYes(length == 0);
+		
+		[_segments addObject: segment];
+		_remainingByteCount += length;
+	}
+	
+	if (_highWatermark != JFSocketWriterNoWatermark && _remainingByteCount >= _highWatermark) {
+		_full = YES;
+		
+		if (_fullHandler != nil) {
+			_fullHandler(self);
+		}
+	}
+	
+	return YES;
+}
+
+- (NSUInteger) segmentCount {
+	
+	return [_segments count];
+}
+
+/*
+ * Writes as many queued segments as the kernel accepts with a single sendmsg call
+ * (up to JFSocketWriterMaxVectorCount of them), advancing past whatever was written.
+ *
+ * Return
+ *		The number of bytes written or -1 on error (with errno set, EAGAIN for a full non-blocking socket).
+ */
+- (NSInteger) writeToSocket {
+	
+	if ([_segments count] == 0) {
+		return 0;
+	}
+	
+	struct iovec *vectors = _vectors;
+	int vectorCount = [self fillVectors: vectors
+							   maxCount: JFSocketWriterMaxVectorCount];
+	
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = vectors;
+	message.msg_iovlen = vectorCount;
+	
+	ssize_t bytesWritten;
+	do {
+		bytesWritten = sendmsg((int) _socket, &message, JFSocketWriterSendFlags);
+	} while (bytesWritten < 0 && errno == EINTR);
+	
+	if (bytesWritten < 0 && errno == ENOTSOCK) {
+		// Pipes and files do not support sendmsg.
+		do {
+			bytesWritten = writev((int) _socket, vectors, vectorCount);
+		} while (bytesWritten < 0 && errno == EINTR);
+	}
+	
+	if (_statistics != NULL || _totalStatistics != NULL) {
+		JFSocketStatisticsCount(_statistics, _totalStatistics, writeCallCount, 1);
+		if (bytesWritten > 0) {
+			NSUInteger requestedByteCount = 0;
+			for (int index = 0; index < vectorCount; index++) {
+				requestedByteCount += vectors[index].iov_len;
+			}
+			
+			JFSocketStatisticsCount(_statistics, _totalStatistics, bytesWritten, bytesWritten);
+			if ((NSUInteger) bytesWritten < requestedByteCount) {
+				JFSocketStatisticsCount(_statistics, _totalStatistics, shortWriteCount, 1);
+			}
+		} else if (bytesWritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			JFSocketStatisticsCount(_statistics, _totalStatistics, writeWouldBlockCount, 1);
+		}
+	}
+	
+	if (bytesWritten <= 0) {
+		return bytesWritten;
+	}
+	
+	[self advanceByByteCount: bytesWritten];
+	
+	return bytesWritten;
+}
+
+/*
+ * Describes the unwritten bytes of the first queued segments, for callers submitting the write themselves
+ * (such as an io_uring event loop).  The segments stay queued, and so their bytes valid, until advanced past.
+ *
+ * Return
+ *		The number of vectors filled.
+ */
+- (int) fillVectors: (struct iovec *) vectors maxCount: (int) maxCount {
+	
+	int vectorCount = (int) MIN([_segments count], (NSUInteger) maxCount);
+	
+	for (int index = 0; index < vectorCount; index++) {
+		NSData *segment = [_segments objectAtIndex: index];
+		NSUInteger offset = (index == 0) ? _offset : 0;
+		
+		vectors[index].iov_base = (UInt8 *) [segment bytes] + offset;
+		vectors[index].iov_len = [segment length] - offset;
+	}
+	
+	return vectorCount;
+}
+
+/*
+ * Drops the written bytes from the front of the queue, calling the drained handler if that drains a full queue.
+ */
+- (void) advanceByByteCount: (NSUInteger) byteCount {
+	
+	byteCount = MIN(byteCount, _remainingByteCount);
+	
+	// Drop the fully written segments and remember how far into the next one the write got.
+	NSUInteger unaccountedByteCount = byteCount;
+	NSUInteger writtenSegmentCount = 0;
+	while (unaccountedByteCount > 0) {
+		NSUInteger segmentRemainder = [[_segments objectAtIndex: writtenSegmentCount] length] - _offset;
+		if (unaccountedByteCount < segmentRemainder) {
+			_offset += unaccountedByteCount;
+			break;
+		}
+		
+		unaccountedByteCount -= segmentRemainder;
+		writtenSegmentCount++;
+		_offset = 0;
+	}
+	
+	[_segments removeObjectsInRange: NSMakeRange(0, writtenSegmentCount)];
+	_remainingByteCount -= byteCount;
+	
+	if (_full && _remainingByteCount <= MIN(_lowWatermark, _highWatermark)) {
+		_full = NO;
+		
+		if (_drainedHandler != nil) {
+			_drainedHandler(self);
+		}
+	}
+}
+
+/*
+ * Writes the queued segments until none remain or the socket would block.
+ *
+ * Return
+ *		The number of bytes written or -1 if an error other than EAGAIN occurred before anything was written.
+ */
+- (NSInteger) flush {
+	
+	NSInteger totalBytesWritten = 0;
+	
+	while (_remainingByteCount > 0) {
+		NSInteger bytesWritten = [self writeToSocket];
+		if (bytesWritten <= 0) {
+			if (bytesWritten < 0 && totalBytesWritten == 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				return -1;
+			}
+			
+			break;
+		}
+		
+		totalBytesWritten += bytesWritten;
+	}
+	
+	return totalBytesWritten;
+}
+
 @end